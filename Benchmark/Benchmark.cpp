@@ -0,0 +1,295 @@
+// Microbenchmarks for the CPU hot paths of the simulator. Needs neither an HMD nor
+// a GPU: only the GL-free sources of Minimal are compiled in.
+//
+// Windows: build the Benchmark project of MinimalStarter.sln.
+// Linux:   g++ -O2 -std=c++11 -pthread -I../Include/LibOVR -I../Minimal -I<path to glm>
+//              Benchmark.cpp ../Minimal/FileIO.cpp ../Minimal/SimControls.cpp
+//              ../Minimal/PoseBatch.cpp -o benchmark
+//
+// Usage:   benchmark [data dir] [--json results.json] [--compare baseline.json] [--filter text]
+//
+// The data dir is the Minimal directory (ppm faces and shaders). Every benchmark is
+// run as a number of timed samples; results are reported as the mean time per
+// operation with a 95% confidence interval. --json writes one JSON object per line,
+// --compare reads such a file from another commit and flags the benchmarks whose
+// intervals don't overlap.
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FileIO.h"
+#include "OvrGlm.h"
+#include "PoseBatch.h"
+#include "Projection.h"
+#include "SimControls.h"
+
+namespace {
+
+	// Keeps results alive so the optimizer can't drop the work being measured
+	volatile float sink;
+
+	struct Result {
+		std::string name;
+		int samples = 0;
+		long long iterations = 0; // per sample
+		double mean = 0, stddev = 0, median = 0, low = 0, high = 0; // ns per operation
+	};
+
+	// Two-sided 95% Student t critical values for 1..30 degrees of freedom
+	double tCritical(int df) {
+		static const double table[30] = {
+			12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+		if (df < 1) return 0.0;
+		return df <= 30 ? table[df - 1] : 1.96;
+	}
+
+	class Runner {
+	public:
+		std::string filter;
+		int maxSamples = 30;
+		int minSamples = 10;
+		double minSampleSeconds = 0.005;
+		double maxSeconds = 2.0;
+		std::vector<Result> results;
+
+		void run(const std::string & name, const std::function<void()> & op) {
+			if (!filter.empty() && name.find(filter) == std::string::npos) {
+				return;
+			}
+			typedef std::chrono::high_resolution_clock Clock;
+
+			// Warm up and find how many calls make a sample long enough to time reliably
+			long long iterations = 1;
+			while (true) {
+				auto start = Clock::now();
+				for (long long i = 0; i < iterations; i++) op();
+				double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+				if (seconds >= minSampleSeconds || iterations >= (1ll << 30)) break;
+				iterations *= 2;
+			}
+
+			std::vector<double> samples;
+			auto begin = Clock::now();
+			while ((int)samples.size() < maxSamples) {
+				auto start = Clock::now();
+				for (long long i = 0; i < iterations; i++) op();
+				auto end = Clock::now();
+				samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+				if ((int)samples.size() >= minSamples && std::chrono::duration<double>(end - begin).count() > maxSeconds) break;
+			}
+
+			Result r;
+			r.name = name;
+			r.samples = (int)samples.size();
+			r.iterations = iterations;
+			for (double s : samples) r.mean += s;
+			r.mean /= samples.size();
+			for (double s : samples) r.stddev += (s - r.mean) * (s - r.mean);
+			r.stddev = samples.size() > 1 ? std::sqrt(r.stddev / (samples.size() - 1)) : 0.0;
+			double half = tCritical(r.samples - 1) * r.stddev / std::sqrt((double)r.samples);
+			r.low = r.mean - half;
+			r.high = r.mean + half;
+			std::sort(samples.begin(), samples.end());
+			r.median = samples[samples.size() / 2];
+			results.push_back(r);
+
+			printf("%-40s %12.1f ns/op  +-%5.1f%%  (median %.1f, n=%d x %lld)\n", name.c_str(), r.mean,
+				r.mean > 0 ? 100.0 * half / r.mean : 0.0, r.median, r.samples, r.iterations);
+		}
+	};
+
+	std::string toJson(const Result & r) {
+		std::ostringstream out;
+		out.precision(10);
+		out << "{\"name\": \"" << r.name << "\", \"unit\": \"ns/op\", \"samples\": " << r.samples
+			<< ", \"iterations\": " << r.iterations << ", \"mean\": " << r.mean << ", \"stddev\": " << r.stddev
+			<< ", \"median\": " << r.median << ", \"ci95_low\": " << r.low << ", \"ci95_high\": " << r.high << "}";
+		return out.str();
+	}
+
+	// Reads back what toJson wrote, one object per line
+	std::map<std::string, Result> loadJson(const std::string & path) {
+		std::map<std::string, Result> results;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line)) {
+			auto field = [&](const char * key) -> std::string {
+				std::string token = std::string("\"") + key + "\": ";
+				size_t at = line.find(token);
+				if (at == std::string::npos) return "";
+				at += token.size();
+				if (line[at] == '"') return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+				return line.substr(at, line.find_first_of(",}", at) - at);
+			};
+			Result r;
+			r.name = field("name");
+			if (r.name.empty()) continue;
+			r.mean = atof(field("mean").c_str());
+			r.low = atof(field("ci95_low").c_str());
+			r.high = atof(field("ci95_high").c_str());
+			results[r.name] = r;
+		}
+		return results;
+	}
+
+	void compare(const std::vector<Result> & current, const std::map<std::string, Result> & baseline) {
+		printf("\n%-40s %12s %12s %8s\n", "benchmark", "baseline", "current", "change");
+		for (const Result & r : current) {
+			auto it = baseline.find(r.name);
+			if (it == baseline.end()) continue;
+			const Result & b = it->second;
+			bool significant = r.high < b.low || r.low > b.high;
+			printf("%-40s %12.1f %12.1f %+7.1f%% %s\n", r.name.c_str(), b.mean, r.mean,
+				100.0 * (r.mean - b.mean) / b.mean, significant ? (r.mean < b.mean ? "faster" : "SLOWER") : "");
+		}
+	}
+
+	ovrPosef randomPose(std::mt19937 & rng) {
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		glm::quat q = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng)));
+		ovrPosef pose;
+		pose.Orientation = ovr::fromGlm(q);
+		pose.Position = ovr::fromGlm(glm::vec3(unit(rng), unit(rng) + 1.5f, unit(rng)));
+		return pose;
+	}
+}
+
+int main(int argc, char ** argv) {
+	std::string dataDir = "../Minimal", jsonPath, baselinePath;
+	Runner runner;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+		else if (arg == "--compare" && i + 1 < argc) baselinePath = argv[++i];
+		else if (arg == "--filter" && i + 1 < argc) runner.filter = argv[++i];
+		else dataDir = arg;
+	}
+
+	// loadPPM: Cube, Skybox, Cave and the CPU renderer's CpuImage::load forward to it
+	const char * faces[2][2] = { { "loadPPM/2048", "/left-ppm/px.ppm" }, { "loadPPM/512", "/self-ppm/px.ppm" } };
+	for (auto & face : faces) {
+		std::string path = dataDir + face[1];
+		runner.run(face[0], [&] {
+			int width, height;
+			unsigned char * image = loadPPM(path.c_str(), width, height);
+			sink = image ? image[0] : 0.0f;
+			delete[] image;
+		});
+	}
+
+	// getProjection for the three walls of the CAVE from random viewer positions
+	std::mt19937 rng(190);
+	std::uniform_real_distribution<float> inside(-1.5f, 1.5f);
+	std::vector<glm::vec3> eyes(1024);
+	for (auto & eye : eyes) eye = glm::vec3(inside(rng), inside(rng), inside(rng));
+	glm::mat4 caveToWorld = glm::rotate(glm::mat4(1.0f), -0.785398f, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 pa = glm::vec3(caveToWorld * glm::vec4(-2.0f, -2.0f, -2.0f, 1.0f));
+	glm::vec3 pb = glm::vec3(caveToWorld * glm::vec4(2.0f, -2.0f, -2.0f, 1.0f));
+	glm::vec3 pc = glm::vec3(caveToWorld * glm::vec4(-2.0f, 2.0f, -2.0f, 1.0f));
+	size_t next = 0;
+	runner.run("getProjection/random-eye", [&] {
+		glm::mat4 m = offAxisProjection(eyes[next++ & 1023], pa, pb, pc, 0.01f, 1000.0f);
+		sink = m[2][0];
+	});
+
+	// Pose and matrix conversions
+	std::vector<ovrPosef> poses(1024);
+	for (auto & pose : poses) pose = randomPose(rng);
+	std::vector<glm::mat4> matrices(1024);
+	std::vector<ovrMatrix4f> ovrMatrices(1024);
+	for (size_t i = 0; i < matrices.size(); i++) {
+		matrices[i] = ovr::toGlm(poses[i]);
+		ovrMatrices[i] = ovr::fromGlm(matrices[i]);
+	}
+	runner.run("ovr::toGlm(ovrPosef)", [&] {
+		glm::mat4 m = ovr::toGlm(poses[next++ & 1023]);
+		sink = m[3][0];
+	});
+	runner.run("ovr::toGlm(ovrMatrix4f)", [&] {
+		glm::mat4 m = ovr::toGlm(ovrMatrices[next++ & 1023]);
+		sink = m[3][0];
+	});
+	runner.run("ovr::fromGlm(mat4)", [&] {
+		ovrMatrix4f m = ovr::fromGlm(matrices[next++ & 1023]);
+		sink = m.M[0][3];
+	});
+	// A frame's worth of poses (4 eye poses, 2 hands, head, 1 spare) one by one and batched
+	glm::mat4 frameMatrices[8];
+	runner.run("ovr::toGlm(ovrPosef)x8/scalar", [&] {
+		const ovrPosef * frame = &poses[(next++ * 8) & 1023];
+		for (int i = 0; i < 8; i++) frameMatrices[i] = ovr::toGlm(frame[i]);
+		sink = frameMatrices[7][3][0];
+	});
+	runner.run("ovr::toGlm(ovrPosef)x8/batch", [&] {
+		ovr::toGlm(&poses[(next++ * 8) & 1023], 8, frameMatrices);
+		sink = frameMatrices[7][3][0];
+	});
+	runner.run("ovr::toGlm(ovrMatrix4f)x8/scalar", [&] {
+		const ovrMatrix4f * frame = &ovrMatrices[(next++ * 8) & 1023];
+		for (int i = 0; i < 8; i++) frameMatrices[i] = ovr::toGlm(frame[i]);
+		sink = frameMatrices[7][3][0];
+	});
+	runner.run("ovr::toGlm(ovrMatrix4f)x8/batch", [&] {
+		ovr::toGlm(&ovrMatrices[(next++ * 8) & 1023], 8, frameMatrices);
+		sink = frameMatrices[7][3][0];
+	});
+	runner.run("ovr::toGlm(ovrQuatf)+fromGlm(quat)", [&] {
+		ovrQuatf q = ovr::fromGlm(ovr::toGlm(poses[next++ & 1023].Orientation));
+		sink = q.w;
+	});
+
+	// The file reading part of LoadShaders
+	const char * shaders[] = { "/shader.vert", "/shader.frag", "/skybox.vert", "/skybox.frag", "/LineShader.vert", "/LineShader.frag" };
+	runner.run("LoadShaders/readTextFile(x6)", [&] {
+		for (const char * shader : shaders) {
+			std::string code;
+			readTextFile((dataDir + shader).c_str(), code);
+			sink = (float)code.size();
+		}
+	});
+
+	// Per frame CPU work of SimApp::update with synthetic controller input
+	std::vector<ovrInputState> inputs(1024);
+	std::uniform_real_distribution<float> stick(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> press(0, 15);
+	for (auto & input : inputs) {
+		memset(&input, 0, sizeof(input));
+		unsigned int buttons[] = { ovrButton_A, ovrButton_B, ovrButton_X, ovrButton_RThumb, ovrButton_LThumb };
+		for (unsigned int button : buttons) if (press(rng) == 0) input.Buttons |= button;
+		input.HandTrigger[ovrHand_Right] = stick(rng);
+		input.Thumbstick[ovrHand_Left] = ovr::fromGlm(glm::vec2(stick(rng), stick(rng)));
+		input.Thumbstick[ovrHand_Right] = ovr::fromGlm(glm::vec2(stick(rng), stick(rng)));
+	}
+	SimControls controls;
+	runner.run("SimApp::update/synthetic-input", [&] {
+		size_t i = next++ & 1023;
+		controls.handleInput(inputs[i]);
+		controls.step(1.0f / 90.0f);
+		glm::mat4 rightHandPose = ovr::toGlm(poses[i]);
+		glm::mat4 cube = controls.cubeTransform(0.5f);
+		sink = cube[3][0] + rightHandPose[3][1];
+	});
+
+	if (!jsonPath.empty()) {
+		std::ofstream out(jsonPath);
+		for (const Result & r : runner.results) out << toJson(r) << "\n";
+	}
+	if (!baselinePath.empty()) {
+		compare(runner.results, loadJson(baselinePath));
+	}
+	return 0;
+}
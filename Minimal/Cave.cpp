@@ -1,12 +1,15 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #include "Cave.h"
+#include "FileIO.h"
+#include "RenderStats.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 // Basic constructor
-Cave::Cave()
+Cave::Cave(const Cave * shared)
 {
-	initialize();
+	initialize(shared);
 }
 
 // Destructor
@@ -14,110 +17,59 @@ Cave::~Cave()
 {
 	// Delete previously generated buffers. Note that forgetting to do this can waste GPU memory in a 
 	// large project! This could crash the graphics driver due to memory leaks, or slow down application performance!
-	glDeleteVertexArrays(1, &lVAO);
-	glDeleteVertexArrays(1, &rVAO);
-	glDeleteVertexArrays(1, &bVAO);
-	glDeleteBuffers(1, &lVBO);
-	glDeleteBuffers(1, &rVBO);
-	glDeleteBuffers(1, &bVBO);
+	glDeleteVertexArrays(1, &wallVAO);
+	glDeleteBuffers(1, &wallVBO);
+	glDeleteBuffers(1, &wallUV_ID);
+	glDeleteBuffers(1, &wallIndex_ID);
 }
 
 // Initialization method for constructors
-void Cave::initialize() {
+void Cave::initialize(const Cave * shared) {
 	toWorld = glm::mat4(1.0f);
 
-	// left 
-	glGenVertexArrays(1, &lVAO);
-	glGenBuffers(1, &lVBO);
-	glGenBuffers(1, &luv_ID);
+	// All walls in one VAO: left, right, bottom after each other, every vertex
+	// carrying the index of its wall, which is also its layer in the wall texture array
+	GLfloat vertices[3 * 18], uvs[3 * 12];
+	GLint walls[3 * 6];
+	const GLfloat * wallVertices[3] = { lvertices, rvertices, bvertices };
+	const GLfloat * wallUVs[3] = { luvs, ruvs, buvs };
+	for (int wall = 0; wall < 3; wall++) {
+		std::copy(wallVertices[wall], wallVertices[wall] + 18, vertices + wall * 18);
+		std::copy(wallUVs[wall], wallUVs[wall] + 12, uvs + wall * 12);
+		std::fill(walls + wall * 6, walls + wall * 6 + 6, wall);
+	}
 
-	glBindVertexArray(lVAO);
+	glGenVertexArrays(1, &wallVAO);
+	glGenBuffers(1, &wallVBO);
+	glGenBuffers(1, &wallUV_ID);
+	glGenBuffers(1, &wallIndex_ID);
 
-	glBindBuffer(GL_ARRAY_BUFFER, lVBO);
+	glBindVertexArray(wallVAO);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(lvertices), &lvertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, wallVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
-		3, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		3 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-	glBindBuffer(GL_ARRAY_BUFFER, luv_ID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(luvs), luvs, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader.
-		2, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		2 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
 
-	// right
-	glGenVertexArrays(1, &rVAO);
-	glGenBuffers(1, &rVBO);
-	glGenBuffers(1, &ruv_ID);
-
-	glBindVertexArray(rVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, rVBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(rvertices), &rvertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
-		3, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		3 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-	glBindBuffer(GL_ARRAY_BUFFER, ruv_ID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(ruvs), ruvs, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, wallUV_ID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(uvs), uvs, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader.
-		2, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		2 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-
-	// bottom
-	glGenVertexArrays(1, &bVAO);
-	glGenBuffers(1, &bVBO);
-	glGenBuffers(1, &buv_ID);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
 
-	glBindVertexArray(bVAO);
+	// An integer attribute, so the I variant
+	glBindBuffer(GL_ARRAY_BUFFER, wallIndex_ID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(walls), walls, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_INT, sizeof(GLint), (GLvoid*)0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, bVBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(bvertices), &bvertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
-		3, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		3 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-	glBindBuffer(GL_ARRAY_BUFFER, buv_ID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(buvs), buvs, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader.
-		2, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		2 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
-	this->loadCubemap();
+	if (shared) texture_ID = shared->texture_ID;
+	else this->loadCubemap();
 }
 
-void Cave::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint left, GLuint right, GLuint bottom)
+void Cave::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint walls, int firstLayer)
 {
 	// Calculate the combination of the model and view (camera inverse) matrices
 	// We need to calcullate this because modern OpenGL does not keep track of any matrix other than the viewport (D)
@@ -131,25 +83,70 @@ void Cave::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint left, GLu
 	glUniformMatrix4fv(uModel, 1, GL_FALSE, &V[0][0]);
 	glUniformMatrix4fv(uView, 1, GL_FALSE, &toWorld[0][0]);
 
-	glUniform1i(glGetUniformLocation(shaderProgram, "myTextureSampler"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "walls"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "firstLayer"), firstLayer);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, walls);
+	RenderStats::texture();
+	glBindVertexArray(wallVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3 * 2 * 3);
+	RenderStats::draw();
+	glBindVertexArray(0);
+}
 
+void Cave::drawFoveated(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint surround, GLuint inset, int insetWall, glm::vec4 insetRect, float blend)
+{
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &P[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &V[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &toWorld[0][0]);
+	glUniform1i(glGetUniformLocation(shaderProgram, "walls"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "insetSampler"), 1);
+	glUniform1i(glGetUniformLocation(shaderProgram, "insetWall"), insetWall);
+	glUniform4f(glGetUniformLocation(shaderProgram, "insetRect"), insetRect.x, insetRect.y, insetRect.z, insetRect.w);
+	glUniform1f(glGetUniformLocation(shaderProgram, "insetBlend"), blend);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, inset);
+	RenderStats::texture();
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, left);
-	glBindVertexArray(lVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, luv_ID);
-	glDrawArrays(GL_TRIANGLES, 0, 2 * 3);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, surround);
+	RenderStats::texture();
+	glBindVertexArray(wallVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3 * 2 * 3);
+	RenderStats::draw();
+	glBindVertexArray(0);
+}
+
+void Cave::drawCubemap(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint cubemap, glm::vec3 center)
+{
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &P[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &V[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &toWorld[0][0]);
+	glUniform1i(glGetUniformLocation(shaderProgram, "viewCubemap"), 0);
+	glUniform3f(glGetUniformLocation(shaderProgram, "cubemapCenter"), center.x, center.y, center.z);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, right);
-	glBindVertexArray(rVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, ruv_ID);
-	glDrawArrays(GL_TRIANGLES, 0, 2 * 3);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+	RenderStats::texture();
+	glBindVertexArray(wallVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3 * 2 * 3);
+	RenderStats::draw();
+	glBindVertexArray(0);
+}
+
+void Cave::drawStereo(GLuint shaderProgram, GLuint walls, int rightEyeLayer)
+{
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "toWorld"), 1, GL_FALSE, &toWorld[0][0]);
+	glUniform1i(glGetUniformLocation(shaderProgram, "walls"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "rightEyeLayer"), rightEyeLayer);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, bottom);
-	glBindVertexArray(bVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, buv_ID);
-	glDrawArrays(GL_TRIANGLES, 0, 2 * 3);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, walls);
+	RenderStats::texture();
+	glBindVertexArray(wallVAO);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 3 * 2 * 3, 2);
+	RenderStats::draw();
 	glBindVertexArray(0);
 }
 
@@ -172,7 +169,7 @@ void Cave::loadCubemap() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
-	free(image);
+	delete[] image;
 	// Unbinds texture
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -188,56 +185,7 @@ void Cave::useCubemap(int eyeIdx)
 	else curTextureID = texture_ID_self;
 }
 
-#pragma warning(disable : 4996)  
 unsigned char* Cave::loadPPM(const char* filename, int& width, int& height)
 {
-	const int BUFSIZE = 128;
-	FILE* fp;
-	unsigned int read;
-	unsigned char* rawData;
-	char buf[3][BUFSIZE];
-	char* retval_fgets;
-	size_t retval_sscanf;
-
-	if ((fp = fopen(filename, "rb")) == NULL)
-	{
-		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
-		width = 0;
-		height = 0;
-		return 0;
-	}
-
-	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
-
-	// Read width and height:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
-	width = atoi(buf[1]);
-	height = atoi(buf[2]);
-
-	// Read maxval:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-
-	// Read image data:
-	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
-	if (read != 1)
-	{
-		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
-		delete[] rawData;
-		width = 0;
-		height = 0;
-
-		return 0;
-	}
-
-	return rawData;
+	return ::loadPPM(filename, width, height);
 }
@@ -18,13 +18,26 @@
 class Cave
 {
 public:
-	Cave();
+	// Pass another Cave to reuse its texture, e.g. from a context sharing its objects
+	Cave(const Cave * shared = nullptr);
 	~Cave();
 
 	glm::mat4 toWorld;
 
-	void initialize();
-	void draw(GLuint, glm::mat4, glm::mat4, GLuint left, GLuint right, GLuint bottom);
+	void initialize(const Cave * shared = nullptr);
+	// walls is a GL_TEXTURE_2D_ARRAY, the left, right and bottom wall are its layers
+	// firstLayer, firstLayer + 1 and firstLayer + 2. One draw for all walls.
+	void draw(GLuint, glm::mat4, glm::mat4, GLuint walls, int firstLayer = 0);
+	// Both eyes in one instanced draw, the right eye's walls start at rightEyeLayer.
+	// The eye matrices come from the StereoEyes block.
+	void drawStereo(GLuint, GLuint walls, int rightEyeLayer);
+	// Walls from a reduced density wall array, with a full density inset blended over
+	// insetWall (-1 for none). insetRect is the inset's wall UV range: min s, min t,
+	// max s, max t. blend is the UV width of the seam.
+	void drawFoveated(GLuint, glm::mat4, glm::mat4, GLuint surround, GLuint inset, int insetWall, glm::vec4 insetRect, float blend);
+	// Walls sampled by direction from a cubemap centred at center, see cave_cubemap.frag.
+	// The walls show whatever lies behind them from there, however many there are.
+	void drawCubemap(GLuint, glm::mat4, glm::mat4, GLuint cubemap, glm::vec3 center);
 	unsigned char* loadPPM(const char*, int&, int&);
 
 	// Cubemap
@@ -34,9 +47,7 @@ public:
 	// These variables are needed for the shader program
 	// GLuint VBO, VAO, uv_ID;
 
-	GLuint lVBO, lVAO, luv_ID;
-	GLuint rVBO, rVAO, ruv_ID;
-	GLuint bVBO, bVAO, buv_ID;
+	GLuint wallVBO, wallVAO, wallUV_ID, wallIndex_ID;
 
 	GLuint uProjection, uModel, uView, texture_ID_left, texture_ID_right, texture_ID_self, texture_ID, curTextureID;
 
@@ -0,0 +1,353 @@
+#include "CpuRenderer.h"
+#include "FileIO.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+bool CpuImage::load(const char * filename)
+{
+	// The first row in the file is t = 0 once glTexImage2D has it, keep it that way
+	unsigned char * image = loadPPM(filename, width, height);
+	if (!image) {
+		pixels.clear();
+		return false;
+	}
+	pixels.assign(image, image + (size_t)width * height * 3);
+	delete[] image;
+	return true;
+}
+
+glm::vec3 CpuImage::texel(int x, int y) const
+{
+	const unsigned char * p = &pixels[(y * width + x) * 3];
+	return glm::vec3(p[0], p[1], p[2]) * (1.0f / 255.0f);
+}
+
+glm::vec3 CpuImage::sampleBilinear(float s, float t, bool repeat) const
+{
+	float fx = s * width - 0.5f;
+	float fy = t * height - 0.5f;
+	int x0 = (int)std::floor(fx);
+	int y0 = (int)std::floor(fy);
+	float ax = fx - x0;
+	float ay = fy - y0;
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+	if (repeat) {
+		x0 = ((x0 % width) + width) % width;
+		x1 = ((x1 % width) + width) % width;
+		y0 = ((y0 % height) + height) % height;
+		y1 = ((y1 % height) + height) % height;
+	}
+	else {
+		x0 = std::min(std::max(x0, 0), width - 1);
+		x1 = std::min(std::max(x1, 0), width - 1);
+		y0 = std::min(std::max(y0, 0), height - 1);
+		y1 = std::min(std::max(y1, 0), height - 1);
+	}
+	glm::vec3 bottom = glm::mix(texel(x0, y0), texel(x1, y0), ax);
+	glm::vec3 top = glm::mix(texel(x0, y1), texel(x1, y1), ax);
+	return glm::mix(bottom, top, ay);
+}
+
+CpuRenderer::CpuRenderer()
+{
+}
+
+void CpuRenderer::loadCubemap(int eyeIdx, const char * directory)
+{
+	static const char * faces[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+	for (int i = 0; i < 6; i++) {
+		std::string path = std::string(directory) + "/" + faces[i] + ".ppm";
+		cubemaps[eyeIdx][i].load(path.c_str());
+	}
+}
+
+void CpuRenderer::loadCubeTexture(const char * filename)
+{
+	cubeTexture.load(filename);
+}
+
+// Face selection and face coordinates as in the GL spec's cube map table
+glm::vec3 CpuRenderer::sampleCubemap(int eyeIdx, const glm::vec3 & d) const
+{
+	glm::vec3 a = glm::abs(d);
+	int face;
+	float sc, tc, ma;
+	if (a.x >= a.y && a.x >= a.z) {
+		ma = a.x;
+		if (d.x > 0) { face = 0; sc = -d.z; tc = -d.y; }
+		else { face = 1; sc = d.z; tc = -d.y; }
+	}
+	else if (a.y >= a.z) {
+		ma = a.y;
+		if (d.y > 0) { face = 2; sc = d.x; tc = d.z; }
+		else { face = 3; sc = d.x; tc = -d.z; }
+	}
+	else {
+		ma = a.z;
+		if (d.z > 0) { face = 4; sc = d.x; tc = -d.y; }
+		else { face = 5; sc = -d.x; tc = -d.y; }
+	}
+	const CpuImage & image = cubemaps[eyeIdx][face];
+	if (image.pixels.empty()) {
+		return glm::vec3(0.0f);
+	}
+	return image.sampleBilinear(0.5f * (sc / ma + 1.0f), 0.5f * (tc / ma + 1.0f), false);
+}
+
+static inline void storeColor(unsigned char * p, const glm::vec3 & color)
+{
+	glm::vec3 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	p[0] = (unsigned char)c.r;
+	p[1] = (unsigned char)c.g;
+	p[2] = (unsigned char)c.b;
+}
+
+void CpuRenderer::shadeSky(int eyeIdx, const glm::mat4 & worldToSkybox, const glm::vec3 & eyePos,
+	const glm::vec3 & pa, const glm::vec3 & right, const glm::vec3 & up,
+	int size, int firstRow, int lastRow, unsigned char * out) const
+{
+	glm::vec3 origin = glm::vec3(worldToSkybox * glm::vec4(eyePos, 1.0f));
+	glm::mat3 rotate = glm::mat3(worldToSkybox);
+	for (int y = firstRow; y < lastRow; y++) {
+		glm::vec3 rowStart = pa + up * ((y + 0.5f) / size) - eyePos;
+		for (int x = 0; x < size; x++) {
+			// Ray from the viewer through the wall point, in the skybox's model space
+			glm::vec3 d = rotate * (rowStart + right * ((x + 0.5f) / size));
+			// The viewer is inside the box, so the nearest exit plane is the hit
+			float t = 1e30f;
+			for (int i = 0; i < 3; i++) {
+				if (d[i] != 0.0f) {
+					float plane = d[i] > 0.0f ? skyboxExtent : -skyboxExtent;
+					t = std::min(t, (plane - origin[i]) / d[i]);
+				}
+			}
+			glm::vec3 hit = origin + d * t;
+			// skybox.vert mirrors x before the lookup
+			hit.x = -hit.x;
+			storeColor(out + (y * size + x) * 3, sampleCubemap(eyeIdx, hit));
+		}
+	}
+}
+
+void CpuRenderer::rasterize(const std::vector<ScreenVertex> & triangles, int size,
+	int firstRow, int lastRow, float * depth, unsigned char * out) const
+{
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+		const ScreenVertex * v = &triangles[t];
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (area == 0.0f) {
+			continue;
+		}
+
+		// Edge functions E(p) = A * x + B * y + C, scaled so that edge i gives the
+		// barycentric weight of vertex i. Culling is disabled, so either winding is fine.
+		float A[3], B[3], C[3];
+		for (int i = 0; i < 3; i++) {
+			const ScreenVertex & a = v[(i + 1) % 3];
+			const ScreenVertex & b = v[(i + 2) % 3];
+			A[i] = (a.y - b.y) / area;
+			B[i] = (b.x - a.x) / area;
+			C[i] = -(A[i] * a.x + B[i] * a.y);
+		}
+
+		float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+		float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+		float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+		float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+		int x0 = std::max(0, (int)std::floor(minX)) / tileSize * tileSize;
+		int x1 = std::min(size, (int)std::ceil(maxX) + 1);
+		int y0 = std::max(firstRow, (int)std::floor(minY) / tileSize * tileSize);
+		int y1 = std::min(lastRow, (int)std::ceil(maxY) + 1);
+		if (x0 >= x1 || y0 >= y1) {
+			continue;
+		}
+
+		const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+		const __m128 z0 = _mm_set1_ps(v[0].z), z1 = _mm_set1_ps(v[1].z), z2 = _mm_set1_ps(v[2].z);
+		const __m128 w0 = _mm_set1_ps(v[0].invW), w1 = _mm_set1_ps(v[1].invW), w2 = _mm_set1_ps(v[2].invW);
+		const __m128 u0 = _mm_set1_ps(v[0].u), u1 = _mm_set1_ps(v[1].u), u2 = _mm_set1_ps(v[2].u);
+		const __m128 s0 = _mm_set1_ps(v[0].v), s1 = _mm_set1_ps(v[1].v), s2 = _mm_set1_ps(v[2].v);
+
+		for (int ty = y0; ty < y1; ty += tileSize) {
+			for (int tx = x0; tx < x1; tx += tileSize) {
+				// Reject the tile if all four corner texel centers are outside one edge
+				bool outside = false;
+				for (int i = 0; i < 3 && !outside; i++) {
+					float cx0 = A[i] * (tx + 0.5f), cx1 = A[i] * (tx + tileSize - 0.5f);
+					float cy0 = B[i] * (ty + 0.5f), cy1 = B[i] * (ty + tileSize - 0.5f);
+					outside = std::max(cx0, cx1) + std::max(cy0, cy1) + C[i] < 0.0f;
+				}
+				if (outside) {
+					continue;
+				}
+
+				int rowEnd = std::min(ty + tileSize, y1);
+				int colEnd = std::min(tx + tileSize, size);
+				for (int y = ty; y < rowEnd; y++) {
+					__m128 py = _mm_set1_ps(y + 0.5f);
+					__m128 e0Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(B[0]), py), _mm_set1_ps(C[0]));
+					__m128 e1Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(B[1]), py), _mm_set1_ps(C[1]));
+					__m128 e2Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(B[2]), py), _mm_set1_ps(C[2]));
+					for (int x = tx; x < colEnd; x += 4) {
+						__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+						__m128 b0 = _mm_add_ps(_mm_mul_ps(a0, px), e0Row);
+						__m128 b1 = _mm_add_ps(_mm_mul_ps(a1, px), e1Row);
+						__m128 b2 = _mm_add_ps(_mm_mul_ps(a2, px), e2Row);
+						__m128 mask = _mm_and_ps(_mm_cmpge_ps(b0, zero),
+							_mm_and_ps(_mm_cmpge_ps(b1, zero), _mm_cmpge_ps(b2, zero)));
+						if (!_mm_movemask_ps(mask)) {
+							continue;
+						}
+
+						// Window z is affine in screen space, GL_LESS against the cleared 1.0
+						__m128 z = _mm_add_ps(_mm_mul_ps(b0, z0), _mm_add_ps(_mm_mul_ps(b1, z1), _mm_mul_ps(b2, z2)));
+						float * depthRow = depth + y * size + x;
+						__m128 stored = _mm_loadu_ps(depthRow);
+						mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, stored), _mm_cmpge_ps(z, zero)));
+						mask = _mm_and_ps(mask, _mm_cmple_ps(z, one));
+						int bits = _mm_movemask_ps(mask);
+						if (!bits) {
+							continue;
+						}
+						_mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+
+						// Perspective correct texture coordinates
+						__m128 invW = _mm_add_ps(_mm_mul_ps(b0, w0), _mm_add_ps(_mm_mul_ps(b1, w1), _mm_mul_ps(b2, w2)));
+						__m128 u = _mm_add_ps(_mm_mul_ps(b0, u0), _mm_add_ps(_mm_mul_ps(b1, u1), _mm_mul_ps(b2, u2)));
+						__m128 s = _mm_add_ps(_mm_mul_ps(b0, s0), _mm_add_ps(_mm_mul_ps(b1, s1), _mm_mul_ps(b2, s2)));
+						u = _mm_div_ps(u, invW);
+						s = _mm_div_ps(s, invW);
+						float us[4], ss[4];
+						_mm_storeu_ps(us, u);
+						_mm_storeu_ps(ss, s);
+						for (int lane = 0; lane < 4; lane++) {
+							if (bits & (1 << lane)) {
+								storeColor(out + (y * size + x + lane) * 3, cubeTexture.sampleBilinear(us[lane], ss[lane], true));
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+namespace {
+	struct ClipVertex {
+		glm::vec4 position;
+		glm::vec2 uv;
+	};
+
+	// Sutherland-Hodgman against the GL near plane (z >= -w). Everything else is
+	// handled by the screen bounds and the per texel depth range test.
+	int clipNear(const ClipVertex in[3], ClipVertex out[4])
+	{
+		int count = 0;
+		for (int i = 0; i < 3; i++) {
+			const ClipVertex & a = in[i];
+			const ClipVertex & b = in[(i + 1) % 3];
+			float da = a.position.z + a.position.w;
+			float db = b.position.z + b.position.w;
+			if (da >= 0.0f) {
+				out[count++] = a;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				float t = da / (da - db);
+				out[count].position = glm::mix(a.position, b.position, t);
+				out[count].uv = glm::mix(a.uv, b.uv, t);
+				count++;
+			}
+		}
+		return count;
+	}
+}
+
+void CpuRenderer::renderWall(ThreadPool & pool, int eyeIdx,
+	const glm::mat4 & projection, const glm::mat4 & modelview, const glm::vec3 & eyePos,
+	const glm::vec3 & pa, const glm::vec3 & pb, const glm::vec3 & pc,
+	const glm::mat4 & skyboxToWorld, const glm::mat4 & cubeToWorld,
+	const float * positions, const float * uvs, int vertexCount,
+	int size, unsigned char * out)
+{
+	if (size % tileSize != 0) {
+		std::cerr << "cpu wall size must be a multiple of " << tileSize << std::endl;
+		return;
+	}
+
+	// Skybox::draw drops the translation of the view, the projection keeps the eye offset
+	glm::mat4 skyView = modelview;
+	skyView[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	glm::mat4 worldToSkybox = glm::inverse(skyView * skyboxToWorld);
+
+	// Run the cube's vertex shader once for the whole wall
+	glm::mat4 mvp = projection * modelview * cubeToWorld;
+	std::vector<ScreenVertex> triangles;
+	triangles.reserve(vertexCount * 2);
+	for (int i = 0; i + 2 < vertexCount; i += 3) {
+		ClipVertex in[3], clipped[4];
+		for (int k = 0; k < 3; k++) {
+			const float * p = positions + (i + k) * 3;
+			in[k].position = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+			in[k].uv = glm::vec2(uvs[(i + k) * 2], uvs[(i + k) * 2 + 1]);
+		}
+		int count = clipNear(in, clipped);
+		for (int k = 1; k + 1 < count; k++) {
+			const ClipVertex * fan[3] = { &clipped[0], &clipped[k], &clipped[k + 1] };
+			for (int j = 0; j < 3; j++) {
+				float invW = 1.0f / fan[j]->position.w;
+				glm::vec3 ndc = glm::vec3(fan[j]->position) * invW;
+				ScreenVertex sv;
+				sv.x = (ndc.x * 0.5f + 0.5f) * size;
+				sv.y = (ndc.y * 0.5f + 0.5f) * size;
+				sv.z = ndc.z * 0.5f + 0.5f;
+				sv.invW = invW;
+				sv.u = fan[j]->uv.x * invW;
+				sv.v = fan[j]->uv.y * invW;
+				triangles.push_back(sv);
+			}
+		}
+	}
+
+	std::vector<float> depth(size * size);
+	glm::vec3 right = pb - pa;
+	glm::vec3 up = pc - pa;
+	pool.parallelFor(0, size / tileSize, 1, [&](int first, int last) {
+		int firstRow = first * tileSize;
+		int lastRow = last * tileSize;
+		std::fill(depth.begin() + firstRow * size, depth.begin() + lastRow * size, 1.0f);
+		shadeSky(eyeIdx, worldToSkybox, eyePos, pa, right, up, size, firstRow, lastRow, out);
+		rasterize(triangles, size, firstRow, lastRow, depth.data(), out);
+	});
+}
+
+ImageDiff CpuRenderer::compare(const unsigned char * a, const unsigned char * b, int texels, int tolerance)
+{
+	ImageDiff result;
+	long long total = 0;
+	int over = 0;
+	for (int i = 0; i < texels; i++) {
+		int worst = 0;
+		for (int c = 0; c < 3; c++) {
+			int diff = std::abs((int)a[i * 3 + c] - (int)b[i * 3 + c]);
+			worst = std::max(worst, diff);
+			total += diff;
+		}
+		result.maxDiff = std::max(result.maxDiff, worst);
+		if (worst > tolerance) {
+			over++;
+		}
+	}
+	if (texels > 0) {
+		result.meanDiff = (double)total / (texels * 3.0);
+		result.overTolerance = (double)over / texels;
+	}
+	return result;
+}
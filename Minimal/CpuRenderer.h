@@ -0,0 +1,82 @@
+#ifndef _CPU_RENDERER_H_
+#define _CPU_RENDERER_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// An RGB image kept on the CPU, rows stored bottom-up like a GL texture
+struct CpuImage
+{
+	int width = 0, height = 0;
+	std::vector<unsigned char> pixels;
+
+	bool load(const char * filename);
+	glm::vec3 texel(int x, int y) const;
+	glm::vec3 sampleBilinear(float s, float t, bool repeat) const;
+};
+
+// How far apart two images are, per 8 bit channel
+struct ImageDiff
+{
+	int maxDiff = 0;
+	double meanDiff = 0.0;
+	double overTolerance = 0.0; // fraction of texels with any channel above the tolerance
+};
+
+// Software version of the wall passes in SimScene::preRender. For every wall texel
+// it casts the off-axis ray from the viewer through the wall point into the stereo
+// cubemap, then rasterizes the textured Cube on top with a tiled SSE half-space
+// rasterizer. Rows of tiles are spread over a work-stealing pool. The output has
+// the same layout as the wall FBO textures so the two can be compared directly.
+class CpuRenderer
+{
+public:
+	CpuRenderer();
+
+	// The left and right face sets are 2048x2048 each, only load the eyes you render
+	void loadCubemap(int eyeIdx, const char * directory);
+	void loadCubeTexture(const char * filename);
+
+	// Same inputs as the GL wall pass: projection comes from SimScene::getProjection
+	// for the wall spanned by pa, pb, pc, modelview is the inverse head pose.
+	// positions/uvs are the Cube's triangle list (3 and 2 floats per vertex).
+	void renderWall(ThreadPool & pool, int eyeIdx,
+		const glm::mat4 & projection, const glm::mat4 & modelview, const glm::vec3 & eyePos,
+		const glm::vec3 & pa, const glm::vec3 & pb, const glm::vec3 & pc,
+		const glm::mat4 & skyboxToWorld, const glm::mat4 & cubeToWorld,
+		const float * positions, const float * uvs, int vertexCount,
+		int size, unsigned char * out);
+
+	static ImageDiff compare(const unsigned char * a, const unsigned char * b, int texels, int tolerance);
+
+	// Skybox vertices span [-skyboxExtent, skyboxExtent] on every axis (see Skybox.h)
+	float skyboxExtent = 20.0f;
+	// Tiles are tileSize x tileSize texels, a job covers one row of tiles
+	static const int tileSize = 8;
+
+private:
+	struct ScreenVertex {
+		float x, y, z, invW;
+		float u, v; // divided by w, for perspective correct interpolation
+	};
+
+	glm::vec3 sampleCubemap(int eyeIdx, const glm::vec3 & direction) const;
+	void shadeSky(int eyeIdx, const glm::mat4 & worldToSkybox, const glm::vec3 & eyePos,
+		const glm::vec3 & pa, const glm::vec3 & right, const glm::vec3 & up,
+		int size, int firstRow, int lastRow, unsigned char * out) const;
+	void rasterize(const std::vector<ScreenVertex> & triangles, int size,
+		int firstRow, int lastRow, float * depth, unsigned char * out) const;
+
+	// GL face order: +X, -X, +Y, -Y, +Z, -Z
+	CpuImage cubemaps[2][6];
+	CpuImage cubeTexture;
+};
+
+#endif
@@ -1,9 +1,11 @@
 #include "Cube.h"
+#include "FileIO.h"
 #include "Cave.h"
+#include "RenderStats.h"
 #include <iostream>
 #include <fstream>
 
-Cube::Cube()
+Cube::Cube(const Cube * shared)
 {
 	toWorld = glm::mat4(1.0f);
 
@@ -53,7 +55,8 @@ Cube::Cube()
 	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
 	glBindVertexArray(0);
 
-	this->loadCubemap();
+	if (shared) texture_ID = shared->texture_ID;
+	else this->loadCubemap();
 }
 
 Cube::~Cube()
@@ -81,6 +84,7 @@ void Cube::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V)
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texture_ID);
+	RenderStats::texture();
 	glUniform1i(glGetUniformLocation(shaderProgram, "myTextureSampler"), 0);
 
 	// Now draw the cube. We simply need to bind the VAO associated with it.
@@ -93,6 +97,7 @@ void Cube::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V)
 	// Tell OpenGL to draw with triangles, using 36 indices, the type of the indices, and the offset to start from
 	// glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 	glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
+	RenderStats::draw();
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
 }
@@ -113,6 +118,7 @@ void Cube::render(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint FBO)
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texture_ID);
+	RenderStats::texture();
 	glUniform1i(glGetUniformLocation(shaderProgram, "myTextureSampler"), 0);
 
 	// Now draw the cube. We simply need to bind the VAO associated with it.
@@ -125,6 +131,7 @@ void Cube::render(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, GLuint FBO)
 	// Tell OpenGL to draw with triangles, using 36 indices, the type of the indices, and the offset to start from
 	// glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 	glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
+	RenderStats::draw();
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
 }
@@ -154,63 +161,14 @@ GLuint Cube::loadCubemap() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
-	free(image);
+	delete[] image;
 	// Unbinds texture
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	return texture_ID;
 }
 
-#pragma warning(disable : 4996)  
 unsigned char* Cube::loadPPM(const char* filename, int& width, int& height)
 {
-	const int BUFSIZE = 128;
-	FILE* fp;
-	unsigned int read;
-	unsigned char* rawData;
-	char buf[3][BUFSIZE];
-	char* retval_fgets;
-	size_t retval_sscanf;
-
-	if ((fp = fopen(filename, "rb")) == NULL)
-	{
-		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
-		width = 0;
-		height = 0;
-		return 0;
-	}
-
-	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
-
-	// Read width and height:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
-	width = atoi(buf[1]);
-	height = atoi(buf[2]);
-
-	// Read maxval:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-
-	// Read image data:
-	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
-	if (read != 1)
-	{
-		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
-		delete[] rawData;
-		width = 0;
-		height = 0;
-
-		return 0;
-	}
-
-	return rawData;
+	return ::loadPPM(filename, width, height);
 }
@@ -19,7 +19,8 @@
 class Cube
 {
 public:
-	Cube();
+	// Pass another Cube to reuse its texture, e.g. from a context sharing its objects
+	Cube(const Cube * shared = nullptr);
 	~Cube();
 
 	glm::mat4 toWorld;
@@ -0,0 +1,185 @@
+#define _CRT_SECURE_NO_DEPRECATE
+#include "FileIO.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool readTextFile(const char * filename, std::string & text)
+{
+	std::ifstream stream(filename, std::ios::in);
+	if (!stream.is_open()) {
+		return false;
+	}
+	std::string line = "";
+	while (getline(stream, line))
+		text += "\n" + line;
+	stream.close();
+	return true;
+}
+
+#pragma warning(disable : 4996)
+unsigned char * loadPPM(const char * filename, int & width, int & height)
+{
+	const int BUFSIZE = 128;
+	FILE* fp;
+	unsigned int read;
+	unsigned char* rawData;
+	char buf[3][BUFSIZE];
+	char* retval_fgets;
+	size_t retval_sscanf;
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+	{
+		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
+		width = 0;
+		height = 0;
+		return 0;
+	}
+
+	// Read magic number:
+	retval_fgets = fgets(buf[0], BUFSIZE, fp);
+
+	// Read width and height:
+	do
+	{
+		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+	} while (buf[0][0] == '#');
+	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
+	width = atoi(buf[1]);
+	height = atoi(buf[2]);
+
+	// Read maxval:
+	do
+	{
+		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+	} while (buf[0][0] == '#');
+
+	// Read image data:
+	rawData = new unsigned char[width * height * 3];
+	read = fread(rawData, width * height * 3, 1, fp);
+	fclose(fp);
+	if (read != 1)
+	{
+		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
+		delete[] rawData;
+		width = 0;
+		height = 0;
+
+		return 0;
+	}
+
+	return rawData;
+}
+
+bool writePPM(const std::string & filename, const unsigned char * pixels, int width, int height)
+{
+	FILE * fp = fopen(filename.c_str(), "wb");
+	if (!fp) {
+		std::cerr << "could not write " << filename << std::endl;
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	for (int y = height - 1; y >= 0; y--) {
+		fwrite(pixels + y * width * 3, width * 3, 1, fp);
+	}
+	fclose(fp);
+	return true;
+}
+
+bool readBinaryFile(const char * filename, std::string & bytes)
+{
+	std::ifstream stream(filename, std::ios::in | std::ios::binary);
+	if (!stream.is_open()) {
+		return false;
+	}
+	stream.seekg(0, std::ios::end);
+	bytes.resize((size_t)stream.tellg());
+	stream.seekg(0, std::ios::beg);
+	stream.read(&bytes[0], bytes.size());
+	return !stream.fail();
+}
+
+bool writeBinaryFile(const std::string & filename, const void * data, size_t size)
+{
+	FILE * fp = fopen(filename.c_str(), "wb");
+	if (!fp) {
+		std::cerr << "could not write " << filename << std::endl;
+		return false;
+	}
+	size_t written = fwrite(data, 1, size, fp);
+	fclose(fp);
+	return written == size;
+}
+
+long long fileTime(const char * filename)
+{
+	struct stat info;
+	if (stat(filename, &info) != 0) return 0;
+	return (long long)info.st_mtime;
+}
+
+bool MappedFile::open(const char * filename)
+{
+	close();
+#ifdef _WIN32
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	bytes = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!bytes) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void * view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file referenced
+	::close(fd);
+	if (view == MAP_FAILED) return false;
+	bytes = (const unsigned char *)view;
+	length = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	mapping = file = nullptr;
+#else
+	if (bytes) munmap((void *)bytes, length);
+#endif
+	bytes = nullptr;
+	length = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _FILE_IO_H_
+#define _FILE_IO_H_
+
+#include <string>
+#include <cstddef>
+
+// Reads a text file line by line, every line prefixed with a newline (the way
+// LoadShaders has always built its source strings). Returns false if it can't be opened.
+bool readTextFile(const char * filename, std::string & text);
+
+// Reads a binary (P6) PPM. Returns a new[] allocated RGB buffer with the rows in
+// file order, or 0 with width and height set to 0 on failure.
+unsigned char * loadPPM(const char * filename, int & width, int & height);
+
+// Writes an RGB image read back from GL (bottom row first) as a binary PPM
+bool writePPM(const std::string & filename, const unsigned char * pixels, int width, int height);
+
+bool readBinaryFile(const char * filename, std::string & bytes);
+bool writeBinaryFile(const std::string & filename, const void * data, size_t size);
+
+// Last modification time of a file in seconds, 0 if it doesn't exist
+long long fileTime(const char * filename);
+
+// A whole file mapped read only into memory. Nothing is read up front, the OS pages
+// the file in as it is touched and can drop the pages again under memory pressure.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	bool open(const char * filename);
+	void close();
+
+	const unsigned char * data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	const unsigned char * bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void * file = nullptr, * mapping = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "FixedTimestep.h"
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(double stepsPerSecond)
+{
+	setRate(stepsPerSecond);
+}
+
+void FixedTimestep::setRate(double rate)
+{
+	// Keep alpha where it is, only the length of a step changes
+	double fraction = started ? accumulator * stepsPerSecond : 0.0;
+	stepsPerSecond = rate > 0.0 ? rate : 90.0;
+	accumulator = fraction / stepsPerSecond;
+}
+
+int FixedTimestep::advance(double seconds)
+{
+	if (!started) {
+		started = true;
+		lastSeconds = seconds;
+		return 0;
+	}
+	double elapsed = seconds - lastSeconds;
+	lastSeconds = seconds;
+	// Predicted display times can come back slightly out of order
+	if (elapsed > 0.0) {
+		accumulator += elapsed;
+	}
+
+	double step = stepSeconds();
+	// A frame time that is a whole number of steps must not leave a step short
+	// because of rounding, that would show up as a one step hitch
+	const double slack = 1e-9;
+	int steps = 0;
+	while (accumulator + slack >= step) {
+		accumulator = std::max(accumulator - step, 0.0);
+		if (++steps == maxStepsPerFrame) {
+			// Drop the rest but keep the phase, the next frame then interpolates normally
+			accumulator = std::fmod(accumulator, step);
+			break;
+		}
+	}
+	return steps;
+}
@@ -0,0 +1,37 @@
+#ifndef _FIXED_TIMESTEP_H_
+#define _FIXED_TIMESTEP_H_
+
+// Turns the varying frame times of the render loop into a whole number of
+// fixed size simulation steps. The time that doesn't add up to a full step is
+// carried over to the next frame and exposed as alpha(), the fraction of the
+// way from the previous to the current simulation state the frame is shown at.
+// Every step has exactly the same length, so the simulation gives the same
+// results whether the loop runs at 45, 90 or 1000 frames per second.
+class FixedTimestep
+{
+public:
+	explicit FixedTimestep(double stepsPerSecond = 90.0);
+
+	void setRate(double stepsPerSecond);
+	double rate() const { return stepsPerSecond; }
+	double stepSeconds() const { return 1.0 / stepsPerSecond; }
+
+	// Feed the time the frame will be displayed at, returns how many steps to
+	// run before rendering it. The first call only starts the clock.
+	int advance(double seconds);
+
+	// Where the frame lies between the last two steps, in [0, 1)
+	float alpha() const { return (float)(accumulator * stepsPerSecond); }
+
+	// After a long stall (loading, a breakpoint) the time beyond this many steps
+	// is dropped instead of being simulated all at once
+	int maxStepsPerFrame = 30;
+
+private:
+	double stepsPerSecond;
+	double lastSeconds = 0.0;
+	double accumulator = 0.0;
+	bool started = false;
+};
+
+#endif
@@ -0,0 +1,402 @@
+#include "FrameGraph.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <iostream>
+
+FrameGraph::~FrameGraph()
+{
+	releaseCache();
+}
+
+void FrameGraph::reset()
+{
+	targets.clear();
+	passes.clear();
+	order.clear();
+	compiled = false;
+}
+
+FrameGraph::Resource FrameGraph::createTarget(const char * name, const TargetDesc & desc)
+{
+	Target target;
+	target.name = name;
+	target.desc = desc;
+	targets.push_back(target);
+	return (Resource)targets.size() - 1;
+}
+
+FrameGraph::Resource FrameGraph::importTexture(const char * name, GLuint texture, int layer, int width, int height, GLenum format)
+{
+	Target target;
+	target.name = name;
+	target.desc.width = width;
+	target.desc.height = height;
+	target.desc.format = format;
+	target.texture = texture;
+	target.layer = layer;
+	target.imported = true;
+	targets.push_back(target);
+	return (Resource)targets.size() - 1;
+}
+
+void FrameGraph::addPass(const char * name, const std::vector<Resource> & reads, const std::vector<Resource> & writes, Execute execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.reads = reads;
+	pass.writes = writes;
+	pass.execute = execute;
+	passes.push_back(pass);
+	compiled = false;
+}
+
+void FrameGraph::markOutput(Resource resource)
+{
+	targets[resource].output = true;
+}
+
+bool FrameGraph::compile()
+{
+	order.clear();
+	for (Target & target : targets) {
+		target.writer = -1;
+		target.first = target.last = -1;
+	}
+	for (int i = 0; i < (int)passes.size(); i++) {
+		for (Resource write : passes[i].writes) {
+			if (targets[write].writer >= 0) {
+				std::cerr << "frame graph: " << targets[write].name << " is written by " << passes[targets[write].writer].name
+					<< " and " << passes[i].name << std::endl;
+				return false;
+			}
+			targets[write].writer = i;
+		}
+	}
+
+	// Keep the passes writing outputs or with nothing to write, then whatever they read
+	std::vector<int> live;
+	for (int i = 0; i < (int)passes.size(); i++) {
+		Pass & pass = passes[i];
+		pass.alive = pass.writes.empty();
+		for (Resource write : pass.writes) pass.alive = pass.alive || targets[write].output;
+		if (pass.alive) live.push_back(i);
+	}
+	while (!live.empty()) {
+		int i = live.back();
+		live.pop_back();
+		for (Resource read : passes[i].reads) {
+			int writer = targets[read].writer;
+			if (writer >= 0 && !passes[writer].alive) {
+				passes[writer].alive = true;
+				live.push_back(writer);
+			}
+		}
+	}
+
+	// Declaration order, except that a pass waits for the writers of what it reads
+	std::vector<bool> placed(passes.size(), false);
+	int alive = 0;
+	for (const Pass & pass : passes) alive += pass.alive;
+	while ((int)order.size() < alive) {
+		int next = -1;
+		for (int i = 0; i < (int)passes.size() && next < 0; i++) {
+			if (!passes[i].alive || placed[i]) continue;
+			bool ready = true;
+			for (Resource read : passes[i].reads) {
+				int writer = targets[read].writer;
+				if (writer >= 0 && writer != i && !placed[writer]) ready = false;
+			}
+			if (ready) next = i;
+		}
+		if (next < 0) {
+			std::cerr << "frame graph: the passes depend on each other in a cycle" << std::endl;
+			order.clear();
+			return false;
+		}
+		placed[next] = true;
+		order.push_back(next);
+	}
+
+	// Lifetimes of the transients, in positions of order
+	for (int position = 0; position < (int)order.size(); position++) {
+		const Pass & pass = passes[order[position]];
+		for (const std::vector<Resource> * uses : { &pass.reads, &pass.writes }) {
+			for (Resource use : *uses) {
+				Target & target = targets[use];
+				if (target.imported) continue;
+				if (target.first < 0) target.first = position;
+				target.last = position;
+			}
+		}
+	}
+
+	// Each transient takes the first storage of its kind that is free by its first use
+	for (Storage & storage : storages) {
+		storage.used = false;
+		storage.busyUntil = -1;
+	}
+	std::vector<int> transients;
+	for (int i = 0; i < (int)targets.size(); i++) {
+		targets[i].storage = -1;
+		if (!targets[i].imported && targets[i].first >= 0) transients.push_back(i);
+	}
+	std::stable_sort(transients.begin(), transients.end(), [&](int a, int b) { return targets[a].first < targets[b].first; });
+	for (int i : transients) {
+		Target & target = targets[i];
+		for (int s = 0; s < (int)storages.size() && target.storage < 0; s++) {
+			if (sameDesc(storages[s].desc, target.desc) && storages[s].busyUntil < target.first) {
+				target.storage = s;
+			}
+		}
+		if (target.storage < 0) {
+			allocate(target);
+		}
+		storages[target.storage].busyUntil = target.last;
+		storages[target.storage].used = true;
+	}
+
+	// Storage the frame did not need goes, with the framebuffers that might use it
+	std::vector<int> remap(storages.size(), -1);
+	std::vector<Storage> kept;
+	for (int s = 0; s < (int)storages.size(); s++) {
+		if (storages[s].used) {
+			remap[s] = (int)kept.size();
+			kept.push_back(storages[s]);
+		}
+		else if (storages[s].renderbuffer) {
+			glDeleteRenderbuffers(1, &storages[s].name);
+		}
+		else {
+			glDeleteTextures(1, &storages[s].name);
+		}
+	}
+	if (kept.size() != storages.size()) {
+		for (auto & entry : framebuffers) glDeleteFramebuffers(1, &entry.second);
+		framebuffers.clear();
+		for (int i : transients) targets[i].storage = remap[targets[i].storage];
+		storages.swap(kept);
+	}
+
+	bool complete = true;
+	for (int i : order) {
+		Pass & pass = passes[i];
+		pass.framebuffer = pass.writes.empty() ? 0 : framebufferFor(pass);
+		complete = complete && (pass.writes.empty() || pass.framebuffer);
+	}
+	compiled = complete;
+	return compiled;
+}
+
+void FrameGraph::execute()
+{
+	if (!compiled) return;
+	static const bool canInvalidate = glfwExtensionSupported("GL_ARB_invalidate_subdata") != 0;
+	for (int position = 0; position < (int)order.size(); position++) {
+		const Pass & pass = passes[order[position]];
+		RenderStats::local().beginPass(pass.name);
+		if (pass.framebuffer) {
+			glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+			RenderStats::framebuffer(pass.framebuffer);
+			const TargetDesc & size = targets[pass.writes[0]].desc;
+			glViewport(0, 0, size.width, size.height);
+		}
+		if (pass.execute) pass.execute();
+
+		// Transients done with need not be written back to memory
+		if (pass.framebuffer && canInvalidate) {
+			std::vector<GLenum> attachments;
+			int color = 0;
+			for (Resource write : pass.writes) {
+				const Target & target = targets[write];
+				bool depth = isDepthFormat(target.desc.format);
+				if (!target.imported && target.last == position) {
+					attachments.push_back(depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0 + color);
+				}
+				if (!depth) color++;
+			}
+			if (!attachments.empty()) {
+				glInvalidateFramebuffer(GL_FRAMEBUFFER, (GLsizei)attachments.size(), attachments.data());
+			}
+		}
+		RenderStats::local().endPass();
+	}
+}
+
+GLuint FrameGraph::texture(Resource resource) const
+{
+	const Target & target = targets[resource];
+	if (target.imported) return target.texture;
+	if (target.storage < 0 || storages[target.storage].renderbuffer) return 0;
+	return storages[target.storage].name;
+}
+
+long long FrameGraph::transientBytes() const
+{
+	long long bytes = 0;
+	for (const Target & target : targets) {
+		if (target.imported || target.first < 0) continue;
+		bytes += (long long)target.desc.width * target.desc.height * bytesPerTexel(target.desc.format);
+	}
+	return bytes;
+}
+
+long long FrameGraph::allocatedBytes() const
+{
+	long long bytes = 0;
+	for (const Storage & storage : storages) {
+		bytes += (long long)storage.desc.width * storage.desc.height * bytesPerTexel(storage.desc.format);
+	}
+	return bytes;
+}
+
+void FrameGraph::print(std::ostream & out) const
+{
+	const double megabyte = 1024.0 * 1024.0;
+	out << "frame graph: " << order.size() << " of " << passes.size() << " passes" << std::endl;
+	for (int i : order) {
+		const Pass & pass = passes[i];
+		out << "  " << pass.name << ", writes";
+		for (Resource write : pass.writes) {
+			const Target & target = targets[write];
+			out << " " << target.name;
+			if (!target.imported) out << " (storage " << target.storage << ")";
+		}
+		out << std::endl;
+	}
+	for (const Pass & pass : passes) {
+		if (!pass.alive) out << "  " << pass.name << ", culled" << std::endl;
+	}
+	long long own = transientBytes(), allocated = allocatedBytes();
+	out << "transient targets: " << own / megabyte << " MB with storage of their own, " << allocated / megabyte
+		<< " MB in " << storages.size() << " shared, " << (own - allocated) / megabyte << " MB saved" << std::endl;
+}
+
+void FrameGraph::releaseCache()
+{
+	for (auto & entry : framebuffers) glDeleteFramebuffers(1, &entry.second);
+	framebuffers.clear();
+	for (Storage & storage : storages) {
+		if (storage.renderbuffer) glDeleteRenderbuffers(1, &storage.name);
+		else glDeleteTextures(1, &storage.name);
+	}
+	storages.clear();
+	for (Target & target : targets) target.storage = -1;
+	for (Pass & pass : passes) pass.framebuffer = 0;
+	compiled = false;
+}
+
+bool FrameGraph::isDepthFormat(GLenum format)
+{
+	switch (format) {
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH_STENCIL:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	}
+	return false;
+}
+
+int FrameGraph::bytesPerTexel(GLenum format)
+{
+	switch (format) {
+	case GL_R8:
+		return 1;
+	case GL_DEPTH_COMPONENT16:
+	case GL_RG8:
+		return 2;
+	case GL_RGBA16F:
+	case GL_DEPTH32F_STENCIL8:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	}
+	// Drivers pad RGB8 and 24 bit depth to 32 bits
+	return 4;
+}
+
+bool FrameGraph::sameDesc(const TargetDesc & a, const TargetDesc & b) const
+{
+	return a.width == b.width && a.height == b.height && a.format == b.format;
+}
+
+void FrameGraph::allocate(Target & target)
+{
+	Storage storage;
+	storage.desc = target.desc;
+	storage.renderbuffer = isDepthFormat(target.desc.format);
+	if (storage.renderbuffer) {
+		glGenRenderbuffers(1, &storage.name);
+		glBindRenderbuffer(GL_RENDERBUFFER, storage.name);
+		glRenderbufferStorage(GL_RENDERBUFFER, target.desc.format, target.desc.width, target.desc.height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+	else {
+		glGenTextures(1, &storage.name);
+		glBindTexture(GL_TEXTURE_2D, storage.name);
+		glTexImage2D(GL_TEXTURE_2D, 0, target.desc.format, target.desc.width, target.desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	target.storage = (int)storages.size();
+	storages.push_back(storage);
+}
+
+GLuint FrameGraph::framebufferFor(const Pass & pass)
+{
+	// Kind 0 an imported texture or layer, 1 a texture of the graph, 2 a renderbuffer,
+	// 3 an imported depth texture
+	std::vector<GLuint> key;
+	for (Resource write : pass.writes) {
+		const Target & target = targets[write];
+		if (target.imported) {
+			GLuint kind = isDepthFormat(target.desc.format) ? 3u : 0u;
+			key.insert(key.end(), { kind, target.texture, (GLuint)(target.layer + 2) });
+		}
+		else {
+			const Storage & storage = storages[target.storage];
+			key.insert(key.end(), { storage.renderbuffer ? 2u : 1u, storage.name, 1u });
+		}
+	}
+	auto found = framebuffers.find(key);
+	if (found != framebuffers.end()) return found->second;
+
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < key.size(); i += 3) {
+		GLuint name = key[i + 1];
+		if (key[i] == 2) {
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, name);
+			continue;
+		}
+		GLenum attachment = key[i] == 3 ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+		if (key[i + 2] == 0) {
+			glFramebufferTexture(GL_FRAMEBUFFER, attachment, name, 0);
+		}
+		else if (key[i + 2] > 1) {
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, name, 0, key[i + 2] - 2);
+		}
+		else {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, name, 0);
+		}
+		if (key[i] != 3) drawBuffers.push_back(attachment);
+	}
+	if (drawBuffers.empty()) glDrawBuffer(GL_NONE);
+	else glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "frame graph: framebuffer of " << pass.name << " is incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+		glDeleteFramebuffers(1, &framebuffer);
+		return 0;
+	}
+	framebuffers[key] = framebuffer;
+	return framebuffer;
+}
@@ -0,0 +1,119 @@
+#ifndef _FRAME_GRAPH_H_
+#define _FRAME_GRAPH_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <vector>
+
+// Render passes declared with the targets they read and write instead of wired to
+// framebuffers by hand. compile() drops the passes nothing marked as an output
+// depends on, orders the rest after the passes writing what they read and works out
+// when each transient target is first and last used. Transients whose uses don't
+// overlap share storage, e.g. one depth buffer for every wall pass, and their
+// contents are invalidated after their last pass. Imported targets belong to the
+// caller and live on.
+//
+// The graph is declared anew every frame; storage and framebuffers are kept between
+// frames and only created when a frame needs more than the last one did.
+class FrameGraph
+{
+public:
+	typedef int Resource;
+	typedef std::function<void()> Execute;
+
+	// A depth format makes a renderbuffer, anything else a 2D texture
+	struct TargetDesc {
+		int width, height;
+		GLenum format;
+	};
+
+	FrameGraph() {}
+	~FrameGraph();
+	FrameGraph(const FrameGraph &) = delete;
+	FrameGraph & operator=(const FrameGraph &) = delete;
+
+	// Forgets the passes and targets of the last frame
+	void reset();
+	Resource createTarget(const char * name, const TargetDesc & desc);
+	// Layer of an imported texture attaching all its layers, for layered rendering into a
+	// cubemap or array. Every target of such a pass must be layered.
+	static const int allLayers = -2;
+
+	// A texture of the caller, layer is -1 unless it is a layer of an array texture.
+	// A depth format attaches it as the depth buffer.
+	Resource importTexture(const char * name, GLuint texture, int layer, int width, int height, GLenum format = 0);
+	// Written targets are attached in order, colors first. Each target has one writer.
+	// execute runs with the pass's framebuffer bound and the viewport set to it.
+	void addPass(const char * name, const std::vector<Resource> & reads, const std::vector<Resource> & writes, Execute execute);
+	// Needed after the frame, e.g. read by passes outside the graph
+	void markOutput(Resource resource);
+
+	bool compile();
+	void execute();
+
+	// The storage of a target for the passes reading it
+	GLuint texture(Resource resource) const;
+
+	// What the transients of the frame would take with storage of their own, and
+	// what the graph has allocated for them
+	long long transientBytes() const;
+	long long allocatedBytes() const;
+	void print(std::ostream & out) const;
+
+	// Deletes the storage and framebuffers, e.g. after imported textures were recreated
+	void releaseCache();
+
+	static bool isDepthFormat(GLenum format);
+	static int bytesPerTexel(GLenum format);
+
+private:
+	struct Target {
+		const char * name;
+		TargetDesc desc;
+		GLuint texture = 0;
+		int layer = -1;
+		bool imported = false;
+		bool output = false;
+		int writer = -1;
+		// Storage for transients, and the first and last pass in order using them
+		int storage = -1;
+		int first = -1, last = -1;
+	};
+	struct Pass {
+		const char * name;
+		std::vector<Resource> reads, writes;
+		Execute execute;
+		bool alive = false;
+		GLuint framebuffer = 0;
+	};
+	struct Storage {
+		TargetDesc desc;
+		GLuint name = 0;
+		bool renderbuffer = false;
+		// Pass in order after which this frame's current user is done with it
+		int busyUntil = -1;
+		bool used = false;
+	};
+
+	bool sameDesc(const TargetDesc & a, const TargetDesc & b) const;
+	void allocate(Target & target);
+	GLuint framebufferFor(const Pass & pass);
+
+	std::vector<Target> targets;
+	std::vector<Pass> passes;
+	std::vector<int> order;
+	std::vector<Storage> storages;
+	// Attachments, as kind, name and layer + 2 triples, to the framebuffer with them
+	std::map<std::vector<GLuint>, GLuint> framebuffers;
+	bool compiled = false;
+};
+
+#endif
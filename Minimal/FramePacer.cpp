@@ -0,0 +1,82 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+FramePacer::FramePacer(double rate)
+	: refreshRate(rate > 0.0 ? rate : 90.0)
+{
+	marginSeconds = minMarginSeconds;
+	history.reserve(historySize);
+}
+
+double FramePacer::startTime(double predictedDisplayTime) const
+{
+	return predictedDisplayTime - compositorLeadFrames * framePeriod() - renderEstimate() - marginSeconds;
+}
+
+void FramePacer::recordFrame(double renderSeconds, bool dropped)
+{
+	if ((int)history.size() < historySize) {
+		history.push_back(renderSeconds);
+	}
+	else {
+		history[nextSample] = renderSeconds;
+		nextSample = (nextSample + 1) % historySize;
+	}
+
+	// Back off quickly after a miss, creep back over about a second
+	if (dropped) {
+		marginSeconds = std::min(marginSeconds + 0.001, maxMarginSeconds);
+	}
+	else {
+		marginSeconds = std::max(marginSeconds - 0.00001, minMarginSeconds);
+	}
+}
+
+double FramePacer::renderEstimate() const
+{
+	// Until there is a history don't sleep at all
+	if (history.empty()) {
+		return framePeriod();
+	}
+	std::vector<double> sorted(history);
+	size_t index = std::min(sorted.size() - 1, (size_t)(renderPercentile * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+void FramePacer::sleepUntil(double target, double (*now)(), double spinSeconds)
+{
+	double remaining = target - now();
+	while (remaining > spinSeconds) {
+		// Sleeps overshoot by up to the timer resolution, stop while there's room for that
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::min(remaining - spinSeconds, 0.001)));
+		remaining = target - now();
+	}
+	while (now() < target) {
+		std::this_thread::yield();
+	}
+}
+
+void PacingStats::add(double frame, double sleep, double render, double motionToPhoton, bool dropped)
+{
+	frames++;
+	frameSeconds += frame;
+	sleepSeconds += sleep;
+	renderSeconds += render;
+	latencySeconds += motionToPhoton;
+	if (dropped) droppedFrames++;
+}
+
+void PacingStats::print(std::ostream & out, const char * name) const
+{
+	if (frames == 0) {
+		out << name << ": no frames" << std::endl;
+		return;
+	}
+	out << name << ": " << frames << " frames, " << frames / frameSeconds << " fps, render thread busy "
+		<< 100.0 * (1.0 - sleepSeconds / frameSeconds) << "%, render " << 1000.0 * renderSeconds / frames
+		<< " ms, motion to photon " << 1000.0 * latencySeconds / frames << " ms, "
+		<< droppedFrames << " dropped" << std::endl;
+}
@@ -0,0 +1,60 @@
+#ifndef _FRAME_PACER_H_
+#define _FRAME_PACER_H_
+
+#include <ostream>
+#include <vector>
+
+// Decides how long the render loop may sleep before starting a frame. The frame
+// has to reach the compositor compositorLeadFrames refresh periods before it is
+// displayed; subtracting a high percentile of the recent render durations and
+// a safety margin from that gives the latest start that still makes it. Starting
+// then instead of right away leaves the CPU idle in between and samples the
+// poses as late as possible. All times are in seconds on the ovr_GetTimeInSeconds
+// clock, nothing here talks to the SDK itself.
+class FramePacer
+{
+public:
+	explicit FramePacer(double refreshRate = 90.0);
+
+	bool enabled = true;
+	double compositorLeadFrames = 1.5;
+	// Margin on top of the render estimate, grows after a dropped frame
+	double minMarginSeconds = 0.002, maxMarginSeconds = 0.008;
+
+	double framePeriod() const { return 1.0 / refreshRate; }
+	double margin() const { return marginSeconds; }
+
+	// Latest time the frame displayed at predictedDisplayTime can start
+	double startTime(double predictedDisplayTime) const;
+
+	// Work of the last frame, from its start to the submit (CPU) or as measured
+	// on the GPU, whichever is longer. dropped says whether it missed its vsync.
+	void recordFrame(double renderSeconds, bool dropped);
+
+	// The renderPercentile of the last historySize render durations
+	double renderEstimate() const;
+
+	// Sleeps until target: coarse sleeps first, the last spinSeconds yield
+	static void sleepUntil(double target, double (*now)(), double spinSeconds = 0.0015);
+
+private:
+	double refreshRate;
+	double marginSeconds;
+	static const int historySize = 90;
+	const double renderPercentile = 0.95;
+	std::vector<double> history;
+	int nextSample = 0;
+};
+
+// Running totals for comparing paced and unpaced frames
+struct PacingStats
+{
+	int frames = 0, droppedFrames = 0;
+	double frameSeconds = 0.0, sleepSeconds = 0.0, renderSeconds = 0.0, latencySeconds = 0.0;
+
+	void add(double frame, double sleep, double render, double motionToPhoton, bool dropped);
+	// One line: frame rate, how busy the render thread was, latency and drops
+	void print(std::ostream & out, const char * name) const;
+};
+
+#endif
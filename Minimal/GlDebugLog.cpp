@@ -0,0 +1,198 @@
+#include "GlDebugLog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+GlDebugLog::GlDebugLog(int ringSize)
+	: ring(ringSize), mask(ringSize - 1)
+{
+	for (size_t i = 0; i < ring.size(); i++) {
+		ring[i].sequence = i;
+	}
+	worker = std::thread([this] {
+		while (running) {
+			drain();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		drain();
+	});
+}
+
+GlDebugLog::~GlDebugLog()
+{
+	running = false;
+	worker.join();
+}
+
+bool GlDebugLog::attach()
+{
+	if (!GLEW_KHR_debug) return false;
+	GLint flags;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) return false;
+	// The parameter of the callback lost its GLvoid * between GLEW versions
+	glDebugMessageCallback((GLDEBUGPROC)callback, this);
+	return true;
+}
+
+void GLAPIENTRY GlDebugLog::callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message, GLvoid * userParam)
+{
+	((GlDebugLog *)userParam)->push(source, type, id, severity, length, message);
+}
+
+bool GlDebugLog::push(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message)
+{
+	size_t position = writePosition.load(std::memory_order_relaxed);
+	Slot * slot;
+	for (;;) {
+		slot = &ring[position & mask];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		if (sequence == position) {
+			if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+		}
+		else if (sequence < position) {
+			// The reader has not freed this slot yet, the ring is full
+			droppedMessages.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else {
+			position = writePosition.load(std::memory_order_relaxed);
+		}
+	}
+	slot->source = source;
+	slot->type = type;
+	slot->id = id;
+	slot->severity = severity;
+	slot->frame = currentFrame.load(std::memory_order_relaxed);
+	size_t size = length < 0 ? strlen(message) : (size_t)length;
+	size = std::min(size, (size_t)maxText - 1);
+	memcpy(slot->text, message, size);
+	slot->text[size] = 0;
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+void GlDebugLog::drain()
+{
+	for (;;) {
+		Slot & slot = ring[readPosition & mask];
+		if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1) break;
+		record(slot);
+		// Free for the writer one lap ahead
+		slot.sequence.store(readPosition + ring.size(), std::memory_order_release);
+		readPosition++;
+	}
+	unsigned int frame = currentFrame.load(std::memory_order_relaxed);
+	if (frame > building.frame) {
+		finishFrame(frame);
+	}
+}
+
+void GlDebugLog::record(const Slot & slot)
+{
+	// Messages of a frame arrive in order, a newer one closes the frame before it
+	if (slot.frame > building.frame) {
+		finishFrame(slot.frame);
+	}
+	Category category = classify(slot.type, slot.text);
+	building.counts[category]++;
+
+	std::lock_guard<std::mutex> guard(lock);
+	MessageCount & message = messages[std::make_tuple(slot.source, slot.type, slot.id)];
+	if (message.total++ == 0) {
+		message.source = slot.source;
+		message.type = slot.type;
+		message.severity = slot.severity;
+		message.id = slot.id;
+		message.category = category;
+		message.text = slot.text;
+		// Only the first time, the repeats are counted
+		std::ostringstream line;
+		line << "GL debug (" << categoryName(category) << ", id " << slot.id << "): " << slot.text;
+#ifdef _WIN32
+		OutputDebugStringA((line.str() + "\n").c_str());
+#endif
+		std::cout << line.str() << std::endl;
+	}
+}
+
+void GlDebugLog::finishFrame(unsigned int frame)
+{
+	building.dropped = droppedMessages.exchange(0);
+	int performance = 0;
+	for (int category = CATEGORY_RECOMPILE; category <= CATEGORY_PERFORMANCE; category++) performance += building.counts[category];
+	auto now = std::chrono::steady_clock::now();
+	if ((performance || building.dropped) && now - lastPrinted > std::chrono::seconds(1)) {
+		lastPrinted = now;
+		std::cout << "GL debug frame " << building.frame << ":";
+		for (int category = CATEGORY_RECOMPILE; category <= CATEGORY_PERFORMANCE; category++) {
+			std::cout << " " << building.counts[category] << " " << categoryName(category) << ",";
+		}
+		std::cout << " " << building.dropped << " dropped" << std::endl;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		finished = building;
+	}
+	building = FrameReport();
+	building.frame = frame;
+}
+
+GlDebugLog::FrameReport GlDebugLog::lastFrameReport()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return finished;
+}
+
+std::vector<GlDebugLog::MessageCount> GlDebugLog::messageCounts()
+{
+	std::vector<MessageCount> counts;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (const auto & entry : messages) counts.push_back(entry.second);
+	}
+	std::sort(counts.begin(), counts.end(), [](const MessageCount & a, const MessageCount & b) { return a.total > b.total; });
+	return counts;
+}
+
+void GlDebugLog::printSummary(std::ostream & out)
+{
+	std::vector<MessageCount> counts = messageCounts();
+	long long totals[CATEGORY_COUNT] = { 0 };
+	for (const MessageCount & message : counts) totals[message.category] += message.total;
+	out << "GL debug messages:";
+	for (int category = 0; category < CATEGORY_COUNT; category++) {
+		out << " " << totals[category] << " " << categoryName(category) << (category + 1 < CATEGORY_COUNT ? "," : "");
+	}
+	out << std::endl;
+	for (const MessageCount & message : counts) {
+		out << "  " << message.total << "x (" << categoryName(message.category) << ", id " << message.id << ") " << message.text << std::endl;
+	}
+}
+
+GlDebugLog::Category GlDebugLog::classify(GLenum type, const char * text)
+{
+	if (type == GL_DEBUG_TYPE_ERROR) return CATEGORY_ERROR;
+	if (type != GL_DEBUG_TYPE_PERFORMANCE) return CATEGORY_OTHER;
+	// No standard for these, the words are what the NVIDIA, AMD and Intel drivers use
+	std::string lower(text);
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	const char * recompiles[] = { "recompil", "shader state", "based on gl state" };
+	const char * stalls[] = { "stall", "synchroniz", "wait", "flush" };
+	const char * migrations[] = { "migrat", "video memory", "system memory", "host memory", "will use", "moved" };
+	for (const char * word : recompiles) if (lower.find(word) != std::string::npos) return CATEGORY_RECOMPILE;
+	for (const char * word : stalls) if (lower.find(word) != std::string::npos) return CATEGORY_STALL;
+	for (const char * word : migrations) if (lower.find(word) != std::string::npos) return CATEGORY_MIGRATION;
+	return CATEGORY_PERFORMANCE;
+}
+
+const char * GlDebugLog::categoryName(int category)
+{
+	const char * names[CATEGORY_COUNT] = { "recompiles", "stalls", "buffer migrations", "other performance", "errors", "other" };
+	return names[category];
+}
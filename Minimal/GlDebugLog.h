@@ -0,0 +1,103 @@
+#ifndef _GL_DEBUG_LOG_H_
+#define _GL_DEBUG_LOG_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Driver debug output without console I/O in the driver's callback. The callback
+// only copies the message into a fixed size lock-free ring; a background thread
+// drains it, prints each distinct message (by source, type and id) the first time it
+// is seen and counts every repeat. Performance warnings are sorted into recompiles,
+// stalls, buffer migrations and others, per frame; a frame that had any is printed,
+// at most once a second.
+class GlDebugLog
+{
+public:
+	enum Category { CATEGORY_RECOMPILE, CATEGORY_STALL, CATEGORY_MIGRATION, CATEGORY_PERFORMANCE, CATEGORY_ERROR, CATEGORY_OTHER, CATEGORY_COUNT };
+
+	// Messages of one frame by category
+	struct FrameReport {
+		unsigned int frame = 0;
+		int counts[CATEGORY_COUNT] = { 0 };
+		int dropped = 0;
+	};
+
+	// A distinct message
+	struct MessageCount {
+		GLenum source, type, severity;
+		GLuint id;
+		Category category;
+		std::string text;
+		long long total = 0;
+	};
+
+	// ringSize must be a power of two
+	explicit GlDebugLog(int ringSize = 1024);
+	~GlDebugLog();
+
+	// Installs the callback on the current context if it is a debug context
+	bool attach();
+	// Called by the GL thread as a frame starts, later messages count toward it
+	void beginFrame(unsigned int frame) { currentFrame = frame; }
+
+	// The last frame the background thread has finished with
+	FrameReport lastFrameReport();
+	// Every distinct message with its count, most frequent first
+	std::vector<MessageCount> messageCounts();
+	void printSummary(std::ostream & out);
+
+	// Sorts a message by type and, for performance warnings, by what the driver says
+	static Category classify(GLenum type, const char * text);
+	static const char * categoryName(int category);
+
+	// Suitable for glDebugMessageCallback, with the log as user parameter
+	static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message, GLvoid * userParam);
+
+private:
+	static const int maxText = 256;
+	struct Slot {
+		// Vyukov's bounded queue: the position a slot expects to be written at next
+		std::atomic<size_t> sequence;
+		GLenum source, type, severity;
+		GLuint id;
+		unsigned int frame;
+		char text[maxText];
+	};
+
+	// Lock free, may be called from any thread, false if the ring was full
+	bool push(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message);
+	void drain();
+	void record(const Slot & slot);
+	void finishFrame(unsigned int frame);
+
+	std::vector<Slot> ring;
+	size_t mask;
+	std::atomic<size_t> writePosition{ 0 };
+	size_t readPosition = 0;
+	std::atomic<unsigned int> currentFrame{ 0 };
+	std::atomic<int> droppedMessages{ 0 };
+	std::atomic<bool> running{ true };
+	std::thread worker;
+
+	// Background thread only, except where the lock guards it
+	std::mutex lock;
+	std::map<std::tuple<GLenum, GLenum, GLuint>, MessageCount> messages;
+	FrameReport building, finished;
+	std::chrono::steady_clock::time_point lastPrinted;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include "Hud.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+
+namespace {
+	// 3x5 glyphs, rows from the top
+	struct Glyph {
+		char c;
+		const char * bits;
+	};
+	const Glyph font[] = {
+		{ '0', "111101101101111" }, { '1', "010110010010111" }, { '2', "111001111100111" },
+		{ '3', "111001111001111" }, { '4', "101101111001001" }, { '5', "111100111001111" },
+		{ '6', "111100111101111" }, { '7', "111001001001001" }, { '8', "111101111101111" },
+		{ '9', "111101111001111" }, { '.', "000000000000010" }, { ':', "000010000010000" },
+		{ '-', "000000111000000" }, { '/', "001001010100100" }, { '%', "101001010100101" },
+		{ 'A', "010101111101101" }, { 'B', "110101110101110" }, { 'C', "011100100100011" },
+		{ 'D', "110101101101110" }, { 'E', "111100110100111" }, { 'F', "111100110100100" },
+		{ 'G', "011100101101011" }, { 'H', "101101111101101" }, { 'I', "111010010010111" },
+		{ 'K', "101101110101101" }, { 'L', "100100100100111" }, { 'M', "101111111101101" },
+		{ 'N', "110101101101101" }, { 'O', "010101101101010" }, { 'P', "110101110100100" },
+		{ 'R', "110101110101101" }, { 'S', "011100010001110" }, { 'T', "111010010010010" },
+		{ 'U', "101101101101111" }, { 'V', "101101101101010" }, { 'W', "101101111111101" },
+		{ 'X', "101101010101101" }, { 'Y', "101101010010010" }, { 'Z', "111001010100111" },
+	};
+
+	const glm::vec4 textColor(0.9f, 0.9f, 0.9f, 1.0f);
+	const glm::vec4 goodColor(0.2f, 0.8f, 0.3f, 1.0f);
+	const glm::vec4 lateColor(0.9f, 0.2f, 0.2f, 1.0f);
+	const glm::vec4 gpuColor(0.3f, 0.5f, 1.0f, 1.0f);
+}
+
+Hud::Hud(ovrSession session, GLuint program, int width, int height)
+	: session(session), program(program), width(width), height(height), history(historySize)
+{
+	ovrTextureSwapChainDesc desc = {};
+	desc.Type = ovrTexture_2D;
+	desc.ArraySize = 1;
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
+	desc.SampleCount = 1;
+	desc.StaticImage = ovrFalse;
+	if (!OVR_SUCCESS(ovr_CreateTextureSwapChainGL(session, &desc, &chain))) {
+		std::cerr << "could not create the HUD swap chain" << std::endl;
+		chain = nullptr;
+	}
+
+	// Half a meter in front of the eyes and a little below them, wherever the head turns
+	memset(&quad, 0, sizeof(quad));
+	quad.Header.Type = ovrLayerType_Quad;
+	quad.Header.Flags = ovrLayerFlag_HeadLocked | ovrLayerFlag_TextureOriginAtBottomLeft;
+	quad.ColorTexture = chain;
+	quad.Viewport.Pos = { 0, 0 };
+	quad.Viewport.Size = { width, height };
+	quad.QuadPoseCenter.Orientation.w = 1.0f;
+	quad.QuadPoseCenter.Position.y = -0.12f;
+	quad.QuadPoseCenter.Position.z = -0.5f;
+	quad.QuadSize.x = 0.3f;
+	quad.QuadSize.y = 0.3f * height / width;
+
+	glGenFramebuffers(1, &fbo);
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec2));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+Hud::~Hud()
+{
+	for (QuerySlot & slot : slots) {
+		if (!slot.queries.empty()) glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+	}
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	if (chain) ovr_DestroyTextureSwapChain(session, chain);
+}
+
+void Hud::beginFrame()
+{
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		shownCpu[stage] = stageCpu[stage];
+		stageCpu[stage] = 0.0;
+	}
+	// The oldest slot is querySlots - 1 frames old, usually done by now. If it is not,
+	// its times are dropped rather than waited for.
+	currentSlot = (currentSlot + 1) % querySlots;
+	readSlot(slots[currentSlot]);
+}
+
+void Hud::readSlot(QuerySlot & slot)
+{
+	if (!slot.used) return;
+	GLint available = 0;
+	glGetQueryObjectiv(slot.queries[2 * slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available) {
+		double gpu[STAGE_COUNT] = { 0.0 };
+		for (int i = 0; i < slot.used; i++) {
+			GLuint64 begin, end;
+			glGetQueryObjectui64v(slot.queries[2 * i], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(slot.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+			gpu[slot.stages[i]] += (end - begin) / 1e6;
+		}
+		std::copy(gpu, gpu + STAGE_COUNT, shownGpu);
+	}
+	slot.used = 0;
+}
+
+void Hud::beginStage(int stage)
+{
+	QuerySlot & slot = slots[currentSlot];
+	if (2 * slot.used == (int)slot.queries.size()) {
+		slot.queries.resize(slot.queries.size() + 2);
+		slot.stages.resize(slot.used + 1);
+		glGenQueries(2, &slot.queries[2 * slot.used]);
+	}
+	slot.stages[slot.used] = stage;
+	glQueryCounter(slot.queries[2 * slot.used], GL_TIMESTAMP);
+	stageStarts[stage] = std::chrono::high_resolution_clock::now();
+}
+
+void Hud::endStage(int stage)
+{
+	QuerySlot & slot = slots[currentSlot];
+	glQueryCounter(slot.queries[2 * slot.used + 1], GL_TIMESTAMP);
+	slot.used++;
+	stageCpu[stage] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stageStarts[stage]).count();
+}
+
+void Hud::addFrame(const FrameStats & stats)
+{
+	newest = (newest + 1) % historySize;
+	history[newest] = stats;
+}
+
+long long Hud::videoMemoryKb()
+{
+	GLint total = 0, available = 0;
+	if (glfwExtensionSupported("GL_NVX_gpu_memory_info")) {
+		glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+		return (long long)total - available;
+	}
+	return -1;
+}
+
+void Hud::rect(float x, float y, float w, float h, const glm::vec4 & color)
+{
+	Vertex corners[4] = { { glm::vec2(x, y), color }, { glm::vec2(x + w, y), color },
+		{ glm::vec2(x + w, y + h), color }, { glm::vec2(x, y + h), color } };
+	const int order[6] = { 0, 1, 2, 2, 3, 0 };
+	for (int i : order) vertices.push_back(corners[i]);
+}
+
+void Hud::text(float x, float y, const std::string & line, const glm::vec4 & color, float scale)
+{
+	for (char c : line) {
+		for (const Glyph & glyph : font) {
+			if (glyph.c != c) continue;
+			for (int bit = 0; bit < 15; bit++) {
+				if (glyph.bits[bit] == '1') rect(x + (bit % 3) * scale, y + (bit / 3) * scale, scale, scale, color);
+			}
+			break;
+		}
+		x += 4 * scale;
+	}
+}
+
+void Hud::render(float budgetMs)
+{
+	if (!chain) return;
+	// Memory queries can be slow on some drivers, twice a second is plenty
+	if (framesSinceMemory-- <= 0) {
+		videoMemory = videoMemoryKb();
+		framesSinceMemory = 45;
+	}
+
+	vertices.clear();
+	const FrameStats & last = history[std::max(newest, 0)];
+	char line[128];
+	snprintf(line, sizeof(line), "FRAME CPU %.1f GPU %.1f MS", last.cpuMs, last.gpuMs);
+	text(8, 8, line, textColor);
+	snprintf(line, sizeof(line), "WALLS %.1f/%.1f  EYES %.1f/%.1f", shownCpu[STAGE_WALLS], shownGpu[STAGE_WALLS],
+		shownCpu[STAGE_EYES], shownGpu[STAGE_EYES]);
+	text(8, 28, line, textColor);
+	if (videoMemory >= 0) snprintf(line, sizeof(line), "PASSES %d  VRAM %lld MB", last.wallPasses, videoMemory / 1024);
+	else snprintf(line, sizeof(line), "PASSES %d  VRAM -", last.wallPasses);
+	text(8, 48, line, textColor);
+	snprintf(line, sizeof(line), "DROPPED APP %d COMP %d", last.appDropped, last.compositorDropped);
+	text(8, 68, line, last.appDropped || last.compositorDropped ? lateColor : textColor);
+	snprintf(line, sizeof(line), "DRAWS %d PROG %d TEX %d FBO %d UP %lld KB", last.render.draws, last.render.programs,
+		last.render.textures, last.render.framebuffers, last.render.uploadBytes / 1024);
+	text(8, 88, line, textColor);
+
+	// Oldest frame on the left, the budget line halfway up
+	float graphTop = 116.0f, graphHeight = height - graphTop - 4.0f;
+	float barWidth = (float)width / historySize;
+	float msToPixels = graphHeight / (2.0f * budgetMs);
+	for (int i = 0; i < historySize; i++) {
+		const FrameStats & frame = history[(newest + 1 + i) % historySize];
+		float cpu = std::min(frame.cpuMs * msToPixels, graphHeight);
+		float gpu = std::min(frame.gpuMs * msToPixels, graphHeight);
+		float x = i * barWidth;
+		rect(x, graphTop + graphHeight - cpu, barWidth * 0.5f, cpu, frame.cpuMs > budgetMs ? lateColor : goodColor);
+		rect(x + barWidth * 0.5f, graphTop + graphHeight - gpu, barWidth * 0.5f, gpu, frame.gpuMs > budgetMs ? lateColor : gpuColor);
+	}
+	rect(0, graphTop + graphHeight * 0.5f, (float)width, 1.0f, textColor);
+
+	int index;
+	GLuint texture;
+	ovr_GetTextureSwapChainCurrentIndex(session, chain, &index);
+	ovr_GetTextureSwapChainBufferGL(session, chain, index, &texture);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	RenderStats::framebuffer(fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glViewport(0, 0, width, height);
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.05f, 0.05f, 0.05f, 0.8f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	glDisable(GL_DEPTH_TEST);
+
+	glUseProgram(program);
+	RenderStats::program(program);
+	glUniform2f(glGetUniformLocation(program, "size"), (float)width, (float)height);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STREAM_DRAW);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+	RenderStats::upload(vertices.size() * sizeof(Vertex));
+	RenderStats::draw();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	glEnable(GL_DEPTH_TEST);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	ovr_CommitTextureSwapChain(session, chain);
+}
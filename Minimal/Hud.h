@@ -0,0 +1,100 @@
+#ifndef _HUD_H_
+#define _HUD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <OVR_CAPI.h>
+#include <OVR_CAPI_GL.h>
+#include "RenderStats.h"
+
+// Head locked performance overlay. It is drawn into a small swap chain of its own and
+// submitted as a quad layer next to the eye buffer, so the eye buffer being measured
+// is never touched and the compositor keeps it in place in front of the viewer.
+//
+// The stage times are summed over every begin/end pair of a stage in a frame. GPU
+// times come from timestamp queries that are read a few frames later, once they are
+// available, so the HUD never waits for the GPU.
+class Hud
+{
+public:
+	enum Stage { STAGE_WALLS, STAGE_EYES, STAGE_COUNT };
+
+	// What the app measured of a frame that has been submitted
+	struct FrameStats {
+		float cpuMs, gpuMs;
+		int wallPasses;
+		int appDropped, compositorDropped;
+		RenderCounters render;
+	};
+
+	// program is the hud.vert/hud.frag program
+	Hud(ovrSession session, GLuint program, int width = 512, int height = 256);
+	~Hud();
+
+	// False if the swap chain could not be created
+	bool valid() const { return chain != nullptr; }
+
+	void beginFrame();
+	void beginStage(int stage);
+	void endStage(int stage);
+	void addFrame(const FrameStats & stats);
+
+	// Draws the latest numbers and commits the swap chain, leaves the draw framebuffer
+	// unbound. budgetMs is the frame time the graph marks.
+	void render(float budgetMs);
+	ovrLayerHeader * layer() { return &quad.Header; }
+
+	// Frames in the graph
+	static const int historySize = 128;
+
+private:
+	struct Vertex {
+		glm::vec2 position;
+		glm::vec4 color;
+	};
+	// Timestamp pairs of one frame, queries[2 * i] and queries[2 * i + 1] bound stages[i]
+	struct QuerySlot {
+		std::vector<GLuint> queries;
+		std::vector<int> stages;
+		int used = 0;
+	};
+	static const int querySlots = 4;
+
+	void readSlot(QuerySlot & slot);
+	long long videoMemoryKb();
+	void rect(float x, float y, float w, float h, const glm::vec4 & color);
+	// Upper case, digits and . : - / % only, at scale pixels per font pixel
+	void text(float x, float y, const std::string & line, const glm::vec4 & color, float scale = 3.0f);
+
+	ovrSession session;
+	ovrTextureSwapChain chain = nullptr;
+	ovrLayerQuad quad;
+	GLuint program, fbo, VAO, VBO;
+	int width, height;
+
+	QuerySlot slots[querySlots];
+	int currentSlot = 0;
+	std::chrono::high_resolution_clock::time_point stageStarts[STAGE_COUNT];
+	double stageCpu[STAGE_COUNT] = { 0.0 }, shownCpu[STAGE_COUNT] = { 0.0 }, shownGpu[STAGE_COUNT] = { 0.0 };
+
+	std::vector<FrameStats> history;
+	int newest = -1;
+	long long videoMemory = -1;
+	int framesSinceMemory = 0;
+	std::vector<Vertex> vertices;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "ImageCompare.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+	struct Lab {
+		float y, cb, cr;
+	};
+
+	// BT.601 luma and colour differences, chroma at half weight
+	Lab toLab(const unsigned char * p)
+	{
+		float r = p[0], g = p[1], b = p[2];
+		Lab c;
+		c.y = 0.299f * r + 0.587f * g + 0.114f * b;
+		c.cb = 0.5f * (-0.168736f * r - 0.331264f * g + 0.5f * b);
+		c.cr = 0.5f * (0.5f * r - 0.418688f * g - 0.081312f * b);
+		return c;
+	}
+
+	float delta(const Lab & a, const Lab & b)
+	{
+		float dy = a.y - b.y, dcb = a.cb - b.cb, dcr = a.cr - b.cr;
+		return std::sqrt(dy * dy + dcb * dcb + dcr * dcr);
+	}
+
+}
+
+PerceptualDiff comparePerceptual(const unsigned char * golden, const unsigned char * image,
+	int width, int height, float tolerance)
+{
+	PerceptualDiff result;
+	if (width <= 0 || height <= 0) {
+		return result;
+	}
+
+	std::vector<Lab> reference(width * height);
+	for (int i = 0; i < width * height; i++) {
+		reference[i] = toLab(golden + i * 3);
+	}
+
+	double total = 0.0;
+	long long bad = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			Lab c = toLab(image + (y * width + x) * 3);
+			// Same texel first, almost every texel of a passing image stops here
+			float best = delta(c, reference[y * width + x]);
+			for (int dy = -1; dy <= 1 && best > tolerance; dy++) {
+				int ny = std::min(std::max(y + dy, 0), height - 1);
+				for (int dx = -1; dx <= 1; dx++) {
+					int nx = std::min(std::max(x + dx, 0), width - 1);
+					best = std::min(best, delta(c, reference[ny * width + nx]));
+				}
+			}
+			result.maxDelta = std::max(result.maxDelta, best);
+			total += best;
+			if (best > tolerance) {
+				bad++;
+			}
+		}
+	}
+	result.meanDelta = total / ((double)width * height);
+	result.badFraction = (double)bad / ((double)width * height);
+	return result;
+}
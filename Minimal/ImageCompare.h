@@ -0,0 +1,21 @@
+#ifndef _IMAGE_COMPARE_H_
+#define _IMAGE_COMPARE_H_
+
+// Result of comparing a rendered image against its golden
+struct PerceptualDiff
+{
+	float maxDelta = 0.0f;     // worst texel, in perceptual units (about 1 per 8 bit luma step)
+	double meanDelta = 0.0;
+	double badFraction = 0.0;  // fraction of texels above the tolerance
+};
+
+// Compares two RGB images of the same size the way a viewer would notice the
+// difference rather than byte for byte. Every texel is turned into luma and two
+// chroma channels, chroma counts half as much as luma, and a texel of the image
+// only needs to match one of the golden's texels in its 3x3 neighbourhood. That
+// absorbs the one texel edge shifts and rounding differences between GL drivers
+// while still catching a wrong texture, a missing wall or a moved cube.
+PerceptualDiff comparePerceptual(const unsigned char * golden, const unsigned char * image,
+	int width, int height, float tolerance);
+
+#endif
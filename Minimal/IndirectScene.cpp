@@ -0,0 +1,347 @@
+#include "IndirectScene.h"
+#include "RenderStats.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+IndirectScene::IndirectScene(GLuint cullProgram)
+	: gpuCulling(cullProgram != 0), cullProgram(cullProgram)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &uv_ID);
+	glGenBuffers(1, &EBO);
+	glGenBuffers(1, &idBuffer);
+	glGenBuffers(1, &objectBuffer);
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &counterBuffer);
+	glGenTextures(1, &objectTexture);
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, uv_ID);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+	// One object id per instance
+	glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_INT, sizeof(GLint), (GLvoid*)0);
+	glVertexAttribDivisor(2, 1);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GLuint zero = 0;
+	glBindBuffer(GL_ARRAY_BUFFER, counterBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (cullProgram) {
+		// Storage block bindings can not be set in a 4.1 shader
+		const char * blocks[3] = { "Objects", "Commands", "Visible" };
+		for (GLuint binding = 0; binding < 3; binding++) {
+			GLuint block = glGetProgramResourceIndex(cullProgram, GL_SHADER_STORAGE_BLOCK, blocks[binding]);
+			if (block != GL_INVALID_INDEX) {
+				glShaderStorageBlockBinding(cullProgram, block, binding);
+			}
+		}
+	}
+}
+
+IndirectScene::~IndirectScene()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &uv_ID);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &idBuffer);
+	glDeleteBuffers(1, &objectBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &counterBuffer);
+	glDeleteTextures(1, &objectTexture);
+}
+
+bool IndirectScene::gpuCullingSupported()
+{
+	// baseInstance has to reach the instanced object id, glMemoryBarrier comes with image load store
+	const char * extensions[] = { "GL_ARB_compute_shader", "GL_ARB_shader_storage_buffer_object",
+		"GL_ARB_program_interface_query", "GL_ARB_multi_draw_indirect", "GL_ARB_base_instance",
+		"GL_ARB_shader_image_load_store" };
+	for (const char * extension : extensions) {
+		if (!glfwExtensionSupported(extension)) return false;
+	}
+	return true;
+}
+
+void IndirectScene::setMesh(const GLfloat * positions, const GLfloat * uvs, int vertexCount, const GLuint * indices, int indexCount)
+{
+	indexTotal = indexCount;
+	meshRadius = 0.0f;
+	for (int i = 0; i < vertexCount; i++) {
+		meshRadius = std::max(meshRadius, glm::length(glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2])));
+	}
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(GLfloat), positions, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, uv_ID);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * 2 * sizeof(GLfloat), uvs, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void IndirectScene::setObjects(const std::vector<Object> & newObjects)
+{
+	objects = newObjects;
+	objectTotal = (int)objects.size();
+
+	glBindBuffer(GL_ARRAY_BUFFER, objectBuffer);
+	glBufferData(GL_ARRAY_BUFFER, objects.size() * sizeof(Object), objects.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, commandBuffer);
+	glBufferData(GL_ARRAY_BUFFER, objects.size() * sizeof(DrawCommand), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+	glBufferData(GL_ARRAY_BUFFER, objects.size() * sizeof(GLint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	idsAreIdentity = false;
+
+	glBindTexture(GL_TEXTURE_BUFFER, objectTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, objectBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	lastVisible = 0;
+}
+
+std::vector<IndirectScene::Object> IndirectScene::scatter(int count, float innerRadius, float outerRadius, float minScale, float maxScale, unsigned int seed) const
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Object> result(count);
+	for (Object & object : result) {
+		// Uniform in the shell's volume
+		glm::vec3 direction;
+		do {
+			direction = glm::vec3(unit(random), unit(random), unit(random)) * 2.0f - 1.0f;
+		} while (glm::dot(direction, direction) > 1.0f || glm::dot(direction, direction) < 1e-6f);
+		float inner3 = innerRadius * innerRadius * innerRadius, outer3 = outerRadius * outerRadius * outerRadius;
+		float radius = std::cbrt(inner3 + unit(random) * (outer3 - inner3));
+		glm::vec3 position = glm::normalize(direction) * radius;
+		float scale = minScale + unit(random) * (maxScale - minScale);
+		glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.1f);
+
+		object.toWorld = glm::translate(glm::mat4(1.0f), position)
+			* glm::rotate(glm::mat4(1.0f), unit(random) * 6.2831853f, axis)
+			* glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+		object.sphere = glm::vec4(position, meshRadius * scale);
+	}
+	return result;
+}
+
+void IndirectScene::frustumPlanes(const glm::mat4 & clip, glm::vec4 planes[6])
+{
+	// Gribb and Hartmann: the planes are the sums and differences of the matrix rows
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		planes[axis * 2] = rows[3] + rows[axis];
+		planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for (int i = 0; i < 6; i++) {
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool IndirectScene::sphereVisible(const glm::vec4 planes[6], const glm::vec4 & sphere)
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), glm::vec3(sphere)) + planes[i].w < -sphere.w) return false;
+	}
+	return true;
+}
+
+void IndirectScene::cullOnGpu(const glm::vec4 planes[6])
+{
+	if (!idsAreIdentity) {
+		std::vector<GLint> identity(objectTotal);
+		for (int i = 0; i < objectTotal; i++) identity[i] = i;
+		glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, identity.size() * sizeof(GLint), identity.data());
+		RenderStats::upload(identity.size() * sizeof(GLint));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		idsAreIdentity = true;
+	}
+
+	GLuint zero = 0;
+	glBindBuffer(GL_ARRAY_BUFFER, counterBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	RenderStats::upload(sizeof(GLuint));
+
+	glUseProgram(cullProgram);
+	RenderStats::program(cullProgram);
+	glUniform4fv(glGetUniformLocation(cullProgram, "planes"), 6, &planes[0][0]);
+	glUniform1ui(glGetUniformLocation(cullProgram, "objectCount"), (GLuint)objectTotal);
+	glUniform1ui(glGetUniformLocation(cullProgram, "indexCount"), (GLuint)indexTotal);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, counterBuffer);
+	// Must match local_size_x in cull.comp
+	glDispatchCompute((objectTotal + 63) / 64, 1, 1);
+	// The commands are read by the draw that follows
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+void IndirectScene::beginView(ViewPacket & packet) const
+{
+	frustumPlanes(packet.projection * packet.modelview, packet.planes);
+	packet.chunks.resize((objectTotal + objectGrain - 1) / objectGrain);
+}
+
+void IndirectScene::cullChunk(ViewPacket & packet, int chunk) const
+{
+	// Clip w is the distance along the view direction
+	glm::mat4 clip = packet.projection * packet.modelview;
+	glm::vec4 depthRow(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+	std::vector<std::pair<float, GLint>> & visible = packet.chunks[chunk];
+	visible.clear();
+	int end = std::min(objectTotal, (chunk + 1) * objectGrain);
+	for (int i = chunk * objectGrain; i < end; i++) {
+		const glm::vec4 & sphere = objects[i].sphere;
+		if (!sphereVisible(packet.planes, sphere)) continue;
+		visible.push_back(std::make_pair(glm::dot(depthRow, glm::vec4(glm::vec3(sphere), 1.0f)), (GLint)i));
+	}
+}
+
+void IndirectScene::finishView(ViewPacket & packet) const
+{
+	size_t total = 0;
+	for (const auto & visible : packet.chunks) total += visible.size();
+	std::vector<std::pair<float, GLint>> sorted;
+	sorted.reserve(total);
+	for (const auto & visible : packet.chunks) sorted.insert(sorted.end(), visible.begin(), visible.end());
+	// Front to back, so near objects fill the depth buffer before the far ones are shaded
+	std::sort(sorted.begin(), sorted.end());
+	packet.visibleIds.resize(total);
+	for (size_t i = 0; i < total; i++) packet.visibleIds[i] = sorted[i].second;
+}
+
+ThreadPool::Job IndirectScene::prepareView(ThreadPool & pool, ViewPacket & packet, const std::vector<ThreadPool::Job> & dependencies) const
+{
+	ViewPacket * view = &packet;
+	ThreadPool::Job planes = pool.add([this, view] { beginView(*view); }, dependencies);
+	int chunks = (objectTotal + objectGrain - 1) / objectGrain;
+	ThreadPool::Job culled = pool.parallelForAsync(0, chunks, 1, [this, view](int first, int last) {
+		for (int chunk = first; chunk < last; chunk++) cullChunk(*view, chunk);
+	}, { planes });
+	return pool.add([this, view] { finishView(*view); }, { culled });
+}
+
+void IndirectScene::prepareView(ViewPacket & packet) const
+{
+	beginView(packet);
+	for (int chunk = 0; chunk < (int)packet.chunks.size(); chunk++) cullChunk(packet, chunk);
+	finishView(packet);
+}
+
+void IndirectScene::bindDraw(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture)
+{
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &projection[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &modelview[0][0]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glUniform1i(glGetUniformLocation(program, "myTextureSampler"), 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, objectTexture);
+	glUniform1i(glGetUniformLocation(program, "objects"), 1);
+	RenderStats::texture(2);
+	glBindVertexArray(VAO);
+}
+
+void IndirectScene::submitView(GLuint program, const ViewPacket & packet, GLuint texture)
+{
+	lastOnGpu = false;
+	lastVisible = (int)packet.visibleIds.size();
+	idsAreIdentity = false;
+	if (packet.visibleIds.empty()) return;
+	glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+	// Orphan, the previous view's draw may still read the ids
+	glBufferData(GL_ARRAY_BUFFER, objectTotal * sizeof(GLint), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, packet.visibleIds.size() * sizeof(GLint), packet.visibleIds.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	RenderStats::upload(packet.visibleIds.size() * sizeof(GLint));
+
+	glUseProgram(program);
+	RenderStats::program(program);
+	bindDraw(program, packet.projection, packet.modelview, texture);
+	glDrawElementsInstanced(GL_TRIANGLES, indexTotal, GL_UNSIGNED_INT, (GLvoid*)0, (GLsizei)packet.visibleIds.size());
+	RenderStats::draw();
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void IndirectScene::draw(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture)
+{
+	if (!objectTotal) return;
+	if (!(gpuCulling && cullProgram)) {
+		cpuView.projection = projection;
+		cpuView.modelview = modelview;
+		prepareView(cpuView);
+		submitView(program, cpuView, texture);
+		return;
+	}
+
+	glm::vec4 planes[6];
+	frustumPlanes(projection * modelview, planes);
+	lastOnGpu = true;
+	cullOnGpu(planes);
+	glUseProgram(program);
+	RenderStats::program(program);
+	bindDraw(program, projection, modelview, texture);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0, objectTotal, 0);
+	RenderStats::draw();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void IndirectScene::drawPerObject(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture)
+{
+	glm::vec4 planes[6];
+	frustumPlanes(projection * modelview, planes);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &projection[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &modelview[0][0]);
+	GLint uView = glGetUniformLocation(program, "view");
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glUniform1i(glGetUniformLocation(program, "myTextureSampler"), 0);
+	RenderStats::texture();
+
+	lastVisible = 0;
+	lastOnGpu = false;
+	glBindVertexArray(VAO);
+	for (int i = 0; i < objectTotal; i++) {
+		if (!sphereVisible(planes, objects[i].sphere)) continue;
+		lastVisible++;
+		glUniformMatrix4fv(uView, 1, GL_FALSE, &objects[i].toWorld[0][0]);
+		glDrawElements(GL_TRIANGLES, indexTotal, GL_UNSIGNED_INT, (GLvoid*)0);
+		RenderStats::draw();
+	}
+	glBindVertexArray(0);
+}
+
+int IndirectScene::lastVisibleCount()
+{
+	if (!lastOnGpu) return lastVisible;
+	GLuint visible = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, counterBuffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLuint), &visible);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return (int)visible;
+}
@@ -0,0 +1,129 @@
+#ifndef _INDIRECT_SCENE_H_
+#define _INDIRECT_SCENE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+// Many copies of one indexed mesh, culled against every view and submitted with a
+// number of GL calls that does not grow with the number of objects.
+//
+// On the GPU path a compute shader culls each object against the view frustum and
+// writes its DrawElementsIndirectCommand (one instance or none, baseInstance = the
+// object), then one glMultiDrawElementsIndirect draws the view. Compute shaders,
+// storage buffers and multi draw indirect are core in 4.3 only, so on the 4.1
+// context they come from extensions, see gpuCullingSupported(). Without them the CPU
+// culls into a list of visible objects, sorted front to back, that one instanced draw
+// consumes. That culling touches no GL, so the views of a frame can be prepared as
+// jobs with prepareView() and only their submitView() is left to the GL thread.
+//
+// The vertex shader fetches the object's toWorld through a buffer texture of the
+// object buffer, indexed by a per instance attribute at location 2.
+class IndirectScene
+{
+public:
+	// std430 and RGBA32F buffer texture layout, five vec4s per object
+	struct Object {
+		glm::mat4 toWorld;
+		// World space bounding sphere: center, radius
+		glm::vec4 sphere;
+	};
+
+	// Layout glMultiDrawElementsIndirect reads
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// One view culled on the CPU
+	struct ViewPacket {
+		glm::mat4 projection, modelview;
+		glm::vec4 planes[6];
+		// Visible objects front to back, the instance ids submitView() uploads
+		std::vector<GLint> visibleIds;
+		// View depth and id of the visible objects of each chunk of objectGrain objects
+		std::vector<std::vector<std::pair<float, GLint>>> chunks;
+	};
+
+	// Objects culled by one job
+	static const int objectGrain = 4096;
+
+	// cullProgram is the compute culling program, 0 to cull on the CPU
+	explicit IndirectScene(GLuint cullProgram = 0);
+	~IndirectScene();
+
+	static bool gpuCullingSupported();
+
+	// Triangle list of vertexCount positions (xyz) and uvs
+	void setMesh(const GLfloat * positions, const GLfloat * uvs, int vertexCount, const GLuint * indices, int indexCount);
+	void setObjects(const std::vector<Object> & objects);
+	int objectCount() const { return objectTotal; }
+
+	// Random objects in a shell around the origin, the bounding spheres come from the mesh
+	std::vector<Object> scatter(int count, float innerRadius, float outerRadius, float minScale, float maxScale, unsigned int seed) const;
+
+	// Culls against projection * modelview and draws what is left, the same matrix order
+	// as Cube::draw. Leaves program in use; the GPU path switches programs to cull.
+	void draw(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture);
+	// Culls packet's view: one job finds the planes, the chunks of objects are culled in
+	// parallel after it and a last job, which is returned, sorts the survivors. The
+	// matrices are read once dependencies have finished. Objects must not change until
+	// the job has finished.
+	ThreadPool::Job prepareView(ThreadPool & pool, ViewPacket & packet,
+		const std::vector<ThreadPool::Job> & dependencies = std::vector<ThreadPool::Job>()) const;
+	// The same on the calling thread
+	void prepareView(ViewPacket & packet) const;
+	// Draws a prepared view like draw() does on the CPU path, on the GL thread
+	void submitView(GLuint program, const ViewPacket & packet, GLuint texture);
+
+	// The submission this replaces: CPU culling and a draw per object, with the cube program
+	void drawPerObject(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture);
+
+	// Objects that survived culling in the last draw. Waits for the GPU on its path.
+	int lastVisibleCount();
+
+	// Cull on the GPU, only possible with a cull program
+	bool gpuCulling;
+
+	// Planes with inward normals, normalized so a plane's w is a signed distance
+	static void frustumPlanes(const glm::mat4 & clip, glm::vec4 planes[6]);
+	static bool sphereVisible(const glm::vec4 planes[6], const glm::vec4 & sphere);
+
+private:
+	void cullOnGpu(const glm::vec4 planes[6]);
+	void beginView(ViewPacket & packet) const;
+	void cullChunk(ViewPacket & packet, int chunk) const;
+	void finishView(ViewPacket & packet) const;
+	void bindDraw(GLuint program, const glm::mat4 & projection, const glm::mat4 & modelview, GLuint texture);
+
+	GLuint cullProgram;
+	GLuint VAO, VBO, uv_ID, EBO, idBuffer;
+	GLuint objectBuffer, objectTexture, commandBuffer, counterBuffer;
+	int indexTotal = 0, objectTotal = 0;
+	float meshRadius = 0.0f;
+	// CPU copy of the objects for culling there, the view draw() culls there and the
+	// visible objects of the last CPU draw
+	std::vector<Object> objects;
+	ViewPacket cpuView;
+	int lastVisible = 0;
+	// idBuffer holds 0 .. objectTotal - 1, which baseInstance indexes on the GPU path
+	bool idsAreIdentity = false;
+	bool lastOnGpu = false;
+};
+
+#endif
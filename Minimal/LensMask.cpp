@@ -0,0 +1,89 @@
+#include "LensMask.h"
+#include <algorithm>
+#include <cmath>
+
+LensMask::LensMask()
+{
+	glGenVertexArrays(2, VAO);
+	glGenBuffers(2, VBO);
+	for (int eye = 0; eye < 2; eye++) {
+		vertexCount[eye] = 0;
+		hidden[eye] = 0.0f;
+		glBindVertexArray(VAO[eye]);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO[eye]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+LensMask::~LensMask()
+{
+	glDeleteVertexArrays(2, VAO);
+	glDeleteBuffers(2, VBO);
+}
+
+void LensMask::build(int eye, const ovrFovPort & fov, float radiusScale, int segments)
+{
+	std::vector<glm::vec2> triangles;
+	hidden[eye] = buildMesh(fov, radiusScale, segments, triangles) / 4.0f;
+	vertexCount[eye] = (int)triangles.size();
+	glBindBuffer(GL_ARRAY_BUFFER, VBO[eye]);
+	glBufferData(GL_ARRAY_BUFFER, triangles.size() * sizeof(glm::vec2), triangles.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void LensMask::draw(int eye)
+{
+	if (!vertexCount[eye]) return;
+	// Nothing is cleared to a depth below the near plane, so the default test passes
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glBindVertexArray(VAO[eye]);
+	glDrawArrays(GL_TRIANGLES, 0, vertexCount[eye]);
+	glBindVertexArray(0);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+float LensMask::buildMesh(const ovrFovPort & fov, float radiusScale, int segments, std::vector<glm::vec2> & triangles)
+{
+	// Where the optical axis lands in NDC, the same offsets ovrMatrix4f_Projection uses
+	glm::vec2 center((fov.LeftTan - fov.RightTan) / (fov.LeftTan + fov.RightTan),
+		(fov.DownTan - fov.UpTan) / (fov.UpTan + fov.DownTan));
+	glm::vec2 tanToNdc(2.0f / (fov.LeftTan + fov.RightTan), 2.0f / (fov.UpTan + fov.DownTan));
+
+	// One fan per quadrant from the corner of the viewport over the ellipse arc, which
+	// starts and ends on the axes, to where the axes meet the viewport edges
+	int quadrantSegments = std::max(1, segments / 4);
+	float area = 0.0f;
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		float sx = (quadrant == 0 || quadrant == 3) ? 1.0f : -1.0f;
+		float sy = quadrant < 2 ? 1.0f : -1.0f;
+		glm::vec2 radius(sx > 0 ? fov.RightTan : fov.LeftTan, sy > 0 ? fov.UpTan : fov.DownTan);
+		radius = radius * radiusScale;
+		glm::vec2 corner(sx, sy);
+
+		std::vector<glm::vec2> outline;
+		outline.push_back(glm::vec2(sx, center.y));
+		for (int i = 0; i <= quadrantSegments; i++) {
+			float angle = 1.5707963f * i / quadrantSegments;
+			glm::vec2 tangent(sx * radius.x * std::cos(angle), sy * radius.y * std::sin(angle));
+			glm::vec2 point = center + tangent * tanToNdc;
+			point.x = std::min(std::max(point.x, -1.0f), 1.0f);
+			point.y = std::min(std::max(point.y, -1.0f), 1.0f);
+			outline.push_back(point);
+		}
+		outline.push_back(glm::vec2(center.x, sy));
+
+		for (size_t i = 0; i + 1 < outline.size(); i++) {
+			glm::vec2 a = outline[i] - corner, b = outline[i + 1] - corner;
+			float twiceArea = std::abs(a.x * b.y - a.y * b.x);
+			if (twiceArea < 1e-7f) continue;
+			triangles.push_back(corner);
+			triangles.push_back(outline[i]);
+			triangles.push_back(outline[i + 1]);
+			area += 0.5f * twiceArea;
+		}
+	}
+	return area;
+}
@@ -0,0 +1,46 @@
+#ifndef _LENS_MASK_H_
+#define _LENS_MASK_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <vector>
+#include <OVR_CAPI.h>
+
+// Hidden area mesh of the eye buffer: the parts of an eye's viewport the lens never
+// shows. Drawn at the near plane into the depth buffer at the start of an eye pass,
+// every later fragment there fails the depth test before it is shaded.
+class LensMask
+{
+public:
+	LensMask();
+	~LensMask();
+
+	// The visible area is an ellipse around the optical axis that reaches radiusScale
+	// of the way to every edge of the field of view, everything outside it is masked
+	void build(int eye, const ovrFovPort & fov, float radiusScale = 1.0f, int segments = 64);
+	// Writes depth only, into the current viewport, with the lens mask program in use
+	void draw(int eye);
+
+	// Fraction of the eye's viewport covered by the mask
+	float hiddenFraction(int eye) const { return hidden[eye]; }
+
+	// Triangle list in normalized device coordinates, returns the area it covers
+	static float buildMesh(const ovrFovPort & fov, float radiusScale, int segments, std::vector<glm::vec2> & triangles);
+
+private:
+	GLuint VAO[2], VBO[2];
+	int vertexCount[2];
+	float hidden[2];
+};
+
+#endif
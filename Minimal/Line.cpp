@@ -1,4 +1,5 @@
 #include "Line.h"
+#include "RenderStats.h"
 #include <iostream>
 
 Line::Line()
@@ -40,10 +41,23 @@ void Line::draw(GLint shaderProgram, glm::mat4 P, glm::mat4 V) {
 	glBindVertexArray(VAO);
 	// Tell OpenGL to draw with triangles, using 36 indices, the type of the indices, and the offset to start from
 	glDrawArrays(GL_LINES, 0, 2);
+	RenderStats::draw();
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
 }
 
+void Line::drawStereo(GLint shaderProgram) {
+	glLineWidth(10.0f);
+	glm::vec3 color = pressed ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glUniform3f(glGetUniformLocation(shaderProgram, "material.ambient"), color.r, color.g, color.b);
+	glUniform3f(glGetUniformLocation(shaderProgram, "material.diffuse"), color.r, color.g, color.b);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "toWorld"), 1, GL_FALSE, &toWorld[0][0]);
+	glBindVertexArray(VAO);
+	glDrawArraysInstanced(GL_LINES, 0, 2, 2);
+	RenderStats::draw();
+	glBindVertexArray(0);
+}
+
 void Line::update(glm::vec3 p1, glm::vec3 p2, bool p)
 {
 	pressed = p; 
@@ -64,6 +78,7 @@ void Line::update(glm::vec3 p1, glm::vec3 p2, bool p)
 	// glBufferData populates the most recently bound buffer with data starting at the 3rd argument and ending after
 	// the 2nd argument number of indices. How does OpenGL know how long an index spans? Go to glVertexAttribPointer.
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	RenderStats::upload(sizeof(vertices));
 	// Enable the usage of layout location 0 (check the vertex shader to see what this is)
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
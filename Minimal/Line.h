@@ -24,6 +24,8 @@ public:
 	glm::mat4 toWorld;
 
 	void draw(GLint shaderProgram, glm::mat4 P, glm::mat4 V);
+	// Both eyes in one instanced draw, the eye matrices come from the StereoEyes block
+	void drawStereo(GLint shaderProgram);
 	void update(glm::vec3 p1, glm::vec3 p2, bool p);
 
 	// These variables are needed for the shader program
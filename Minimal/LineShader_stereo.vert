@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoords;
+
+out vec2 TexCoords;
+
+uniform mat4 toWorld;
+
+out vec3 Normal;
+out vec3 FragPos;
+
+void main()
+{
+    mat4 modelview = eyeView[gl_InstanceID] * toWorld;
+    stereoOutput(eyeProjection[gl_InstanceID] * modelview * vec4(position, 1.0));
+    TexCoords = texCoords;
+    FragPos = vec3(modelview * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(modelview))) * normal;
+}
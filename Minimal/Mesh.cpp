@@ -0,0 +1,99 @@
+#include "Mesh.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+Mesh::Mesh(const CookedMesh & cooked)
+{
+	toWorld = glm::mat4(1.0f);
+	const CookedMeshHeader & header = cooked.header();
+	boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	dequantize = glm::translate(glm::mat4(1.0f), boundsMin) * glm::scale(glm::mat4(1.0f), boundsMax - boundsMin);
+	indexType = header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	lods.assign(cooked.lods(), cooked.lods() + header.lodCount);
+	size_t vertexBytes = header.vertexCount * sizeof(PackedVertex);
+	size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+	gpuBytes = vertexBytes + indexBytes;
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glBindVertexArray(VAO);
+
+	// The mapped sections go to GL without a copy on our side
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, cooked.vertices(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, cooked.indices(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
+	glBindVertexArray(0);
+}
+
+Mesh::~Mesh()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+}
+
+void Mesh::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V, int lod)
+{
+	glm::mat4 view = toWorld * dequantize;
+	// Normals go through toWorld only, the dequantization scale would bend them
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(toWorld)));
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &P[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &V[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "normalMatrix"), 1, GL_FALSE, &normalMatrix[0][0]);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "lightDirection"), 1, &lightDirection[0]);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "baseColor"), 1, &baseColor[0]);
+
+	glBindVertexArray(VAO);
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	glDrawElements(GL_TRIANGLES, lods[lod].indexCount, indexType, (GLvoid*)(lods[lod].firstIndex * indexSize));
+	RenderStats::draw();
+	glBindVertexArray(0);
+}
+
+float Mesh::projectedSize(const glm::mat4 & clip, const glm::vec3 & center, float radius, float length, int resolution)
+{
+	// Clip x and y change by at most the length of their rows' xyz per unit moved, and
+	// w is the distance along the view axis. Dividing by the smallest w on the sphere
+	// keeps the estimate conservative for off-axis projections as well.
+	glm::vec3 rowX(clip[0][0], clip[1][0], clip[2][0]);
+	glm::vec3 rowY(clip[0][1], clip[1][1], clip[2][1]);
+	glm::vec3 rowW(clip[0][3], clip[1][3], clip[2][3]);
+	float w = glm::dot(rowW, center) + clip[3][3] - radius * glm::length(rowW);
+	if (w <= 1e-4f) return FLT_MAX;
+	float scale = std::max(glm::length(rowX), glm::length(rowY));
+	return length * scale / w * resolution * 0.5f;
+}
+
+int Mesh::selectLod(int view, const glm::mat4 & clip, int resolution)
+{
+	if (view >= (int)viewLods.size()) viewLods.resize(view + 1, 0);
+	glm::vec3 center = glm::vec3(toWorld * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+	float worldScale = std::max(std::max(glm::length(glm::vec3(toWorld[0])), glm::length(glm::vec3(toWorld[1]))),
+		glm::length(glm::vec3(toWorld[2])));
+	float radius = glm::length(boundsMax - boundsMin) * 0.5f * worldScale;
+	// Texels per model unit of error
+	float texels = projectedSize(clip, center, radius, worldScale, resolution);
+
+	int lod = std::min(viewLods[view], lodCount() - 1);
+	while (lod > 0 && lods[lod].error * texels > maxTexelError) lod--;
+	while (lod + 1 < lodCount() && lods[lod + 1].error * texels < maxTexelError * (1.0f - hysteresis)) lod++;
+	viewLods[view] = lod;
+	return lod;
+}
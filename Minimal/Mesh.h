@@ -0,0 +1,66 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include "MeshCache.h"
+
+// A cooked mesh on the GPU. Its buffers are filled straight from the mapped file and
+// the packed attributes are read as they are: quantized positions as normalized
+// shorts, dequantized by the bounds folded into the model matrix, octahedral normals
+// decoded by mesh.vert, uvs as half floats.
+class Mesh
+{
+public:
+	explicit Mesh(const CookedMesh & cooked);
+	~Mesh();
+
+	glm::mat4 toWorld;
+	glm::vec3 baseColor = glm::vec3(0.8f, 0.8f, 0.8f);
+	// Towards the light, in world space
+	glm::vec3 lightDirection = glm::vec3(0.3f, 1.0f, 0.5f);
+
+	void draw(GLuint, glm::mat4 P, glm::mat4 V, int lod = 0);
+
+	// Level of detail selection. The simplification error of a LOD is projected to
+	// texels of a view at the nearest point of the model's bounding sphere. The
+	// coarsest LOD within maxTexelError is drawn, but a view only moves to a coarser
+	// LOD once that one is within (1 - hysteresis) of the limit, so a model near the
+	// threshold doesn't pop back and forth.
+	float maxTexelError = 1.0f;
+	float hysteresis = 0.25f;
+	// view is any small id for a view that keeps being rendered, e.g. eye and wall;
+	// clip is its projection * modelview and resolution its side in texels
+	int selectLod(int view, const glm::mat4 & clip, int resolution);
+	// Texels a world space length at world space center spans at most in a view
+	static float projectedSize(const glm::mat4 & clip, const glm::vec3 & center, float radius, float length, int resolution);
+	int lodCount() const { return (int)lods.size(); }
+	int triangles(int lod) const { return lods[lod].indexCount / 3; }
+
+	glm::vec3 boundsMin, boundsMax;
+	// Vertex and index buffer sizes
+	size_t gpuBytes;
+
+	// These variables are needed for the shader program
+	GLuint VBO, VAO, EBO;
+	GLenum indexType;
+	// Maps the quantized unit cube onto the bounds
+	glm::mat4 dequantize;
+	std::vector<MeshLod> lods;
+	// The LOD each view drew last
+	std::vector<int> viewLods;
+};
+
+#endif
@@ -0,0 +1,536 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+	const char cookedMagic[4] = { 'C', 'M', 'S', 'H' };
+	const uint32_t cookedVersion = 2;
+
+	size_t align16(size_t offset) {
+		return (offset + 15) & ~(size_t)15;
+	}
+
+	// One corner of an OBJ face: position, uv and normal index, -1 if absent
+	struct Corner {
+		int v, t, n;
+		bool operator==(const Corner & other) const { return v == other.v && t == other.t && n == other.n; }
+	};
+
+	struct Cell {
+		int x, y, z;
+		bool operator==(const Cell & other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct CellHash {
+		size_t operator()(const Cell & c) const {
+			return ((size_t)c.x * 73856093u) ^ ((size_t)c.y * 19349663u) ^ ((size_t)c.z * 83492791u);
+		}
+	};
+
+	struct CornerHash {
+		size_t operator()(const Corner & c) const {
+			return ((size_t)c.v * 73856093u) ^ ((size_t)(c.t + 1) * 19349663u) ^ ((size_t)(c.n + 1) * 83492791u);
+		}
+	};
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	// OBJ indices are 1 based, negative ones count back from the last element read
+	int resolveIndex(long index, size_t count) {
+		if (index > 0) return (int)index - 1;
+		if (index < 0) return (int)count + (int)index;
+		return -1;
+	}
+
+	float readFloat(const char *& p) {
+		char * next;
+		float value = strtof(p, &next);
+		p = next;
+		return value;
+	}
+
+}
+
+bool importObj(const char * filename, ImportedMesh & mesh)
+{
+	std::string text;
+	if (!readBinaryFile(filename, text)) {
+		std::cerr << "could not read " << filename << std::endl;
+		return false;
+	}
+	mesh = ImportedMesh();
+
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	std::unordered_map<Corner, uint32_t, CornerHash> unique;
+	// Normals smoothed from the faces for corners without one
+	std::vector<bool> computedNormal;
+	std::vector<uint32_t> polygon;
+
+	const char * p = text.c_str();
+	const char * end = p + text.size();
+	while (p < end) {
+		while (p < end && isSpace(*p)) p++;
+		const char * lineEnd = (const char *)memchr(p, '\n', end - p);
+		if (!lineEnd) lineEnd = end;
+
+		if (p[0] == 'v' && isSpace(p[1])) {
+			p += 2;
+			float x = readFloat(p), y = readFloat(p), z = readFloat(p);
+			positions.push_back(glm::vec3(x, y, z));
+		}
+		else if (p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+			p += 3;
+			float u = readFloat(p), v = readFloat(p);
+			uvs.push_back(glm::vec2(u, v));
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+			p += 3;
+			float x = readFloat(p), y = readFloat(p), z = readFloat(p);
+			normals.push_back(glm::vec3(x, y, z));
+		}
+		else if (p[0] == 'f' && isSpace(p[1])) {
+			p++;
+			polygon.clear();
+			while (true) {
+				while (p < lineEnd && isSpace(*p)) p++;
+				if (p >= lineEnd) break;
+				char * next;
+				Corner corner = { resolveIndex(strtol(p, &next, 10), positions.size()), -1, -1 };
+				p = next;
+				if (*p == '/') {
+					p++;
+					if (*p != '/') {
+						corner.t = resolveIndex(strtol(p, &next, 10), uvs.size());
+						p = next;
+					}
+					if (*p == '/') {
+						p++;
+						corner.n = resolveIndex(strtol(p, &next, 10), normals.size());
+						p = next;
+					}
+				}
+				// Skip whatever is left of a malformed corner
+				while (p < lineEnd && !isSpace(*p)) p++;
+				if (corner.v < 0 || corner.v >= (int)positions.size()) continue;
+				if (corner.t >= (int)uvs.size()) corner.t = -1;
+				if (corner.n >= (int)normals.size()) corner.n = -1;
+
+				auto found = unique.find(corner);
+				if (found == unique.end()) {
+					found = unique.insert(std::make_pair(corner, (uint32_t)mesh.positions.size())).first;
+					mesh.positions.push_back(positions[corner.v]);
+					mesh.uvs.push_back(corner.t >= 0 ? uvs[corner.t] : glm::vec2(0.0f));
+					mesh.normals.push_back(corner.n >= 0 ? normals[corner.n] : glm::vec3(0.0f));
+					computedNormal.push_back(corner.n < 0);
+				}
+				polygon.push_back(found->second);
+			}
+			// Fan triangulation, fine for the convex polygons exporters write
+			for (size_t i = 2; i < polygon.size(); i++) {
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i - 1]);
+				mesh.indices.push_back(polygon[i]);
+			}
+		}
+		p = lineEnd + 1;
+	}
+
+	// Area weighted face normals for the corners that came without one
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		glm::vec3 face = glm::cross(mesh.positions[b] - mesh.positions[a], mesh.positions[c] - mesh.positions[a]);
+		uint32_t corners[3] = { a, b, c };
+		for (uint32_t corner : corners) {
+			if (computedNormal[corner]) mesh.normals[corner] = mesh.normals[corner] + face;
+		}
+	}
+	for (glm::vec3 & normal : mesh.normals) {
+		float length = glm::length(normal);
+		normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	if (mesh.indices.empty()) {
+		std::cerr << filename << " has no faces" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void buildMeshlets(ImportedMesh & mesh, std::vector<MeshletRange> & meshlets, int maxMeshletVertices, int maxMeshletTriangles)
+{
+	size_t triangleCount = mesh.indices.size() / 3;
+	size_t vertexCount = mesh.positions.size();
+
+	// The triangles around every vertex
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0), adjacency(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; i++) adjacencyStart[mesh.indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++) adjacencyStart[v + 1] += adjacencyStart[v];
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[mesh.indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<bool> emitted(triangleCount, false);
+	// The meshlet a vertex was last added to
+	std::vector<int> vertexMeshlet(vertexCount, -1);
+	std::vector<uint32_t> order, candidates;
+	order.reserve(triangleCount);
+	meshlets.clear();
+
+	// Greedy: start at the first triangle left, then keep adding the neighbouring
+	// triangle that brings the fewest new vertices until a limit is reached
+	size_t seed = 0;
+	while (true) {
+		while (seed < triangleCount && emitted[seed]) seed++;
+		if (seed == triangleCount) break;
+		int id = (int)meshlets.size();
+		int meshletVertices = 0, meshletTriangles = 0;
+		candidates.clear();
+		candidates.push_back((uint32_t)seed);
+		while (meshletTriangles < maxMeshletTriangles) {
+			int best = -1, bestNew = 4;
+			for (size_t c = 0; c < candidates.size(); c++) {
+				uint32_t triangle = candidates[c];
+				if (emitted[triangle]) {
+					candidates[c--] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				int added = 0;
+				for (int k = 0; k < 3; k++) {
+					if (vertexMeshlet[mesh.indices[triangle * 3 + k]] != id) added++;
+				}
+				if (added < bestNew) {
+					bestNew = added;
+					best = (int)triangle;
+				}
+			}
+			if (best < 0 || meshletVertices + bestNew > maxMeshletVertices) break;
+
+			emitted[best] = true;
+			order.push_back((uint32_t)best);
+			meshletTriangles++;
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = mesh.indices[best * 3 + k];
+				if (vertexMeshlet[v] == id) continue;
+				vertexMeshlet[v] = id;
+				meshletVertices++;
+				for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++) {
+					if (!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+				}
+			}
+		}
+		MeshletRange meshlet;
+		meshlet.firstIndex = (uint32_t)(order.size() - meshletTriangles) * 3;
+		meshlet.indexCount = (uint32_t)meshletTriangles * 3;
+		meshlet.firstVertex = meshlet.vertexCount = 0;
+		meshlets.push_back(meshlet);
+	}
+
+	// Number the vertices in the order the triangles use them. A meshlet's vertex range
+	// is the vertices it uses first, shared ones belong to an earlier meshlet.
+	std::vector<int> remap(vertexCount, -1);
+	ImportedMesh ordered;
+	ordered.indices.reserve(mesh.indices.size());
+	size_t triangle = 0;
+	for (MeshletRange & meshlet : meshlets) {
+		meshlet.firstVertex = (uint32_t)ordered.positions.size();
+		for (uint32_t t = 0; t < meshlet.indexCount / 3; t++, triangle++) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = mesh.indices[order[triangle] * 3 + k];
+				if (remap[v] < 0) {
+					remap[v] = (int)ordered.positions.size();
+					ordered.positions.push_back(mesh.positions[v]);
+					ordered.normals.push_back(mesh.normals[v]);
+					ordered.uvs.push_back(mesh.uvs[v]);
+				}
+				ordered.indices.push_back((uint32_t)remap[v]);
+			}
+		}
+		meshlet.vertexCount = (uint32_t)ordered.positions.size() - meshlet.firstVertex;
+	}
+	mesh = ordered;
+}
+
+float averageCacheMissRatio(const std::vector<uint32_t> & indices, int cacheSize)
+{
+	if (indices.size() < 3) return 0.0f;
+	std::vector<uint32_t> fifo(cacheSize, 0xffffffff);
+	int next = 0;
+	size_t misses = 0;
+	for (uint32_t index : indices) {
+		if (std::find(fifo.begin(), fifo.end(), index) != fifo.end()) continue;
+		fifo[next] = index;
+		next = (next + 1) % cacheSize;
+		misses++;
+	}
+	return (float)misses / (float)(indices.size() / 3);
+}
+
+void buildLods(ImportedMesh & mesh, std::vector<MeshLod> & lods, int maxLods, int firstGrid, float maxKept)
+{
+	lods.clear();
+	if (mesh.indices.empty()) return;
+	MeshLod full = { 0, (uint32_t)mesh.indices.size(), 0.0f, 0 };
+	lods.push_back(full);
+
+	// Only LOD 0's vertices are clustered, every LOD's error is against the import
+	size_t sourceVertices = mesh.positions.size();
+	size_t sourceIndices = mesh.indices.size();
+	glm::vec3 low = mesh.positions[0], high = mesh.positions[0];
+	for (size_t v = 0; v < sourceVertices; v++) {
+		low = glm::min(low, mesh.positions[v]);
+		high = glm::max(high, mesh.positions[v]);
+	}
+	glm::vec3 extent = high - low;
+	float longest = std::max(std::max(extent.x, extent.y), extent.z);
+	if (longest <= 0.0f) return;
+
+	std::unordered_map<Cell, uint32_t, CellHash> clusters;
+	std::vector<uint32_t> cluster(sourceVertices);
+	std::vector<glm::vec3> positionSum, normalSum;
+	std::vector<glm::vec2> uvSum;
+	std::vector<int> count;
+	std::vector<int> output;
+	for (int grid = firstGrid; grid >= 1 && (int)lods.size() < maxLods; grid /= 2) {
+		float cellSize = longest / grid;
+		clusters.clear();
+		positionSum.clear();
+		normalSum.clear();
+		uvSum.clear();
+		count.clear();
+		for (size_t v = 0; v < sourceVertices; v++) {
+			glm::vec3 p = (mesh.positions[v] - low) / cellSize;
+			Cell cell = { (int)std::floor(p.x), (int)std::floor(p.y), (int)std::floor(p.z) };
+			auto found = clusters.find(cell);
+			if (found == clusters.end()) {
+				found = clusters.insert(std::make_pair(cell, (uint32_t)count.size())).first;
+				positionSum.push_back(glm::vec3(0.0f));
+				normalSum.push_back(glm::vec3(0.0f));
+				uvSum.push_back(glm::vec2(0.0f));
+				count.push_back(0);
+			}
+			uint32_t c = found->second;
+			cluster[v] = c;
+			positionSum[c] = positionSum[c] + mesh.positions[v];
+			normalSum[c] = normalSum[c] + mesh.normals[v];
+			uvSum[c] = uvSum[c] + mesh.uvs[v];
+			count[c]++;
+		}
+
+		// Triangles whose corners all landed in different clusters survive
+		std::vector<uint32_t> triangles;
+		for (size_t i = 0; i < sourceIndices; i += 3) {
+			uint32_t a = cluster[mesh.indices[i]], b = cluster[mesh.indices[i + 1]], c = cluster[mesh.indices[i + 2]];
+			if (a == b || b == c || a == c) continue;
+			triangles.push_back(a);
+			triangles.push_back(b);
+			triangles.push_back(c);
+		}
+		if (triangles.empty()) break;
+		if (triangles.size() > lods.back().indexCount * maxKept) continue;
+
+		float error = lods.back().error;
+		for (size_t v = 0; v < sourceVertices; v++) {
+			glm::vec3 representative = positionSum[cluster[v]] / (float)count[cluster[v]];
+			error = std::max(error, glm::length(mesh.positions[v] - representative));
+		}
+
+		// The LOD's vertices in the order its triangles use them
+		MeshLod lod = { (uint32_t)mesh.indices.size(), (uint32_t)triangles.size(), error, 0 };
+		output.assign(count.size(), -1);
+		for (uint32_t c : triangles) {
+			if (output[c] < 0) {
+				output[c] = (int)mesh.positions.size();
+				float length = glm::length(normalSum[c]);
+				mesh.positions.push_back(positionSum[c] / (float)count[c]);
+				mesh.normals.push_back(length > 0.0f ? normalSum[c] / length : glm::vec3(0.0f, 1.0f, 0.0f));
+				mesh.uvs.push_back(uvSum[c] / (float)count[c]);
+			}
+			mesh.indices.push_back((uint32_t)output[c]);
+		}
+		lods.push_back(lod);
+	}
+}
+
+void cookMesh(const ImportedMesh & mesh, const std::vector<MeshletRange> & meshlets, const std::vector<MeshLod> & lods,
+	std::vector<unsigned char> & cooked)
+{
+	CookedMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cookedMagic, 4);
+	header.version = cookedVersion;
+	header.vertexCount = (uint32_t)mesh.positions.size();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.indexSize = header.vertexCount <= 65536 ? 2 : 4;
+	header.meshletCount = (uint32_t)meshlets.size();
+	header.lodCount = (uint32_t)lods.size();
+
+	glm::vec3 low(0.0f), high(0.0f);
+	if (!mesh.positions.empty()) low = high = mesh.positions[0];
+	for (const glm::vec3 & p : mesh.positions) {
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	for (int i = 0; i < 3; i++) {
+		header.boundsMin[i] = low[i];
+		header.boundsMax[i] = high[i];
+	}
+
+	header.vertexOffset = align16(sizeof(CookedMeshHeader));
+	header.indexOffset = align16(header.vertexOffset + header.vertexCount * sizeof(PackedVertex));
+	header.meshletOffset = align16(header.indexOffset + (size_t)header.indexCount * header.indexSize);
+	header.lodOffset = align16(header.meshletOffset + meshlets.size() * sizeof(MeshletRange));
+	cooked.assign(header.lodOffset + lods.size() * sizeof(MeshLod), 0);
+	memcpy(cooked.data(), &header, sizeof(header));
+
+	glm::vec3 extent = high - low;
+	PackedVertex * vertices = (PackedVertex *)(cooked.data() + header.vertexOffset);
+	for (size_t v = 0; v < mesh.positions.size(); v++) {
+		for (int i = 0; i < 3; i++) {
+			float t = extent[i] > 0.0f ? (mesh.positions[v][i] - low[i]) / extent[i] : 0.0f;
+			vertices[v].position[i] = (uint16_t)std::lround(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f);
+		}
+		vertices[v].position[3] = 65535;
+		octEncode(mesh.normals[v], vertices[v].normal);
+		vertices[v].uv[0] = floatToHalf(mesh.uvs[v].x);
+		vertices[v].uv[1] = floatToHalf(mesh.uvs[v].y);
+	}
+
+	unsigned char * indices = cooked.data() + header.indexOffset;
+	for (size_t i = 0; i < mesh.indices.size(); i++) {
+		if (header.indexSize == 2) ((uint16_t *)indices)[i] = (uint16_t)mesh.indices[i];
+		else ((uint32_t *)indices)[i] = mesh.indices[i];
+	}
+	if (!meshlets.empty()) {
+		memcpy(cooked.data() + header.meshletOffset, meshlets.data(), meshlets.size() * sizeof(MeshletRange));
+	}
+	if (!lods.empty()) {
+		memcpy(cooked.data() + header.lodOffset, lods.data(), lods.size() * sizeof(MeshLod));
+	}
+}
+
+void octEncode(const glm::vec3 & normal, int16_t out[2])
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1, fold the lower half over the upper
+	glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	for (int i = 0; i < 2; i++) {
+		out[i] = (int16_t)std::lround(std::min(std::max(e[i], -1.0f), 1.0f) * 32767.0f);
+	}
+}
+
+glm::vec3 octDecode(const int16_t in[2])
+{
+	glm::vec2 e(in[0] / 32767.0f, in[1] / 32767.0f);
+	glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+	if (n.z < 0.0f) {
+		n = glm::vec3((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f), n.z);
+	}
+	return glm::normalize(n);
+}
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponentBits = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (exponentBits == 0xff) {
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	int exponent = (int)exponentBits - 127 + 15;
+	if (exponent >= 31) {
+		return (uint16_t)(sign | 0x7c00);
+	}
+	if (exponent <= 0) {
+		// Denormal or zero
+		if (exponent < -10) return (uint16_t)sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) half++;
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	// Round to nearest even, a carry into the exponent is still correct
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+	return (uint16_t)half;
+}
+
+bool CookedMesh::open(const char * filename)
+{
+	if (!file.open(filename)) return false;
+	if (file.size() < sizeof(CookedMeshHeader)) {
+		file.close();
+		return false;
+	}
+	const CookedMeshHeader & h = header();
+	bool valid = memcmp(h.magic, cookedMagic, 4) == 0 && h.version == cookedVersion
+		&& (h.indexSize == 2 || h.indexSize == 4)
+		&& h.vertexOffset + (uint64_t)h.vertexCount * sizeof(PackedVertex) <= file.size()
+		&& h.indexOffset + (uint64_t)h.indexCount * h.indexSize <= file.size()
+		&& h.meshletOffset + (uint64_t)h.meshletCount * sizeof(MeshletRange) <= file.size()
+		&& h.lodCount > 0 && h.lodOffset + (uint64_t)h.lodCount * sizeof(MeshLod) <= file.size();
+	if (!valid) {
+		file.close();
+	}
+	return valid;
+}
+
+std::string cookedMeshPath(const std::string & sourcePath)
+{
+	return sourcePath + ".cmesh";
+}
+
+bool loadCachedMesh(const std::string & path, CookedMesh & mesh)
+{
+	const std::string extension = ".cmesh";
+	if (path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+		if (mesh.open(path.c_str())) return true;
+		std::cerr << path << " is not a cooked mesh" << std::endl;
+		return false;
+	}
+
+	std::string cookedPath = cookedMeshPath(path);
+	long long cookedTime = fileTime(cookedPath.c_str());
+	if (cookedTime && cookedTime >= fileTime(path.c_str()) && mesh.open(cookedPath.c_str())) {
+		return true;
+	}
+
+	ImportedMesh imported;
+	if (!importObj(path.c_str(), imported)) {
+		return false;
+	}
+	std::vector<MeshletRange> meshlets;
+	buildMeshlets(imported, meshlets);
+	size_t importedTriangles = imported.indices.size() / 3;
+	std::vector<MeshLod> lods;
+	buildLods(imported, lods);
+	std::vector<unsigned char> cooked;
+	cookMesh(imported, meshlets, lods, cooked);
+	if (!writeBinaryFile(cookedPath, cooked.data(), cooked.size())) {
+		return false;
+	}
+	std::cout << "cooked " << path << ": " << imported.positions.size() << " vertices, "
+		<< importedTriangles << " triangles, " << meshlets.size() << " meshlets, LOD triangles";
+	for (const MeshLod & lod : lods) {
+		std::cout << " " << lod.indexCount / 3;
+	}
+	std::cout << std::endl;
+	return mesh.open(cookedPath.c_str());
+}
@@ -0,0 +1,123 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FileIO.h"
+
+// Imported models are cooked once into a binary file next to the source, which is
+// then mapped and handed to GL as is: no parsing and no per vertex work at load time.
+//
+// Cooked layout, every section 16 byte aligned:
+//   CookedMeshHeader
+//   PackedVertex[vertexCount]
+//   uint16_t or uint32_t[indexCount], 16 bit whenever the vertices fit
+//   MeshletRange[meshletCount]
+//   MeshLod[lodCount]
+// Triangles are grouped into meshlets of neighbouring triangles sharing at most
+// maxMeshletVertices vertices, and vertices are numbered in the order the meshlets
+// first use them, so consecutive triangles hit the post-transform cache and fetch
+// nearby vertex memory.
+//
+// LOD 0 is the imported mesh, the meshlets cover it. The coarser LODs follow it in
+// the index buffer, with their own vertices after LOD 0's in the vertex buffer.
+
+// 16 bytes, against 32 for float positions, normals and uvs
+struct PackedVertex {
+	// Unsigned normalized inside the mesh bounds, w is unused
+	uint16_t position[4];
+	// Octahedral, signed normalized
+	int16_t normal[2];
+	// Half floats, uvs may tile outside [0, 1]
+	uint16_t uv[2];
+};
+
+struct MeshletRange {
+	uint32_t firstIndex, indexCount;
+	uint32_t firstVertex, vertexCount;
+};
+
+// A level of detail: its range of the index buffer and how far, in model units, any
+// vertex of the imported mesh moved to reach it
+struct MeshLod {
+	uint32_t firstIndex, indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+struct CookedMeshHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount, indexCount;
+	// 2 or 4 bytes
+	uint32_t indexSize;
+	uint32_t meshletCount, lodCount;
+	float boundsMin[3], boundsMax[3];
+	uint64_t vertexOffset, indexOffset, meshletOffset, lodOffset;
+};
+
+// An imported model, one entry per unique position/uv/normal combination
+struct ImportedMesh {
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint32_t> indices;
+};
+
+// Triangulates polygons, missing normals are smoothed from the faces, missing uvs are 0.
+// Returns false if the file can't be read or holds no triangles.
+bool importObj(const char * filename, ImportedMesh & mesh);
+
+// Reorders mesh's triangles and vertices into meshlets
+void buildMeshlets(ImportedMesh & mesh, std::vector<MeshletRange> & meshlets,
+	int maxMeshletVertices = 64, int maxMeshletTriangles = 124);
+
+// Average cache miss ratio: vertex shader runs per triangle drawing indices through a
+// post-transform cache of cacheSize entries replaced first in, first out. 3 without reuse,
+// about 0.5 at best for a regular grid.
+float averageCacheMissRatio(const std::vector<uint32_t> & indices, int cacheSize = 32);
+
+// Appends coarser versions of mesh's triangles to it by vertex clustering on ever
+// coarser grids, starting at firstGrid cells along the longest side. A grid is
+// skipped when it keeps more than maxKept of the last LOD's triangles.
+void buildLods(ImportedMesh & mesh, std::vector<MeshLod> & lods, int maxLods = 6, int firstGrid = 64, float maxKept = 0.7f);
+
+void cookMesh(const ImportedMesh & mesh, const std::vector<MeshletRange> & meshlets, const std::vector<MeshLod> & lods,
+	std::vector<unsigned char> & cooked);
+
+// Octahedral normal encoding, normal must be unit length
+void octEncode(const glm::vec3 & normal, int16_t out[2]);
+glm::vec3 octDecode(const int16_t in[2]);
+uint16_t floatToHalf(float value);
+
+// A cooked mesh mapped from disk
+class CookedMesh
+{
+public:
+	// Maps a cooked file, false if it is missing or not a cooked mesh of this version
+	bool open(const char * filename);
+
+	const CookedMeshHeader & header() const { return *(const CookedMeshHeader *)file.data(); }
+	const PackedVertex * vertices() const { return (const PackedVertex *)(file.data() + header().vertexOffset); }
+	const void * indices() const { return file.data() + header().indexOffset; }
+	const MeshletRange * meshlets() const { return (const MeshletRange *)(file.data() + header().meshletOffset); }
+	const MeshLod * lods() const { return (const MeshLod *)(file.data() + header().lodOffset); }
+	size_t size() const { return file.size(); }
+
+private:
+	MappedFile file;
+};
+
+// The cooked file of a source model
+std::string cookedMeshPath(const std::string & sourcePath);
+
+// Maps the cooked version of an OBJ, cooking it first if it is missing or older than
+// the source. A path to a cooked file is mapped directly.
+bool loadCachedMesh(const std::string & path, CookedMesh & mesh);
+
+#endif
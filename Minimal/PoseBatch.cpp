@@ -0,0 +1,79 @@
+#include "PoseBatch.h"
+#include <xmmintrin.h>
+
+namespace {
+
+	void poseToMatrix(const ovrPosef & pose, glm::mat4 & m)
+	{
+		float x = pose.Orientation.x, y = pose.Orientation.y, z = pose.Orientation.z, w = pose.Orientation.w;
+		m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f);
+		m[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f);
+		m[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f);
+		m[3] = glm::vec4(pose.Position.x, pose.Position.y, pose.Position.z, 1.0f);
+	}
+
+	// Rows r0..r3 hold one column of four matrices, one matrix per lane
+	inline void storeColumn(__m128 r0, __m128 r1, __m128 r2, __m128 r3, glm::mat4 * out, int column)
+	{
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(&out[0][column][0], r0);
+		_mm_storeu_ps(&out[1][column][0], r1);
+		_mm_storeu_ps(&out[2][column][0], r2);
+		_mm_storeu_ps(&out[3][column][0], r3);
+	}
+
+}
+
+namespace ovr {
+
+	void toGlm(const ovrPosef * poses, int count, glm::mat4 * out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 zero = _mm_setzero_ps();
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const ovrPosef * p = poses + i;
+			// ovrQuatf is x, y, z, w: four loads and a transpose give one component per register
+			__m128 x = _mm_loadu_ps(&p[0].Orientation.x);
+			__m128 y = _mm_loadu_ps(&p[1].Orientation.x);
+			__m128 z = _mm_loadu_ps(&p[2].Orientation.x);
+			__m128 w = _mm_loadu_ps(&p[3].Orientation.x);
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			__m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+			__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+			__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+			__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+			storeColumn(_mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy), zero, out + i, 0);
+			storeColumn(_mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx), zero, out + i, 1);
+			storeColumn(_mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), zero, out + i, 2);
+			// A 16 byte load of Position would read past the last pose, gather the lanes instead
+			storeColumn(_mm_set_ps(p[3].Position.x, p[2].Position.x, p[1].Position.x, p[0].Position.x),
+				_mm_set_ps(p[3].Position.y, p[2].Position.y, p[1].Position.y, p[0].Position.y),
+				_mm_set_ps(p[3].Position.z, p[2].Position.z, p[1].Position.z, p[0].Position.z),
+				one, out + i, 3);
+		}
+		for (; i < count; i++) {
+			poseToMatrix(poses[i], out[i]);
+		}
+	}
+
+	void toGlm(const ovrMatrix4f * matrices, int count, glm::mat4 * out)
+	{
+		for (int i = 0; i < count; i++) {
+			// ovrMatrix4f is row major, a transpose turns its rows into GLM's columns
+			__m128 r0 = _mm_loadu_ps(matrices[i].M[0]);
+			__m128 r1 = _mm_loadu_ps(matrices[i].M[1]);
+			__m128 r2 = _mm_loadu_ps(matrices[i].M[2]);
+			__m128 r3 = _mm_loadu_ps(matrices[i].M[3]);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(&out[i][0][0], r0);
+			_mm_storeu_ps(&out[i][1][0], r1);
+			_mm_storeu_ps(&out[i][2][0], r2);
+			_mm_storeu_ps(&out[i][3][0], r3);
+		}
+	}
+
+}
@@ -0,0 +1,22 @@
+#ifndef _POSE_BATCH_H_
+#define _POSE_BATCH_H_
+
+#include "OvrGlm.h"
+
+// Batched versions of the ovr::toGlm conversions for everything tracked in a frame
+// (eyes, hands, head). Four poses at a time go through an SSE quaternion to
+// rotation kernel that writes the columns directly, instead of building a rotation
+// and a translation mat4 and multiplying them. The output is column major with 16
+// floats per matrix, the layout glUniformMatrix4fv and std140 uniform blocks use,
+// so it can be uploaded as is.
+namespace ovr {
+
+	// out[i] = toGlm(poses[i])
+	void toGlm(const ovrPosef * poses, int count, glm::mat4 * out);
+
+	// out[i] = toGlm(matrices[i])
+	void toGlm(const ovrMatrix4f * matrices, int count, glm::mat4 * out);
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "PosePredictor.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+	glm::vec3 clampLength(const glm::vec3 & v, float maxLength)
+	{
+		float length = glm::length(v);
+		return length > maxLength ? v * (maxLength / length) : v;
+	}
+
+	double percentile(std::vector<double> values, double p)
+	{
+		if (values.empty()) return 0.0;
+		size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+		std::nth_element(values.begin(), values.begin() + index, values.end());
+		return values[index];
+	}
+
+	ovrPosef interpolate(const ovrPoseStatef & a, const ovrPoseStatef & b, double seconds)
+	{
+		float t = b.TimeInSeconds > a.TimeInSeconds ? (float)((seconds - a.TimeInSeconds) / (b.TimeInSeconds - a.TimeInSeconds)) : 0.0f;
+		ovrPosef pose;
+		pose.Position = ovr::fromGlm(glm::mix(ovr::toGlm(a.ThePose.Position), ovr::toGlm(b.ThePose.Position), t));
+		pose.Orientation = ovr::fromGlm(glm::slerp(ovr::toGlm(a.ThePose.Orientation), ovr::toGlm(b.ThePose.Orientation), t));
+		return pose;
+	}
+
+}
+
+void PosePredictor::update(const ovrPoseStatef & state)
+{
+	if (hasSample && state.TimeInSeconds == last.TimeInSeconds) {
+		return;
+	}
+	glm::vec3 v = clampLength(ovr::toGlm(state.LinearVelocity), maxLinearSpeed);
+	glm::vec3 w = clampLength(ovr::toGlm(state.AngularVelocity), maxAngularSpeed);
+	glm::vec3 a = clampLength(ovr::toGlm(state.LinearAcceleration), maxLinearAcceleration);
+	if (hasSample) {
+		velocity = glm::mix(v, velocity, smoothing);
+		angularVelocity = glm::mix(w, angularVelocity, smoothing);
+		acceleration = glm::mix(a, acceleration, smoothing);
+	}
+	else {
+		velocity = v;
+		angularVelocity = w;
+		acceleration = a;
+	}
+	last = state;
+	hasSample = true;
+}
+
+ovrPosef PosePredictor::predict(double seconds) const
+{
+	if (!hasSample) {
+		ovrPosef identity;
+		identity.Position = ovr::fromGlm(glm::vec3(0.0f));
+		identity.Orientation = ovr::fromGlm(glm::quat());
+		return identity;
+	}
+	if (!enabled) {
+		return last.ThePose;
+	}
+	float dt = (float)std::min(std::max(seconds - last.TimeInSeconds, 0.0), maxPredictionSeconds);
+
+	ovrPosef pose;
+	glm::vec3 position = ovr::toGlm(last.ThePose.Position) + velocity * dt + 0.5f * accelerationWeight * acceleration * dt * dt;
+	pose.Position = ovr::fromGlm(position);
+
+	// The angular velocity is in world space, so the rotation it adds goes on the left
+	glm::quat orientation = ovr::toGlm(last.ThePose.Orientation);
+	float speed = glm::length(angularVelocity);
+	if (speed > 1e-6f) {
+		orientation = glm::angleAxis(speed * dt, angularVelocity / speed) * orientation;
+	}
+	pose.Orientation = ovr::fromGlm(glm::normalize(orientation));
+	return pose;
+}
+
+PredictionError PosePredictor::evaluate(const std::vector<ovrPoseStatef> & trace, double latency) const
+{
+	PosePredictor replay = *this;
+	replay.reset();
+	std::vector<double> positionErrors, angleErrors;
+	size_t next = 0;
+	for (size_t i = 0; i < trace.size(); i++) {
+		replay.update(trace[i]);
+		double target = trace[i].TimeInSeconds + latency;
+		while (next + 1 < trace.size() && trace[next + 1].TimeInSeconds < target) next++;
+		if (next + 1 >= trace.size()) break;
+
+		ovrPosef actual = interpolate(trace[next], trace[next + 1], target);
+		ovrPosef predicted = replay.predict(target);
+		positionErrors.push_back(glm::length(ovr::toGlm(actual.Position) - ovr::toGlm(predicted.Position)));
+		float d = std::min(1.0f, std::abs(glm::dot(ovr::toGlm(actual.Orientation), ovr::toGlm(predicted.Orientation))));
+		angleErrors.push_back(2.0 * std::acos(d));
+	}
+
+	PredictionError error;
+	error.samples = (int)positionErrors.size();
+	for (size_t i = 0; i < positionErrors.size(); i++) {
+		error.meanPosition += positionErrors[i] / positionErrors.size();
+		error.meanAngle += angleErrors[i] / angleErrors.size();
+		error.maxPosition = std::max(error.maxPosition, positionErrors[i]);
+		error.maxAngle = std::max(error.maxAngle, angleErrors[i]);
+	}
+	error.p95Position = percentile(positionErrors, 0.95);
+	error.p95Angle = percentile(angleErrors, 0.95);
+	return error;
+}
+
+bool savePoseTrace(const std::string & path, const std::vector<ovrPoseStatef> & trace)
+{
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "could not write pose trace " << path << std::endl;
+		return false;
+	}
+	file.precision(9);
+	file << "# t px py pz qx qy qz qw wx wy wz vx vy vz awx awy awz ax ay az" << std::endl;
+	for (const ovrPoseStatef & s : trace) {
+		const ovrVector3f & p = s.ThePose.Position;
+		const ovrQuatf & q = s.ThePose.Orientation;
+		file << s.TimeInSeconds << " " << p.x << " " << p.y << " " << p.z << " "
+			<< q.x << " " << q.y << " " << q.z << " " << q.w << " "
+			<< s.AngularVelocity.x << " " << s.AngularVelocity.y << " " << s.AngularVelocity.z << " "
+			<< s.LinearVelocity.x << " " << s.LinearVelocity.y << " " << s.LinearVelocity.z << " "
+			<< s.AngularAcceleration.x << " " << s.AngularAcceleration.y << " " << s.AngularAcceleration.z << " "
+			<< s.LinearAcceleration.x << " " << s.LinearAcceleration.y << " " << s.LinearAcceleration.z << std::endl;
+	}
+	return true;
+}
+
+bool loadPoseTrace(const std::string & path, std::vector<ovrPoseStatef> & trace)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "could not open pose trace " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		ovrPoseStatef s;
+		memset(&s, 0, sizeof(s));
+		ovrVector3f & p = s.ThePose.Position;
+		ovrQuatf & q = s.ThePose.Orientation;
+		if (fields >> s.TimeInSeconds >> p.x >> p.y >> p.z >> q.x >> q.y >> q.z >> q.w
+			>> s.AngularVelocity.x >> s.AngularVelocity.y >> s.AngularVelocity.z
+			>> s.LinearVelocity.x >> s.LinearVelocity.y >> s.LinearVelocity.z
+			>> s.AngularAcceleration.x >> s.AngularAcceleration.y >> s.AngularAcceleration.z
+			>> s.LinearAcceleration.x >> s.LinearAcceleration.y >> s.LinearAcceleration.z) {
+			trace.push_back(s);
+		}
+	}
+	return !trace.empty();
+}
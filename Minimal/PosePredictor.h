@@ -0,0 +1,55 @@
+#ifndef _POSE_PREDICTOR_H_
+#define _POSE_PREDICTOR_H_
+
+#include <string>
+#include <vector>
+#include "OvrGlm.h"
+
+// How far predicted poses were off from the poses actually reached
+struct PredictionError
+{
+	int samples = 0;
+	double meanPosition = 0.0, p95Position = 0.0, maxPosition = 0.0; // meters
+	double meanAngle = 0.0, p95Angle = 0.0, maxAngle = 0.0;          // radians
+};
+
+// Extrapolates a tracked pose (the right hand when it stands in for the CAVE
+// viewer) from the time it was sampled to the time the frame is displayed, using
+// the velocities and accelerations the SDK reports with every sample. The
+// derivatives are noisy, so they go through an exponential filter and are
+// clamped, and the extrapolation never reaches further than maxPredictionSeconds.
+class PosePredictor
+{
+public:
+	bool enabled = true;
+	double maxPredictionSeconds = 0.05;
+	// 0 extrapolates with constant velocity, 1 with the full acceleration
+	float accelerationWeight = 0.5f;
+	// Weight of the previous filtered value, 0 uses the raw derivatives
+	float smoothing = 0.5f;
+	float maxLinearSpeed = 5.0f, maxAngularSpeed = 12.0f, maxLinearAcceleration = 50.0f;
+
+	void reset() { hasSample = false; }
+
+	// Feed the latest sample; repeated samples with the same time are ignored
+	void update(const ovrPoseStatef & state);
+
+	// The pose at an absolute time on the ovr_GetTimeInSeconds clock
+	ovrPosef predict(double seconds) const;
+
+	// Replays a trace: every sample is predicted latency seconds ahead and
+	// compared with the trace interpolated at that time
+	PredictionError evaluate(const std::vector<ovrPoseStatef> & trace, double latency) const;
+
+private:
+	ovrPoseStatef last;
+	glm::vec3 velocity, angularVelocity, acceleration;
+	bool hasSample = false;
+};
+
+// One sample per line: time, position, orientation (x y z w), angular velocity,
+// linear velocity, angular acceleration, linear acceleration
+bool savePoseTrace(const std::string & path, const std::vector<ovrPoseStatef> & trace);
+bool loadPoseTrace(const std::string & path, std::vector<ovrPoseStatef> & trace);
+
+#endif
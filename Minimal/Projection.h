@@ -0,0 +1,37 @@
+#ifndef _PROJECTION_H_
+#define _PROJECTION_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+// Off-axis projection of a planar screen seen from eyePos (Kooima, "Generalized
+// Perspective Projection"). pa, pb and pc are the screen's lower left, lower right
+// and upper left corners in world space; n and f the near and far planes.
+inline glm::mat4 offAxisProjection(glm::vec3 eyePos, glm::vec3 pa, glm::vec3 pb, glm::vec3 pc, float n, float f) {
+	glm::vec3 vr = glm::normalize(pb - pa);
+	glm::vec3 vu = glm::normalize(pc - pa);
+	glm::vec3 vn = glm::normalize(glm::cross(vr, vu));
+	glm::vec3 va = pa - eyePos;
+	glm::vec3 vb = pb - eyePos;
+	glm::vec3 vc = pc - eyePos;
+	float d = -glm::dot(vn, va);
+	float l = glm::dot(vr, va) * n / d;
+	float r = glm::dot(vr, vb) * n / d;
+	float b = glm::dot(vu, va) * n / d;
+	float t = glm::dot(vu, vc) * n / d;
+
+	glm::mat4 P = glm::frustum(l, r, b, t, n, f);
+	glm::mat4 M = glm::mat4(vr.x, vr.y, vr.z, 0.0f,
+							vu.x, vu.y, vu.z, 0.0f,
+							vn.x, vn.y, vn.z, 0.0f,
+							0.0f, 0.0f, 0.0f, 1.0f);
+	glm::mat4 T = glm::translate(glm::vec3(-eyePos.x, -eyePos.y, -eyePos.z));
+	return P*glm::transpose(M)*T;
+}
+
+#endif
@@ -0,0 +1,427 @@
+#include "ProjectorOutput.h"
+#include "FileIO.h"
+#include "RenderStats.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#endif
+
+ProjectorCalibration ProjectorCalibration::identity(int wall, int eye, int width, int height)
+{
+	ProjectorCalibration calibration;
+	calibration.wall = wall;
+	calibration.eye = eye;
+	calibration.width = width;
+	calibration.height = height;
+	calibration.columns = calibration.rows = 2;
+	calibration.mesh = { glm::vec4(0, 0, 0, 0), glm::vec4(1, 0, 1, 0), glm::vec4(0, 1, 0, 1), glm::vec4(1, 1, 1, 1) };
+	return calibration;
+}
+
+bool loadProjectorSetup(const std::string & path, std::vector<ProjectorCalibration> & projectors)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "could not open projector setup " << path << std::endl;
+		return false;
+	}
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		std::string keyword;
+		if (!(fields >> keyword)) continue;
+		if (keyword == "projector") {
+			projectors.push_back(ProjectorCalibration());
+			continue;
+		}
+		if (projectors.empty()) {
+			std::cerr << path << ":" << lineNumber << ": " << keyword << " before the first projector" << std::endl;
+			return false;
+		}
+		ProjectorCalibration & projector = projectors.back();
+		bool valid = true;
+		if (keyword == "wall") valid = (fields >> projector.wall) && projector.wall >= 0 && projector.wall < 3;
+		else if (keyword == "eye") valid = (fields >> projector.eye) && projector.eye >= 0 && projector.eye < 2;
+		else if (keyword == "monitor") valid = (fields >> projector.monitor) && projector.monitor >= 0;
+		else if (keyword == "size") valid = (bool)(fields >> projector.width >> projector.height);
+		else if (keyword == "gamma") valid = (fields >> projector.gamma) && projector.gamma > 0.0f;
+		else if (keyword == "blend") {
+			std::string blend;
+			valid = (bool)(fields >> blend);
+			projector.blendPath = directory + blend;
+		}
+		else if (keyword == "mesh") {
+			valid = (fields >> projector.columns >> projector.rows) && projector.columns >= 2 && projector.rows >= 2;
+			projector.mesh.clear();
+			while (valid && (int)projector.mesh.size() < projector.columns * projector.rows && std::getline(file, line)) {
+				lineNumber++;
+				if (line.empty() || line[0] == '#') continue;
+				std::istringstream vertex(line);
+				glm::vec4 v;
+				valid = (bool)(vertex >> v.x >> v.y >> v.z >> v.w);
+				projector.mesh.push_back(v);
+			}
+			valid = valid && (int)projector.mesh.size() == projector.columns * projector.rows;
+		}
+		else {
+			std::cerr << path << ":" << lineNumber << ": unknown keyword " << keyword << std::endl;
+			return false;
+		}
+		if (!valid) {
+			std::cerr << path << ":" << lineNumber << ": malformed " << keyword << std::endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < projectors.size(); i++) {
+		if (projectors[i].mesh.empty()) {
+			std::cerr << path << ": projector " << i << " has no mesh" << std::endl;
+			return false;
+		}
+	}
+	return !projectors.empty();
+}
+
+ProjectorOutput::ProjectorOutput(GLuint program) : program(program)
+{
+}
+
+ProjectorOutput::~ProjectorOutput()
+{
+	close();
+}
+
+bool ProjectorOutput::open(const std::vector<ProjectorCalibration> & projectors, GLFWwindow * share, bool visible)
+{
+	close();
+	this->share = share;
+	int monitorCount = 0;
+	GLFWmonitor ** monitors = glfwGetMonitors(&monitorCount);
+	for (const ProjectorCalibration & calibration : projectors) {
+		Window target;
+		target.calibration = calibration;
+		GLFWmonitor * monitor = nullptr;
+		if (calibration.monitor < monitorCount) {
+			monitor = monitors[calibration.monitor];
+		}
+		else if (visible) {
+			std::cerr << "no monitor " << calibration.monitor << ", the projector of wall " << calibration.wall
+				<< " opens on the primary one" << std::endl;
+			monitor = glfwGetPrimaryMonitor();
+		}
+		const GLFWvidmode * mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+		target.width = calibration.width ? calibration.width : (mode ? mode->width : 1920);
+		target.height = calibration.height ? calibration.height : (mode ? mode->height : 1080);
+
+		glfwWindowHint(GLFW_DECORATED, GL_FALSE);
+		glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
+		target.window = glfwCreateWindow(target.width, target.height, "projector", nullptr, share);
+		glfwWindowHint(GLFW_DECORATED, GL_TRUE);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+		if (!target.window) {
+			std::cerr << "could not open the window of the projector of wall " << calibration.wall << std::endl;
+			close();
+			return false;
+		}
+		if (monitor && visible) {
+			int x, y;
+			glfwGetMonitorPos(monitor, &x, &y);
+			glfwSetWindowPos(target.window, x, y);
+		}
+		glfwMakeContextCurrent(target.window);
+		upload(target);
+		windows.push_back(target);
+	}
+
+	// Every window flips on the same vertical blank, or they all swap without waiting.
+	// Either way the swaps only hold up the projectors' thread.
+	bool swapGroup = false;
+#ifdef _WIN32
+	swapGroup = WGLEW_NV_swap_group != 0;
+#endif
+	for (Window & target : windows) {
+		glfwMakeContextCurrent(target.window);
+		glfwSwapInterval(swapGroup ? 1 : 0);
+#ifdef _WIN32
+		if (swapGroup) {
+			swapGroup = wglJoinSwapGroupNV(wglGetCurrentDC(), 1) != FALSE;
+		}
+#endif
+	}
+#ifdef _WIN32
+	if (swapGroup && !windows.empty()) {
+		wglBindSwapBarrierNV(1, 1);
+	}
+#endif
+	if (!swapGroup && visible) {
+		std::cerr << "no swap group, the projectors swap without vertical sync and out of step with each other" << std::endl;
+	}
+	glfwMakeContextCurrent(share);
+	if (visible && !windows.empty()) {
+		stopping = false;
+		presenter = std::thread(&ProjectorOutput::presentLoop, this);
+	}
+	return true;
+}
+
+void ProjectorOutput::close()
+{
+	if (presenter.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(presentLock);
+			stopping = true;
+		}
+		presentWake.notify_all();
+		presenter.join();
+		std::cout << "projectors showed " << presented.load() << " of " << submitted << " frames, " << skipped
+			<< " skipped while drawing the last" << std::endl;
+	}
+	if (share) glfwMakeContextCurrent(share);
+	if (copied) glDeleteSync(copied);
+	copied = 0;
+	for (GLsync fence : drawn) {
+		glDeleteSync(fence);
+	}
+	drawn.clear();
+	pending = drawing = false;
+	glDeleteFramebuffers(2, copyFbos);
+	glDeleteTextures(1, &copyArray);
+	copyFbos[0] = copyFbos[1] = copyArray = 0;
+	copySize = 0;
+
+	for (Window & target : windows) {
+		glfwMakeContextCurrent(target.window);
+		glDeleteVertexArrays(1, &target.VAO);
+		glDeleteBuffers(1, &target.VBO);
+		glDeleteBuffers(1, &target.EBO);
+		glDeleteTextures(1, &target.blend);
+		glDeleteFramebuffers(1, &target.offscreenFbo);
+		glDeleteTextures(1, &target.offscreenTexture);
+		glfwMakeContextCurrent(nullptr);
+		glfwDestroyWindow(target.window);
+	}
+	windows.clear();
+	if (share) glfwMakeContextCurrent(share);
+}
+
+void ProjectorOutput::present(GLuint wallArray, const int firstLayer[2])
+{
+	if (!presenter.joinable()) return;
+	std::vector<GLsync> reads;
+	{
+		std::lock_guard<std::mutex> guard(presentLock);
+		submitted++;
+		if (drawing) {
+			skipped++;
+			return;
+		}
+		// Not taken by the thread while it is overwritten
+		pending = false;
+		reads.swap(drawn);
+	}
+	for (GLsync fence : reads) {
+		glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+	}
+	copyWalls(wallArray, firstLayer);
+	GLsync fence = wallsDone();
+	{
+		std::lock_guard<std::mutex> guard(presentLock);
+		if (copied) glDeleteSync(copied);
+		copied = fence;
+		pending = true;
+	}
+	presentWake.notify_one();
+}
+
+void ProjectorOutput::copyWalls(GLuint wallArray, const int firstLayer[2])
+{
+	GLint size = 0;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, wallArray);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_WIDTH, &size);
+	if (size != copySize) {
+		if (!copyArray) {
+			glGenTextures(1, &copyArray);
+			glGenFramebuffers(2, copyFbos);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, copyArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, size, size, 6, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		copySize = size;
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Only the walls some projector shows
+	bool copiedLayer[6] = { false };
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFbos[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFbos[1]);
+	RenderStats::framebuffer(copyFbos[1]);
+	for (const Window & target : windows) {
+		int eye = target.calibration.eye, wall = target.calibration.wall;
+		if (copiedLayer[eye * 3 + wall]) continue;
+		copiedLayer[eye * 3 + wall] = true;
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, wallArray, 0, firstLayer[eye] + wall);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, copyArray, 0, eye * 3 + wall);
+		glBlitFramebuffer(0, 0, copySize, copySize, 0, 0, copySize, copySize, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ProjectorOutput::presentLoop()
+{
+	const int copyLayers[2] = { 0, 3 };
+	std::vector<GLsync> reads;
+	for (;;) {
+		GLsync fence;
+		{
+			std::unique_lock<std::mutex> guard(presentLock);
+			presentWake.wait(guard, [this] { return stopping || pending; });
+			if (stopping) break;
+			fence = copied;
+			copied = 0;
+			pending = false;
+			drawing = true;
+		}
+		for (Window & target : windows) {
+			glfwMakeContextCurrent(target.window);
+			glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, target.width, target.height);
+			draw(target, copyArray, copyLayers);
+			reads.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+			// The next copy waits for these in share's context
+			glFlush();
+		}
+		glDeleteSync(fence);
+		{
+			std::lock_guard<std::mutex> guard(presentLock);
+			drawn.insert(drawn.end(), reads.begin(), reads.end());
+			drawing = false;
+		}
+		reads.clear();
+		for (Window & target : windows) {
+			glfwSwapBuffers(target.window);
+		}
+		presented++;
+	}
+	glfwMakeContextCurrent(nullptr);
+}
+
+void ProjectorOutput::renderOffscreen(int projector, GLuint wallArray, const int firstLayer[2], std::vector<unsigned char> & pixels)
+{
+	GLsync fence = wallsDone();
+	Window & target = windows[projector];
+	glfwMakeContextCurrent(target.window);
+	glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+	if (!target.offscreenFbo) {
+		glGenTextures(1, &target.offscreenTexture);
+		glBindTexture(GL_TEXTURE_2D, target.offscreenTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, target.width, target.height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenFramebuffers(1, &target.offscreenFbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, target.offscreenFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.offscreenTexture, 0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, target.offscreenFbo);
+	glViewport(0, 0, target.width, target.height);
+	draw(target, wallArray, firstLayer);
+	pixels.resize((size_t)target.width * target.height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, target.width, target.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glfwMakeContextCurrent(share);
+	glDeleteSync(fence);
+}
+
+void ProjectorOutput::upload(Window & target)
+{
+	const ProjectorCalibration & calibration = target.calibration;
+	std::vector<GLuint> indices;
+	for (int row = 0; row + 1 < calibration.rows; row++) {
+		for (int column = 0; column + 1 < calibration.columns; column++) {
+			GLuint corner = row * calibration.columns + column, above = corner + calibration.columns;
+			indices.insert(indices.end(), { corner, corner + 1, above + 1, corner, above + 1, above });
+		}
+	}
+	target.indexCount = (int)indices.size();
+
+	glGenVertexArrays(1, &target.VAO);
+	glGenBuffers(1, &target.VBO);
+	glGenBuffers(1, &target.EBO);
+	glBindVertexArray(target.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, target.VBO);
+	glBufferData(GL_ARRAY_BUFFER, calibration.mesh.size() * sizeof(glm::vec4), calibration.mesh.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)(2 * sizeof(GLfloat)));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, target.EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Without a mask a single white texel, so there is only one shader
+	int width = 1, height = 1;
+	unsigned char white[3] = { 255, 255, 255 };
+	unsigned char * mask = nullptr;
+	if (!calibration.blendPath.empty()) {
+		mask = loadPPM(calibration.blendPath.c_str(), width, height);
+	}
+	if (!mask) {
+		width = height = 1;
+	}
+	glGenTextures(1, &target.blend);
+	glBindTexture(GL_TEXTURE_2D, target.blend);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, mask ? mask : white);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	RenderStats::upload((long long)width * height * 3);
+	delete[] mask;
+}
+
+void ProjectorOutput::draw(const Window & target, GLuint wallArray, const int firstLayer[2])
+{
+	const ProjectorCalibration & calibration = target.calibration;
+	glDisable(GL_DEPTH_TEST);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glUseProgram(program);
+	RenderStats::program(program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, wallArray);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, target.blend);
+	RenderStats::texture(2);
+	glUniform1i(glGetUniformLocation(program, "walls"), 0);
+	glUniform1i(glGetUniformLocation(program, "blend"), 1);
+	glUniform1i(glGetUniformLocation(program, "layer"), firstLayer[calibration.eye] + calibration.wall);
+	glUniform1f(glGetUniformLocation(program, "gamma"), calibration.gamma);
+	glBindVertexArray(target.VAO);
+	glDrawElements(GL_TRIANGLES, target.indexCount, GL_UNSIGNED_INT, 0);
+	RenderStats::draw();
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLsync ProjectorOutput::wallsDone()
+{
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// The other contexts can only wait for a fence that has reached the GPU
+	glFlush();
+	return fence;
+}
@@ -0,0 +1,128 @@
+#ifndef _PROJECTOR_OUTPUT_H_
+#define _PROJECTOR_OUTPUT_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One projector: the wall of an eye it shows, the monitor it is connected to and its
+// calibration. The warp mesh maps the projector's image, x and y from 0 to 1 starting
+// at the bottom left, to wall texture coordinates. The blend mask is an RGB image over
+// the projector's image, in linear light, fading out where it overlaps a neighbour.
+struct ProjectorCalibration {
+	int wall = 0, eye = 0, monitor = 0;
+	// Of the window, 0 for the size of the monitor's current mode
+	int width = 0, height = 0;
+	float gamma = 2.2f;
+	// A PPM, empty for none
+	std::string blendPath;
+	// columns * rows vertices, x y u v, row by row from the bottom
+	int columns = 0, rows = 0;
+	std::vector<glm::vec4> mesh;
+
+	// The whole wall on the whole image, without blending
+	static ProjectorCalibration identity(int wall, int eye, int width, int height);
+};
+
+// Reads a projector setup: a "projector" line starts each projector, followed by any of
+//   wall <0 left, 1 right, 2 bottom>   eye <0 or 1>   monitor <index>
+//   size <width> <height>              gamma <value>  blend <ppm, relative to the setup>
+//   mesh <columns> <rows>, then columns * rows lines of "x y u v"
+// Lines starting with # are skipped.
+bool loadProjectorSetup(const std::string & path, std::vector<ProjectorCalibration> & projectors);
+
+// Drives the projectors of a CAVE. Every projector gets a borderless window on its
+// monitor with a context sharing objects with the simulator's, so the wall textures
+// are sampled where they were rendered. Presenting is one draw of the warp mesh per
+// window, the blend mask applied in the same draw; then all windows swap back to back.
+// Where WGL_NV_swap_group is available the windows join one swap group and barrier
+// and flip on the same vertical blank; without it they swap without waiting for a
+// vertical blank and without any synchronisation between them.
+//
+// The windows are drawn and swapped on a thread of their own, so waiting for the
+// projectors' vertical blank never holds up the simulator's frames. present() copies
+// the walls the projectors show into an array of its own, which the thread draws from
+// once the copy's fence has passed. A frame whose walls arrive while the thread is
+// still issuing the draws of the last one is skipped on the projectors.
+class ProjectorOutput
+{
+public:
+	// program is the projector.vert/projector.frag program
+	explicit ProjectorOutput(GLuint program);
+	~ProjectorOutput();
+	ProjectorOutput(const ProjectorOutput &) = delete;
+	ProjectorOutput & operator=(const ProjectorOutput &) = delete;
+
+	// With share's context current. Hidden windows only render offscreen.
+	bool open(const std::vector<ProjectorCalibration> & projectors, GLFWwindow * share, bool visible = true);
+	void close();
+	int count() const { return (int)windows.size(); }
+	const ProjectorCalibration & calibration(int projector) const { return windows[projector].calibration; }
+	glm::ivec2 size(int projector) const { return glm::ivec2(windows[projector].width, windows[projector].height); }
+
+	// Hands the walls to the projectors' thread, which shows them on its next frame. The
+	// walls of an eye are layers firstLayer[eye] to firstLayer[eye] + 2 of wallArray.
+	// With share's context current, once the walls are rendered. Only visible windows
+	// present.
+	void present(GLuint wallArray, const int firstLayer[2]);
+	// What present shows on a projector, drawn into a texture of its window's size and
+	// read back as RGB rows, bottom row first. Only hidden windows render offscreen.
+	void renderOffscreen(int projector, GLuint wallArray, const int firstLayer[2], std::vector<unsigned char> & pixels);
+
+	// Frames handed to present(), those skipped and those the projectors swapped in
+	long long submitted = 0, skipped = 0;
+	std::atomic<long long> presented{ 0 };
+
+private:
+	// The GL objects of a window live in its context, VAOs and framebuffers are not shared
+	struct Window {
+		ProjectorCalibration calibration;
+		GLFWwindow * window = nullptr;
+		int width = 0, height = 0;
+		GLuint VAO = 0, VBO = 0, EBO = 0, blend = 0;
+		int indexCount = 0;
+		GLuint offscreenFbo = 0, offscreenTexture = 0;
+	};
+
+	void upload(Window & target);
+	void draw(const Window & target, GLuint wallArray, const int firstLayer[2]);
+	// A fence after the wall passes in share's context, for the windows' contexts to wait on
+	GLsync wallsDone();
+	// Copies the layers the projectors show into copyArray, in share's context
+	void copyWalls(GLuint wallArray, const int firstLayer[2]);
+	void presentLoop();
+
+	GLuint program;
+	GLFWwindow * share = nullptr;
+	std::vector<Window> windows;
+
+	// The walls the projectors' thread draws from, eye e's in layers 3e to 3e + 2, and
+	// the framebuffers copying into it
+	GLuint copyArray = 0, copyFbos[2] = { 0, 0 };
+	int copySize = 0;
+	std::thread presenter;
+	std::mutex presentLock;
+	std::condition_variable presentWake;
+	// Guarded by presentLock. copied is the fence after the copy the thread draws next,
+	// drawn those after the draws that read the last one, which the next copy waits on.
+	GLsync copied = 0;
+	std::vector<GLsync> drawn;
+	bool pending = false, drawing = false, stopping = false;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "RenderStats.h"
+#include <utility>
+
+void RenderCounters::add(const RenderCounters & other)
+{
+	draws += other.draws;
+	programs += other.programs;
+	textures += other.textures;
+	framebuffers += other.framebuffers;
+	uploadBytes += other.uploadBytes;
+}
+
+void RenderStats::beginFrame(unsigned int number)
+{
+	building.number = number;
+	building.passes.clear();
+	outside = RenderCounters();
+	pass = -1;
+	// Whatever was bound before, the first program and framebuffer of a frame count
+	lastProgram = lastFramebuffer = ~0u;
+}
+
+void RenderStats::endFrame()
+{
+	endPass();
+	building.total = outside;
+	for (const Pass & each : building.passes) building.total.add(each.counters);
+	std::swap(building, finished);
+}
+
+void RenderStats::beginPass(const char * name)
+{
+	Pass next;
+	next.name = name;
+	building.passes.push_back(next);
+	pass = (int)building.passes.size() - 1;
+}
+
+void RenderStats::endPass()
+{
+	pass = -1;
+}
+
+void RenderStats::print(std::ostream & out) const
+{
+	auto line = [&](const char * name, const RenderCounters & counters) {
+		out << "  " << name << ": " << counters.draws << " draws, " << counters.programs << " program switches, "
+			<< counters.textures << " texture binds, " << counters.framebuffers << " framebuffer switches, "
+			<< counters.uploadBytes << " bytes uploaded" << std::endl;
+	};
+	out << "frame " << finished.number << std::endl;
+	for (const Pass & each : finished.passes) line(each.name, each.counters);
+	line("total", finished.total);
+}
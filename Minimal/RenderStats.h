@@ -0,0 +1,97 @@
+#ifndef _RENDER_STATS_H_
+#define _RENDER_STATS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <ostream>
+#include <vector>
+
+// What the GL calls of a frame or pass cost the driver: draw calls, program and
+// framebuffer switches, texture binds and bytes handed to buffers and textures.
+struct RenderCounters {
+	int draws = 0, programs = 0, textures = 0, framebuffers = 0;
+	long long uploadBytes = 0;
+
+	void add(const RenderCounters & other);
+};
+
+// Per frame and per pass counters, reported by the code next to its GL calls. Every
+// thread counts into its own RenderStats, so contexts rendering on separate threads
+// don't mix. Reporting is one branch while the stats are disabled, the default.
+class RenderStats
+{
+public:
+	struct Pass {
+		// A string literal, passes are named on every frame
+		const char * name;
+		RenderCounters counters;
+	};
+	struct Frame {
+		unsigned int number = 0;
+		std::vector<Pass> passes;
+		// The passes and everything outside them
+		RenderCounters total;
+	};
+
+	// The calling thread's stats
+	static RenderStats & local() {
+		static thread_local RenderStats stats;
+		return stats;
+	}
+
+	bool enabled = false;
+
+	void beginFrame(unsigned int number);
+	void endFrame();
+	// Ends the current pass, if any. Work outside passes counts toward the frame only.
+	void beginPass(const char * name);
+	void endPass();
+
+	// The last frame endFrame() completed
+	const Frame & lastFrame() const { return finished; }
+	void print(std::ostream & out) const;
+
+	// Reports of the calling thread. Programs and framebuffers count only when they
+	// change, textures on every bind.
+	static void draw(int calls = 1) {
+		RenderStats & stats = local();
+		if (stats.enabled) stats.current().draws += calls;
+	}
+	static void program(GLuint program) {
+		RenderStats & stats = local();
+		if (stats.enabled && program != stats.lastProgram) {
+			stats.current().programs++;
+			stats.lastProgram = program;
+		}
+	}
+	static void texture(int binds = 1) {
+		RenderStats & stats = local();
+		if (stats.enabled) stats.current().textures += binds;
+	}
+	static void framebuffer(GLuint framebuffer) {
+		RenderStats & stats = local();
+		if (stats.enabled && framebuffer != stats.lastFramebuffer) {
+			stats.current().framebuffers++;
+			stats.lastFramebuffer = framebuffer;
+		}
+	}
+	static void upload(long long bytes) {
+		RenderStats & stats = local();
+		if (stats.enabled) stats.current().uploadBytes += bytes;
+	}
+
+private:
+	RenderCounters & current() { return pass < 0 ? outside : building.passes[pass].counters; }
+
+	Frame building, finished;
+	RenderCounters outside;
+	int pass = -1;
+	GLuint lastProgram = 0, lastFramebuffer = 0;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "SimControls.h"
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+void SimControls::handleInput(const ovrInputState & inputState)
+{
+	if (inputState.Buttons & ovrButton_A) buttonAPressed = true;
+	else if (buttonAPressed) {
+		buttonA = (buttonA + 1) % 4; buttonAPressed = false;
+	}
+	if (inputState.Buttons & ovrButton_B) buttonBPressed = true;
+	else if (buttonBPressed) {
+		buttonB = (buttonB + 1) % 2; buttonBPressed = false;
+	}
+	if (inputState.Buttons & ovrButton_X) buttonXPressed = true;
+	else if (buttonXPressed) {
+		buttonX = (buttonX + 1) % 2; buttonXPressed = false, randomGened = false;
+	}
+	if (inputState.Buttons & ovrButton_Y) buttonYPressed = true;
+	else if (buttonYPressed) {
+		hudVisible = !hudVisible; buttonYPressed = false;
+	}
+
+	if (inputState.HandTrigger[ovrHand_Right] > 0.5f) rightHandTriggerPressed = true;
+	else rightHandTriggerPressed = false;
+
+	resetPosition = (inputState.Buttons & ovrButton_RThumb) != 0;
+	moveX = moveZ = 0;
+	if (inputState.Thumbstick[ovrHand_Right].x > 0.5f) moveX = 1;
+	else if (inputState.Thumbstick[ovrHand_Right].x < -0.5f) moveX = -1;
+	if (inputState.Thumbstick[ovrHand_Right].y > 0.5f) moveZ = -1;
+	else if (inputState.Thumbstick[ovrHand_Right].y < -0.5f) moveZ = 1;
+
+	resetSize = (inputState.Buttons & ovrButton_LThumb) != 0;
+	resize = 0;
+	if (inputState.Thumbstick[ovrHand_Left].x > 0.5f) resize = 1;
+	else if (inputState.Thumbstick[ovrHand_Left].x < -0.5f) resize = -1;
+}
+
+void SimControls::releaseSticks()
+{
+	moveX = moveZ = resize = 0;
+	resetPosition = resetSize = false;
+}
+
+void SimControls::step(float seconds)
+{
+	prevCubeX = cubeX;
+	prevCubeZ = cubeZ;
+	prevCubeSize = cubeSize;
+
+	if (resetPosition) {
+		cubeX = 0.0f;
+		cubeZ = -0.5f;
+	}
+	else {
+		cubeX += moveX * cubeSpeed * seconds;
+		cubeZ += moveZ * cubeSpeed * seconds;
+	}
+	if (resetSize) cubeSize = 0.03f;
+	else cubeSize = std::min(std::max(cubeSize + resize * resizeSpeed * seconds, 0.001f), 0.1f);
+}
+
+glm::mat4 SimControls::cubeTransform(float alpha) const
+{
+	float x = prevCubeX + (cubeX - prevCubeX) * alpha;
+	float z = prevCubeZ + (cubeZ - prevCubeZ) * alpha;
+	float size = prevCubeSize + (cubeSize - prevCubeSize) * alpha;
+	return glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)) * glm::scale(glm::mat4(1.0f), glm::vec3(size, size, size));
+}
@@ -0,0 +1,44 @@
+#ifndef _SIM_CONTROLS_H_
+#define _SIM_CONTROLS_H_
+
+#include <cstdlib>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <OVR_CAPI.h>
+
+// The user controlled state of the simulator: button toggles, the hand trigger and
+// the cube's placement. Holds no GL objects, so it can be driven with synthetic input.
+struct SimControls
+{
+	bool buttonAPressed = false, buttonBPressed = false, buttonXPressed = false, rightHandTriggerPressed = false;
+	int buttonA = 0, buttonB = 0, buttonX = 0;
+	// The performance HUD, toggled with the Y button
+	bool buttonYPressed = false, hudVisible = false;
+	float IOD = 0.0f, cubeSize = 0.03f, cubeX = 0.0f, cubeZ = -0.5f;
+	int random_num = rand() % 6;
+	bool randomGened = false;
+
+	// Cube state before the last step, for interpolating between steps
+	float prevCubeSize = 0.03f, prevCubeX = 0.0f, prevCubeZ = -0.5f;
+	// Thumbstick directions (-1, 0, 1) and resets seen by the last handleInput
+	int moveX = 0, moveZ = 0, resize = 0;
+	bool resetPosition = false, resetSize = false;
+	// Per second; the cube used to move 0.001 per frame at the Rift's 90 Hz
+	float cubeSpeed = 0.09f, resizeSpeed = 0.09f;
+
+	// Buttons toggle on release, the thumbsticks move (right) and resize (left) the
+	// cube. Only samples the controllers, the cube itself moves in step().
+	void handleInput(const ovrInputState & inputState);
+	// Stops the thumbstick motion and resets of the last handleInput, for frames whose
+	// input could not be read. Buttons keep their state.
+	void releaseSticks();
+	// Advance the cube by one fixed simulation step
+	void step(float seconds);
+	// alpha 0 is the state before the last step, 1 the state after it
+	glm::mat4 cubeTransform(float alpha = 1.0f) const;
+};
+
+#endif
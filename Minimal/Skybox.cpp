@@ -1,12 +1,16 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #include "Skybox.h"
+#include "FileIO.h"
+#include "RenderStats.h"
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <string>
 
 // Basic constructor
-Skybox::Skybox()
+Skybox::Skybox(const Skybox * shared)
 {
-	initialize();
+	initialize(shared);
 }
 
 // Increase size of skybox by mult times
@@ -24,10 +28,11 @@ Skybox::~Skybox()
 	// large project! This could crash the graphics driver due to memory leaks, or slow down application performance!
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
+	if (streamThread.joinable()) streamThread.join();
 }
 
 // Initialization method for constructors
-void Skybox::initialize() {
+void Skybox::initialize(const Skybox * shared) {
 	toWorld = glm::mat4(1.0f);
 
 	// Create array object and buffers. Remember to delete your buffers when the object is destroyed!
@@ -80,7 +85,11 @@ void Skybox::initialize() {
 	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
 	glBindVertexArray(0);
 
-	this->loadCubemap();
+	if (shared) {
+		texture_ID_stereo = shared->texture_ID_stereo;
+		texture_ID_self = shared->texture_ID_self;
+	}
+	else this->loadCubemap();
 }
 
 // Skybox is source of directional light
@@ -120,15 +129,14 @@ void Skybox::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V)
 	glUniformMatrix4fv(uModel, 1, GL_FALSE, &toWorld[0][0]);
 
 	// Now draw the cube. We simply need to bind the VAO associated with it.
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, curTextureID);
-	glUniform1i(glGetUniformLocation(shaderProgram, "myTextureSampler"), 0);
+	bindCubemap(shaderProgram);
 	glBindVertexArray(VAO);
 
 
 	// Tell OpenGL to draw with triangles, using 36 indices, the type of the indices, and the offset to start from
 	glBindBuffer(GL_ARRAY_BUFFER, uv_ID);
 	glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
+	RenderStats::draw();
 
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
@@ -138,104 +146,68 @@ void Skybox::draw(GLuint shaderProgram, glm::mat4 P, glm::mat4 V)
 	glDepthFunc(GL_LESS);
 }
 
+void Skybox::drawStereo(GLuint shaderProgram)
+{
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+
+	// The view matrices are in the uniform block, the shader drops their translation
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &toWorld[0][0]);
+
+	bindCubemap(shaderProgram);
+	glBindVertexArray(VAO);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 12 * 3, 2);
+	RenderStats::draw();
+	glBindVertexArray(0);
+
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
 // Load textures for skybox
 void Skybox::loadCubemap() {
 	unsigned char * image;
 	int width, height;
+	// GL face order +X, -X, +Y, -Y, +Z, -Z, the layer faces of a cube map array follow it
+	const char * faces[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+	const char * stereoSets[2] = {
+		"C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/",
+		"C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/" };
 
-	glGenTextures(1, &texture_ID_left);
-	glGenTextures(1, &texture_ID_right);
-	glGenTextures(1, &texture_ID_self);
-
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_ID_left);
 	// Make sure no bytes are padded:
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	// Select GL_MODULATE to mix texture with polygon color for shading:
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/nx.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/ny.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/nz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/px.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/py.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm/pz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	// Sets texture parameters
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	// Unbinds texture
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_ID_right);
-	// Make sure no bytes are padded:
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	// Select GL_MODULATE to mix texture with polygon color for shading:
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/nx.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/ny.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/nz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/px.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/py.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm/pz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
+	// Both stereo sets in one cube map array, the layer is the eye
+	glGenTextures(1, &texture_ID_stereo);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture_ID_stereo);
+	for (int eye = 0; eye < 2; eye++) {
+		for (int face = 0; face < 6; face++) {
+			image = loadPPM((std::string(stereoSets[eye]) + faces[face] + ".ppm").c_str(), width, height);
+			if (eye == 0 && face == 0) {
+				glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_RGB, width, height, 2 * 6, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			}
+			glTexSubImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, eye * 6 + face, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, image);
+			delete[] image;
+		}
+	}
 	// Sets texture parameters
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	// Unbinds texture
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
 
+	// The self set is smaller, so it can't be a layer of the same array
+	glGenTextures(1, &texture_ID_self);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_ID_self);
-	// Make sure no bytes are padded:
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	// Select GL_MODULATE to mix texture with polygon color for shading:
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/nx.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/ny.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/nz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/px.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/py.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
-	image = loadPPM("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/pz.ppm", width, height);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	free(image);
+	for (int face = 0; face < 6; face++) {
+		image = loadPPM((std::string("C:/Users/degu/Desktop/CSE190Project3/Minimal/self-ppm/") + faces[face] + ".ppm").c_str(), width, height);
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+		delete[] image;
+	}
 	// Sets texture parameters
 	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -247,67 +219,100 @@ void Skybox::loadCubemap() {
 	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
-void Skybox::useCubemap(int eyeIdx)
+bool Skybox::streamStereoCubemap(UploadService & uploads, const std::string & leftDirectory,
+	const std::string & rightDirectory, std::function<void()> done)
 {
-	if (eyeIdx == 0) {
-		curTextureID = texture_ID_left;
-	}
-	else if(eyeIdx == 1) {
-		curTextureID = texture_ID_right;
-	}
-	else curTextureID = texture_ID_self;
+	if (streaming) return false;
+	if (streamThread.joinable()) streamThread.join();
+	streaming = true;
+
+	GLint width, height;
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture_ID_stereo);
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_TEXTURE_HEIGHT, &height);
+	// Storage only, the faces arrive over the next frames
+	GLuint array;
+	glGenTextures(1, &array);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, array);
+	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_RGB, width, height, 2 * 6, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+	// The callbacks all run on the GL thread, the last one swaps the arrays
+	auto remaining = std::make_shared<int>(2 * 6);
+	auto failed = std::make_shared<bool>(false);
+	auto faceDone = [this, array, remaining, failed, done] {
+		if (--*remaining) return;
+		if (*failed) {
+			glDeleteTextures(1, &array);
+		}
+		else {
+			glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, array);
+			glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+			glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+			glDeleteTextures(1, &texture_ID_stereo);
+			texture_ID_stereo = array;
+		}
+		streaming = false;
+		if (done) done();
+	};
+
+	std::string directories[2] = { leftDirectory, rightDirectory };
+	streamThread = std::thread([this, &uploads, array, width, height, directories, failed, faceDone] {
+		const char * faces[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+		for (int eye = 0; eye < 2; eye++) {
+			for (int face = 0; face < 6; face++) {
+				UploadService::TextureRegion region = { GL_TEXTURE_CUBE_MAP_ARRAY, array, 0, eye * 6 + face,
+					width, height, GL_RGB, GL_UNSIGNED_BYTE, 3 };
+				int faceWidth = 0, faceHeight = 0;
+				unsigned char * image = loadPPM((directories[eye] + faces[face] + ".ppm").c_str(), faceWidth, faceHeight);
+				std::vector<unsigned char> pixels;
+				if (image && faceWidth == width && faceHeight == height) {
+					pixels.assign(image, image + (size_t)width * height * 3);
+				}
+				else {
+					if (image) std::cerr << directories[eye] << faces[face] << ".ppm is not " << width << "x" << height << std::endl;
+					// Only read on the GL thread, after every face has been requested
+					*failed = true;
+				}
+				delete[] image;
+				if (!uploads.uploadTexture(region, std::move(pixels), faceDone)) {
+					// Still counted, so the last face swaps or discards the array
+					*failed = true;
+					uploads.uploadTexture(region, std::vector<unsigned char>(), faceDone);
+				}
+			}
+		}
+	});
+	return true;
 }
 
-#pragma warning(disable : 4996)  
-unsigned char* Skybox::loadPPM(const char* filename, int& width, int& height)
+// 0 and 1 are the layers of the stereo array, anything else the self cubemap
+void Skybox::useCubemap(int eyeIdx)
 {
-	const int BUFSIZE = 128;
-	FILE* fp;
-	unsigned int read;
-	unsigned char* rawData;
-	char buf[3][BUFSIZE];
-	char* retval_fgets;
-	size_t retval_sscanf;
-
-	if ((fp = fopen(filename, "rb")) == NULL)
-	{
-		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
-		width = 0;
-		height = 0;
-		return 0;
-	}
+	curLayer = (eyeIdx == 0 || eyeIdx == 1) ? eyeIdx : -1;
+}
 
-	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
-
-	// Read width and height:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
-	width = atoi(buf[1]);
-	height = atoi(buf[2]);
-
-	// Read maxval:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-
-	// Read image data:
-	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
-	if (read != 1)
-	{
-		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
-		delete[] rawData;
-		width = 0;
-		height = 0;
-
-		return 0;
-	}
+// Both cubemap kinds stay bound, the layer uniform picks one of them
+void Skybox::bindCubemap(GLuint shaderProgram)
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_ID_self);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture_ID_stereo);
+	glActiveTexture(GL_TEXTURE0);
+	RenderStats::texture(2);
+	glUniform1i(glGetUniformLocation(shaderProgram, "skybox"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "stereoSkybox"), 1);
+	glUniform1i(glGetUniformLocation(shaderProgram, "layer"), curLayer);
+	if (virtualCubemap) virtualCubemap->bind(shaderProgram);
+}
 
-	return rawData;
+unsigned char* Skybox::loadPPM(const char* filename, int& width, int& height)
+{
+	return ::loadPPM(filename, width, height);
 }
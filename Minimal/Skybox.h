@@ -18,29 +18,53 @@
 #endif
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <functional>
+#include <string>
+#include <thread>
+#include "UploadService.h"
+#include "VirtualCubemap.h"
 
 class Skybox
 {
 public:
-	Skybox();
+	// Pass another Skybox to reuse its cubemaps, e.g. from a context sharing its objects
+	Skybox(const Skybox * shared = nullptr);
 	Skybox(float mult);
 	~Skybox();
 
 	glm::mat4 toWorld;
 
-	void initialize();
+	void initialize(const Skybox * shared = nullptr);
 	void draw(GLuint, glm::mat4, glm::mat4);
+	// Both eyes in one instanced draw, the eye matrices come from the StereoEyes block
+	void drawStereo(GLuint);
 	void sendLight(GLuint shaderProgram);
 	unsigned char* loadPPM(const char*, int&, int&);
 
 	// Cubemap
 	void loadCubemap();
 	void useCubemap(int eyeIdx);
+	void bindCubemap(GLuint shaderProgram);
+	// Replaces the stereo cubemaps with the sets in leftDirectory and rightDirectory, as
+	// laid out for loadCubemap, without stalling the frame: the faces are read on a thread
+	// of their own and uploaded by uploads into a new array the size of the current one.
+	// done runs on the GL thread once the new array is in use. False if a set is still
+	// streaming.
+	bool streamStereoCubemap(UploadService & uploads, const std::string & leftDirectory,
+		const std::string & rightDirectory, std::function<void()> done = std::function<void()>());
 	glm::vec3 direction = glm::vec3(-0.0459845f, 0.0925645f, 0.994644f);
+	// The stereo sets as tiles streamed in on demand, bound by bindCubemap for programs
+	// sampling them through skybox_virtual.frag. Owned by the caller.
+	VirtualCubemap * virtualCubemap = nullptr;
 
 	// These variables are needed for the shader program
 	GLuint VBO, VAO, uv_ID;
-	GLuint uProjection, uModel, uView, texture_ID_left, texture_ID_right, texture_ID_self, curTextureID;
+	GLuint uProjection, uModel, uView;
+	// The left and right eye sets as layers 0 and 1 of a cube map array
+	GLuint texture_ID_stereo, texture_ID_self;
+	int curLayer = 0;
+	std::thread streamThread;
+	bool streaming = false;
 
 	/*
 	GLfloat vertices[8][3] = {
@@ -0,0 +1,37 @@
+#include "StageTimer.h"
+
+StageTimer::StageTimer(int stageCount)
+	: queries(stageCount), issued(stageCount, false), starts(stageCount), cpu(stageCount, 0.0), gpu(stageCount, 0.0)
+{
+	glGenQueries(stageCount, queries.data());
+}
+
+StageTimer::~StageTimer()
+{
+	glDeleteQueries((GLsizei)queries.size(), queries.data());
+}
+
+void StageTimer::begin(int stage)
+{
+	glBeginQuery(GL_TIME_ELAPSED, queries[stage]);
+	starts[stage] = std::chrono::high_resolution_clock::now();
+}
+
+void StageTimer::end(int stage)
+{
+	cpu[stage] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - starts[stage]).count();
+	glEndQuery(GL_TIME_ELAPSED);
+	issued[stage] = true;
+}
+
+void StageTimer::collect()
+{
+	for (size_t stage = 0; stage < queries.size(); stage++) {
+		if (!issued[stage]) continue;
+		// Asking for the result stalls until the GPU got there
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queries[stage], GL_QUERY_RESULT, &nanoseconds);
+		gpu[stage] = nanoseconds / 1e6;
+		issued[stage] = false;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _STAGE_TIMER_H_
+#define _STAGE_TIMER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <vector>
+
+// Measures the stages of a frame on both sides: CPU time is the wall clock time
+// between begin() and end() on the calling thread, GPU time comes from a
+// GL_TIME_ELAPSED query around the same commands. Only one such query can be
+// active at a time, so stages must not overlap.
+class StageTimer
+{
+public:
+	explicit StageTimer(int stageCount);
+	~StageTimer();
+
+	void begin(int stage);
+	void end(int stage);
+
+	// Waits for the GPU results of the stages timed since the last collect()
+	void collect();
+
+	double cpuMs(int stage) const { return cpu[stage]; }
+	double gpuMs(int stage) const { return gpu[stage]; }
+
+private:
+	std::vector<GLuint> queries;
+	std::vector<bool> issued;
+	std::vector<std::chrono::high_resolution_clock::time_point> starts;
+	std::vector<double> cpu, gpu;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+	// The pool and deque of the worker running on this thread, if any
+	thread_local ThreadPool * workerPool = nullptr;
+	thread_local unsigned int workerIndex = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+	for (unsigned int i = 1; i < threadCount; i++) {
+		threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto & thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	// A worker keeps what it spawns, the others steal it if they run dry. Spread
+	// outside submissions over the workers, they will rebalance by stealing.
+	if (workerPool == this) {
+		push(workerIndex, std::move(task));
+	}
+	else {
+		push(nextQueue++ % size(), std::move(task));
+	}
+}
+
+void ThreadPool::push(unsigned int queue, std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> guard(queues[queue]->lock);
+		queues[queue]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		++pending;
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::pop(unsigned int self, std::function<void()> & task)
+{
+	// Own work first, newest first, since it is the most likely to be cache hot
+	{
+		Queue & own = *queues[self];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--pending;
+			return true;
+		}
+	}
+	// Then steal the oldest task of somebody else
+	for (unsigned int i = 1; i < size(); i++) {
+		Queue & victim = *queues[(self + i) % size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--pending;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(unsigned int index)
+{
+	workerPool = this;
+	workerIndex = index;
+	std::function<void()> task;
+	while (true) {
+		if (pop(index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [&] { return stopping || pending > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const std::function<void(int, int)> & body)
+{
+	if (end <= begin) {
+		return;
+	}
+	grain = std::max(1, grain);
+	std::atomic<int> remaining((end - begin + grain - 1) / grain);
+	for (int first = begin; first < end; first += grain) {
+		int last = std::min(end, first + grain);
+		submit([&body, &remaining, first, last] {
+			body(first, last);
+			--remaining;
+		});
+	}
+	// Help out instead of blocking, this is also what makes a pool of size 1 work
+	while (remaining > 0) {
+		if (!runOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool ThreadPool::runOne()
+{
+	std::function<void()> task;
+	if (!pop(workerPool == this ? workerIndex : 0, task)) {
+		return false;
+	}
+	task();
+	return true;
+}
+
+ThreadPool::Job ThreadPool::add(std::function<void()> task, const std::vector<Job> & dependencies)
+{
+	Job job = std::make_shared<JobState>();
+	job->task = std::move(task);
+	++frameJobs;
+	for (const Job & dependency : dependencies) {
+		if (!dependency) continue;
+		std::lock_guard<std::mutex> guard(dependency->lock);
+		if (!dependency->finished) {
+			++job->unfinished;
+			dependency->continuations.push_back(job);
+		}
+	}
+	// Drop the hold, the job runs now unless a dependency is still going
+	if (--job->unfinished == 0) {
+		schedule(job);
+	}
+	return job;
+}
+
+void ThreadPool::schedule(const Job & job)
+{
+	submit([this, job] {
+		job->task();
+		complete(job);
+	});
+}
+
+void ThreadPool::complete(const Job & job)
+{
+	// Release what the task holds before anyone waiting sees it finished
+	job->task = nullptr;
+	std::vector<Job> continuations;
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->finished = true;
+		continuations.swap(job->continuations);
+	}
+	for (const Job & continuation : continuations) {
+		if (--continuation->unfinished == 0) {
+			schedule(continuation);
+		}
+	}
+	--frameJobs;
+}
+
+ThreadPool::Job ThreadPool::parallelForAsync(int begin, int end, int grain, std::function<void(int, int)> body,
+	const std::vector<Job> & dependencies)
+{
+	grain = std::max(1, grain);
+	// The chunks share the body, the last job keeps it alive until they are done
+	auto shared = std::make_shared<std::function<void(int, int)>>(std::move(body));
+	std::vector<Job> chunks;
+	for (int first = begin; first < end; first += grain) {
+		int last = std::min(end, first + grain);
+		chunks.push_back(add([shared, first, last] { (*shared)(first, last); }, dependencies));
+	}
+	if (chunks.empty()) {
+		chunks = dependencies;
+	}
+	return add([shared] {}, chunks);
+}
+
+void ThreadPool::wait(const Job & job)
+{
+	while (job && !job->finished) {
+		if (!runOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::finishFrame()
+{
+	while (frameJobs > 0) {
+		if (!runOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool. Every worker owns a deque: it pops its own
+// work from the back and, when that runs dry, steals from the front of the others.
+// Work submitted from inside a task goes to the submitting worker's own deque.
+// The thread calling parallelFor() or wait() joins in, so a pool of size 1 runs
+// everything on the caller.
+//
+// Jobs are tasks with dependencies: a job is queued once all the jobs it depends on
+// have finished. Jobs added since the last finishFrame() belong to the current frame.
+class ThreadPool
+{
+	struct JobState;
+
+public:
+	typedef std::shared_ptr<JobState> Job;
+
+	// threadCount includes the calling thread, 0 means one per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	unsigned int size() const { return (unsigned int)queues.size(); }
+
+	void submit(std::function<void()> task);
+
+	// Split [begin, end) into chunks of at most grain items and run body(first, last)
+	// on every chunk. Returns once all chunks are finished.
+	void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> & body);
+
+	// Runs task after every job in dependencies
+	Job add(std::function<void()> task, const std::vector<Job> & dependencies = std::vector<Job>());
+	// parallelFor as a job: the chunks start after dependencies, the returned job
+	// finishes after the last chunk. body must stay valid until then.
+	Job parallelForAsync(int begin, int end, int grain, std::function<void(int, int)> body,
+		const std::vector<Job> & dependencies = std::vector<Job>());
+	// Runs tasks until job has finished
+	void wait(const Job & job);
+	// Runs tasks until every job of the frame has finished, the next job starts a new frame
+	void finishFrame();
+
+private:
+	struct JobState {
+		std::function<void()> task;
+		// Dependencies still running, plus one held by add() while it links them
+		std::atomic<int> unfinished{ 1 };
+		std::atomic<bool> finished{ false };
+		std::mutex lock;
+		std::vector<Job> continuations;
+	};
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void push(unsigned int queue, std::function<void()> task);
+	bool pop(unsigned int self, std::function<void()> & task);
+	void workerLoop(unsigned int index);
+	void schedule(const Job & job);
+	void complete(const Job & job);
+	// Runs one task of the calling thread's deque or a stolen one, false if there was none
+	bool runOne();
+
+	// Queue 0 belongs to the threads outside the pool, 1..n-1 to the workers
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> pending{ 0 };
+	std::atomic<unsigned int> nextQueue{ 0 };
+	std::atomic<int> frameJobs{ 0 };
+	bool stopping = false;
+};
+
+#endif
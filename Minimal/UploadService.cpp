@@ -0,0 +1,216 @@
+#include "UploadService.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// Tiles start at offsets any pixel or buffer copy accepts
+	const size_t stagingAlignment = 64;
+}
+
+UploadService::UploadService(size_t ringBytes, size_t tileBytes)
+	: ringSize(ringBytes), tileSize(std::min(tileBytes, ringBytes))
+{
+	glGenBuffers(1, &ring);
+	glBindBuffer(GL_COPY_READ_BUFFER, ring);
+	if (glfwExtensionSupported("GL_ARB_buffer_storage")) {
+		// Mapped once for the life of the service, the fences keep writes off tiles in use
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, ringSize, NULL, flags);
+		mapped = (unsigned char *)glMapBufferRange(GL_COPY_READ_BUFFER, 0, ringSize, flags);
+	}
+	else {
+		glBufferData(GL_COPY_READ_BUFFER, ringSize, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+UploadService::~UploadService()
+{
+	for (Batch & batch : inFlight) {
+		glDeleteSync(batch.fence);
+	}
+	if (mapped) {
+		glBindBuffer(GL_COPY_READ_BUFFER, ring);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ring);
+}
+
+bool UploadService::uploadTexture(const TextureRegion & region, std::vector<unsigned char> pixels, Callback done)
+{
+	if (!pixels.empty() && pixels.size() != (size_t)region.width * region.height * region.pixelSize) {
+		std::cerr << "texture upload of " << pixels.size() << " bytes does not match its " << region.width << "x" << region.height << " region" << std::endl;
+		return false;
+	}
+	Request request = { true, region, 0, 0, std::move(pixels), 0, std::move(done) };
+	std::lock_guard<std::mutex> guard(lock);
+	incoming.push_back(std::move(request));
+	return true;
+}
+
+void UploadService::uploadBuffer(GLuint buffer, GLintptr offset, std::vector<unsigned char> data, Callback done)
+{
+	Request request = { false, TextureRegion(), buffer, offset, std::move(data), 0, std::move(done) };
+	std::lock_guard<std::mutex> guard(lock);
+	incoming.push_back(std::move(request));
+}
+
+int UploadService::pending()
+{
+	int waiting = (int)active.size();
+	for (const Batch & batch : inFlight) waiting += (int)batch.done.size();
+	std::lock_guard<std::mutex> guard(lock);
+	return waiting + (int)incoming.size();
+}
+
+int UploadService::cancelTexture(GLuint texture)
+{
+	auto into = [texture](const Request & request) { return request.texture && request.region.texture == texture; };
+	size_t before = active.size();
+	// What already reached GL is done with before the texture can go
+	active.erase(std::remove_if(active.begin(), active.end(), into), active.end());
+	int cancelled = (int)(before - active.size());
+	std::lock_guard<std::mutex> guard(lock);
+	before = incoming.size();
+	incoming.erase(std::remove_if(incoming.begin(), incoming.end(), into), incoming.end());
+	return cancelled + (int)(before - incoming.size());
+}
+
+void UploadService::retire()
+{
+	while (!inFlight.empty()) {
+		GLenum status = glClientWaitSync(inFlight.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+		Batch batch = std::move(inFlight.front());
+		inFlight.pop_front();
+		glDeleteSync(batch.fence);
+		used -= batch.ringBytes;
+		for (Callback & done : batch.done) {
+			if (done) done();
+		}
+	}
+}
+
+bool UploadService::allocate(size_t bytes, size_t & offset, size_t & consumed)
+{
+	size_t start = (head + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+	// A tile does not wrap, the end of the ring is skipped instead
+	if (start + bytes > ringSize) start = ringSize;
+	size_t skipped = start - head;
+	if (start == ringSize) start = 0;
+	if (used + skipped + bytes > ringSize) return false;
+	offset = start;
+	consumed = skipped + bytes;
+	used += consumed;
+	head = start + bytes;
+	return true;
+}
+
+void UploadService::stage(size_t offset, const unsigned char * data, size_t bytes)
+{
+	if (mapped) {
+		memcpy(mapped + offset, data, bytes);
+		return;
+	}
+	// The fences already keep this range out of use, so GL need not wait for it either
+	glBindBuffer(GL_COPY_READ_BUFFER, ring);
+	void * staging = glMapBufferRange(GL_COPY_READ_BUFFER, offset, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	memcpy(staging, data, bytes);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void UploadService::uploadTile(Request & request, size_t offset, size_t bytes)
+{
+	RenderStats::upload(bytes);
+	if (!request.texture) {
+		glBindBuffer(GL_COPY_READ_BUFFER, ring);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, request.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, request.offset + request.uploaded, bytes);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		return;
+	}
+
+	const TextureRegion & region = request.region;
+	size_t rowBytes = (size_t)region.width * region.pixelSize;
+	GLint firstRow = (GLint)(request.uploaded / rowBytes);
+	GLsizei rows = (GLsizei)(bytes / rowBytes);
+	const GLvoid * pixels = (const GLvoid *)offset;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+	glBindTexture(region.target, region.texture);
+	switch (region.target) {
+	case GL_TEXTURE_CUBE_MAP:
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + region.layer, region.level, 0, firstRow,
+			region.width, rows, region.format, region.type, pixels);
+		break;
+	case GL_TEXTURE_2D_ARRAY:
+	case GL_TEXTURE_CUBE_MAP_ARRAY:
+		glTexSubImage3D(region.target, region.level, 0, firstRow, region.layer,
+			region.width, rows, 1, region.format, region.type, pixels);
+		break;
+	default:
+		glTexSubImage2D(region.target, region.level, 0, firstRow, region.width, rows, region.format, region.type, pixels);
+		break;
+	}
+	glBindTexture(region.target, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadService::update()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	retire();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		while (!incoming.empty()) {
+			active.push_back(std::move(incoming.front()));
+			incoming.pop_front();
+		}
+	}
+
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	Batch batch = { 0, 0 };
+	size_t spent = 0;
+	double elapsed = 0.0;
+	while (!active.empty()) {
+		Request & request = active.front();
+		size_t remaining = request.data.size() - request.uploaded;
+		size_t bytes = std::min(remaining, tileSize);
+		if (request.texture && remaining) {
+			// Whole rows, one at least
+			size_t rowBytes = (size_t)request.region.width * request.region.pixelSize;
+			bytes = std::min(std::max(bytes / rowBytes, (size_t)1) * rowBytes, remaining);
+		}
+		if (spent && (spent + bytes > byteBudget || elapsed >= microsecondBudget)) break;
+
+		if (bytes) {
+			size_t offset, consumed;
+			if (!allocate(bytes, offset, consumed)) break;
+			stage(offset, request.data.data() + request.uploaded, bytes);
+			uploadTile(request, offset, bytes);
+			request.uploaded += bytes;
+			batch.ringBytes += consumed;
+			spent += bytes;
+		}
+		if (request.uploaded == request.data.size()) {
+			batch.done.push_back(std::move(request.done));
+			active.pop_front();
+		}
+		elapsed = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+	if (batch.ringBytes || !batch.done.empty()) {
+		batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		inFlight.push_back(std::move(batch));
+	}
+	lastBytes = spent;
+	lastMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+}
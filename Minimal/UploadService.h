@@ -0,0 +1,109 @@
+#ifndef _UPLOAD_SERVICE_H_
+#define _UPLOAD_SERVICE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Uploads textures and buffers a little every frame instead of all at once. Requests
+// come from any thread; update(), on the GL thread, copies them in tiles into a ring
+// of staging memory that stays allocated (and persistently mapped where
+// GL_ARB_buffer_storage is available) and hands the tiles to GL from there, until
+// the frame's byte or time budget is spent. A request's callback runs in a later
+// update() on the GL thread, once the fence after its last tile has signalled.
+//
+// Textures are uploaded in bands of whole rows into storage the caller has already
+// allocated, e.g. with a glTexImage2D of NULL pixels.
+class UploadService
+{
+public:
+	struct TextureRegion {
+		// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY
+		GLenum target;
+		GLuint texture;
+		GLint level;
+		// The face of a cube map, the layer of an array, layer * 6 + face of a cube map array
+		GLint layer;
+		GLsizei width, height;
+		GLenum format, type;
+		int pixelSize;
+	};
+	typedef std::function<void()> Callback;
+
+	// ringBytes of staging memory, used in tiles of up to tileBytes. The ring has to
+	// hold a row of every texture uploaded through it.
+	explicit UploadService(size_t ringBytes = 32 << 20, size_t tileBytes = 256 << 10);
+	~UploadService();
+
+	// Thread safe. pixels are width * height tightly packed rows; none uploads nothing,
+	// but done still runs after the requests before it. False, with nothing queued and
+	// done never run, if pixels are not the size of the region.
+	bool uploadTexture(const TextureRegion & region, std::vector<unsigned char> pixels, Callback done = Callback());
+	void uploadBuffer(GLuint buffer, GLintptr offset, std::vector<unsigned char> data, Callback done = Callback());
+
+	// Once per frame on the GL thread: runs the callbacks of finished requests and
+	// uploads until a budget is spent. At least one tile goes per frame while there is
+	// room in the ring, whatever the budgets.
+	void update();
+
+	// Requests not uploaded yet or still waiting for their fence
+	int pending();
+	// On the GL thread: drops the requests into texture not handed to GL yet, without
+	// running their callbacks, e.g. before deleting it. Returns how many.
+	int cancelTexture(GLuint texture);
+
+	size_t byteBudget = 4 << 20;
+	double microsecondBudget = 1000.0;
+
+	// What the last update() spent
+	size_t lastBytes = 0;
+	double lastMicroseconds = 0.0;
+
+private:
+	struct Request {
+		bool texture;
+		TextureRegion region;
+		GLuint buffer;
+		GLintptr offset;
+		std::vector<unsigned char> data;
+		// Bytes of data already uploaded
+		size_t uploaded;
+		Callback done;
+	};
+
+	// The tiles of one update() and the requests they finished
+	struct Batch {
+		GLsync fence;
+		size_t ringBytes;
+		std::vector<Callback> done;
+	};
+
+	void retire();
+	// Offset of bytes of ring space, false if the ring is full
+	bool allocate(size_t bytes, size_t & offset, size_t & consumed);
+	void stage(size_t offset, const unsigned char * data, size_t bytes);
+	void uploadTile(Request & request, size_t offset, size_t bytes);
+
+	std::mutex lock;
+	std::deque<Request> incoming;
+	// GL thread only
+	std::deque<Request> active;
+	std::deque<Batch> inFlight;
+
+	GLuint ring;
+	unsigned char * mapped = nullptr;
+	size_t ringSize, tileSize;
+	// Next free byte and the bytes between the oldest batch and it
+	size_t head = 0, used = 0;
+};
+
+#endif
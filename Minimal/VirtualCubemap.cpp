@@ -0,0 +1,485 @@
+#include "VirtualCubemap.h"
+#include "RenderStats.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+	const char cookedMagic[4] = { 'V', 'C', 'U', 'B' };
+	const uint32_t cookedVersion = 1;
+	const uint32_t tileBorder = 1;
+	const uint32_t maxPagesPerSide = 256;
+	// GL face order, as loaded by Skybox::loadCubemap
+	const char * faceNames[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+	// -1 unless value is a power of two
+	int exactLog2(uint32_t value) {
+		if (!value || (value & (value - 1))) return -1;
+		int log = 0;
+		while (value >>= 1) log++;
+		return log;
+	}
+
+	// An RGB image of size x size halved by averaging 2x2 blocks
+	std::vector<unsigned char> halve(const std::vector<unsigned char> & image, int size) {
+		int half = size / 2;
+		std::vector<unsigned char> result((size_t)half * half * 3);
+		for (int y = 0; y < half; y++) {
+			const unsigned char * above = &image[(size_t)2 * y * size * 3];
+			const unsigned char * below = above + (size_t)size * 3;
+			unsigned char * out = &result[(size_t)y * half * 3];
+			for (int x = 0; x < half; x++) {
+				for (int c = 0; c < 3; c++) {
+					int i = x * 6 + c;
+					out[x * 3 + c] = (unsigned char)((above[i] + above[i + 3] + below[i] + below[i + 3] + 2) / 4);
+				}
+			}
+		}
+		return result;
+	}
+
+}
+
+bool cookVirtualCubemap(const std::string & leftDirectory, const std::string & rightDirectory,
+	const std::string & outputPath, int tileSize)
+{
+	std::string directories[2] = { leftDirectory + "/", rightDirectory + "/" };
+	std::ofstream out(outputPath.c_str(), std::ios::binary);
+	if (!out) {
+		std::cerr << "could not write " << outputPath << std::endl;
+		return false;
+	}
+	VirtualCubemapHeader header = {};
+	std::vector<unsigned char> tile;
+	for (int eye = 0; eye < 2; eye++) {
+		for (int face = 0; face < 6; face++) {
+			std::string path = directories[eye] + faceNames[face] + ".ppm";
+			int width, height;
+			unsigned char * image = loadPPM(path.c_str(), width, height);
+			if (!image) {
+				std::cerr << "could not read " << path << std::endl;
+				return false;
+			}
+			if (eye == 0 && face == 0) {
+				uint32_t pages = tileSize > 0 && width % tileSize == 0 ? width / tileSize : 0;
+				if (width != height || exactLog2(pages) < 0 || pages > maxPagesPerSide) {
+					std::cerr << path << " is " << width << "x" << height << ", faces have to be square and " << tileSize
+						<< " times a power of two up to " << maxPagesPerSide << std::endl;
+					delete[] image;
+					return false;
+				}
+				memcpy(header.magic, cookedMagic, 4);
+				header.version = cookedVersion;
+				header.faceSize = width;
+				header.tileSize = tileSize;
+				header.border = tileBorder;
+				header.pagesPerSide = pages;
+				header.levels = exactLog2(pages) + 1;
+				out.write((const char *)&header, sizeof(header));
+				int stride = tileSize + 2 * tileBorder;
+				tile.resize((size_t)stride * stride * 3);
+			}
+			else if (width != (int)header.faceSize || height != (int)header.faceSize) {
+				std::cerr << path << " is not " << header.faceSize << "x" << header.faceSize << std::endl;
+				delete[] image;
+				return false;
+			}
+			std::vector<unsigned char> level(image, image + (size_t)width * height * 3);
+			delete[] image;
+
+			int stride = tileSize + 2 * tileBorder;
+			for (uint32_t mip = 0; mip < header.levels; mip++) {
+				int size = (int)header.faceSize >> mip;
+				if (mip) level = halve(level, size * 2);
+				int pages = size / tileSize;
+				for (int pageY = 0; pageY < pages; pageY++) {
+					for (int pageX = 0; pageX < pages; pageX++) {
+						// The border repeats the neighbouring tiles' texels, clamped at the face's edges
+						for (int row = 0; row < stride; row++) {
+							int y = std::min(std::max(pageY * tileSize - (int)tileBorder + row, 0), size - 1);
+							for (int column = 0; column < stride; column++) {
+								int x = std::min(std::max(pageX * tileSize - (int)tileBorder + column, 0), size - 1);
+								memcpy(&tile[((size_t)row * stride + column) * 3], &level[((size_t)y * size + x) * 3], 3);
+							}
+						}
+						out.write((const char *)tile.data(), tile.size());
+					}
+				}
+			}
+		}
+	}
+	if (!out) {
+		std::cerr << "could not write " << outputPath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+VirtualCubemap::VirtualCubemap(UploadService & uploads)
+	: uploads(uploads)
+{
+	for (int i = 0; i < 12; i++) dirtyFaces[i] = false;
+}
+
+VirtualCubemap::~VirtualCubemap()
+{
+	{
+		std::lock_guard<std::mutex> guard(loadLock);
+		stopping = true;
+	}
+	loadWake.notify_all();
+	if (loader.joinable()) loader.join();
+	// Tiles not uploaded yet would land in a deleted or reused texture name. Those already
+	// uploaded still finish, their callbacks do nothing.
+	if (tiles) uploads.cancelTexture(tiles);
+	if (alive) *alive = false;
+	for (FeedbackFrame & frame : feedback) {
+		if (frame.fence) glDeleteSync(frame.fence);
+		glDeleteBuffers(1, &frame.buffer);
+	}
+	glDeleteTextures(1, &tiles);
+	glDeleteTextures(1, &pageTable);
+}
+
+bool VirtualCubemap::open(const std::string & path, long long wallTexels)
+{
+	if (tiles) {
+		std::cerr << "a virtual cubemap is already open" << std::endl;
+		return false;
+	}
+	if (!file.open(path.c_str())) {
+		std::cerr << "could not open " << path << std::endl;
+		return false;
+	}
+	const VirtualCubemapHeader & cooked = header();
+	if (file.size() < sizeof(VirtualCubemapHeader) || memcmp(cooked.magic, cookedMagic, 4) || cooked.version != cookedVersion
+		|| !cooked.tileSize || cooked.border >= cooked.tileSize || exactLog2(cooked.pagesPerSide) < 0
+		|| cooked.pagesPerSide > maxPagesPerSide || cooked.levels != (uint32_t)exactLog2(cooked.pagesPerSide) + 1) {
+		std::cerr << path << " is not a virtual cubemap" << std::endl;
+		file.close();
+		return false;
+	}
+	tileStride = cooked.tileSize + 2 * cooked.border;
+	tileBytes = (size_t)tileStride * tileStride * 3;
+	tilesPerFace = tileIndex(cooked.levels, 0, 0);
+	if (file.size() != sizeof(VirtualCubemapHeader) + (size_t)12 * tilesPerFace * tileBytes) {
+		std::cerr << path << " is truncated" << std::endl;
+		file.close();
+		return false;
+	}
+
+	// A wall texel takes about one texel of the level it samples, the tiles it touches are
+	// rarely covered completely, and the coarser levels kept as fallbacks add a third
+	long long tileTexels = (long long)cooked.tileSize * cooked.tileSize;
+	long long sized = 2 * (wallTexels * 2 * 4 / 3 / tileTexels) + 12;
+	GLint maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	int capacity = (int)std::min(std::min(sized, (long long)maxLayers), (long long)12 * tilesPerFace);
+	capacity = std::max(capacity, std::min(12 * tilesPerFace, 24));
+	slots.assign(capacity, Slot());
+
+	glGenTextures(1, &tiles);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tiles);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, tileStride, tileStride, capacity, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// The coarsest tile of every eye and face, pinned so every page has a fallback
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	int coarsest = cooked.levels - 1;
+	for (int eyeFace = 0; eyeFace < 12; eyeFace++) {
+		tileSlots[eyeFace].assign(tilesPerFace, -1);
+		pageEntries[eyeFace].assign((size_t)tilesPerFace * 2, 0);
+		uint32_t key = tileKey(eyeFace / 6, eyeFace % 6, coarsest, 0, 0);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, eyeFace, tileStride, tileStride, 1, GL_RGB, GL_UNSIGNED_BYTE,
+			file.data() + tileOffset(key));
+		RenderStats::upload((long long)tileBytes);
+		slots[eyeFace].key = key;
+		slots[eyeFace].state = SLOT_RESIDENT;
+		slots[eyeFace].pinned = true;
+		tileSlots[eyeFace][tileIndex(coarsest, 0, 0)] = eyeFace;
+		resident++;
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Integer texels, so looked up with texelFetch; one level per tile level
+	glGenTextures(1, &pageTable);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+	for (int level = 0; level < (int)cooked.levels; level++) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RG16UI, pagesAt(level), pagesAt(level), 12, 0, GL_RG_INTEGER, GL_UNSIGNED_SHORT, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, coarsest);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	for (int eyeFace = 0; eyeFace < 12; eyeFace++) updatePageTable(eyeFace);
+
+	for (FeedbackFrame & frame : feedback) {
+		glGenBuffers(1, &frame.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, frame.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, feedbackBytes, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	alive = std::make_shared<bool>(true);
+	loader = std::thread(&VirtualCubemap::loaderLoop, this);
+	return true;
+}
+
+void VirtualCubemap::bind(GLuint program, int firstUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + firstUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+	glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tiles);
+	glActiveTexture(GL_TEXTURE0);
+	RenderStats::texture(2);
+	glUniform1i(glGetUniformLocation(program, "pageTable"), firstUnit);
+	glUniform1i(glGetUniformLocation(program, "tiles"), firstUnit + 1);
+	glUniform1i(glGetUniformLocation(program, "pagesPerSide"), header().pagesPerSide);
+	glUniform1i(glGetUniformLocation(program, "levels"), header().levels);
+	glUniform1i(glGetUniformLocation(program, "tileSize"), header().tileSize);
+	glUniform1i(glGetUniformLocation(program, "tileStride"), tileStride);
+}
+
+void VirtualCubemap::setFeedback(GLuint program, bool feedback, float lodBias)
+{
+	glUniform1i(glGetUniformLocation(program, "feedback"), feedback);
+	glUniform1f(glGetUniformLocation(program, "lodBias"), lodBias);
+}
+
+void VirtualCubemap::readFeedback(GLuint texture, int size)
+{
+	FeedbackFrame & target = feedback[feedbackWrite];
+	size_t bytes = (size_t)size * size * 4;
+	if (target.fence || target.used + bytes > feedbackBytes) return;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, target.buffer);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void *)target.used);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	target.used += bytes;
+}
+
+void VirtualCubemap::update()
+{
+	frame++;
+	FeedbackFrame & written = feedback[feedbackWrite];
+	if (written.used && !written.fence) {
+		written.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		feedbackWrite = (feedbackWrite + 1) % feedbackFrameCount;
+	}
+	// Oldest first, never waiting for a copy still in flight
+	for (int i = 0; i < feedbackFrameCount; i++) {
+		FeedbackFrame & ready = feedback[(feedbackWrite + i) % feedbackFrameCount];
+		if (!ready.fence) continue;
+		GLenum status = glClientWaitSync(ready.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+		glDeleteSync(ready.fence);
+		ready.fence = 0;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ready.buffer);
+		const unsigned char * texels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, ready.used, GL_MAP_READ_BIT);
+		if (texels) {
+			parseFeedback(texels, ready.used / 4);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		ready.used = 0;
+		feedbackFrames++;
+	}
+	requestTiles();
+	for (int eyeFace = 0; eyeFace < 12; eyeFace++) {
+		if (dirtyFaces[eyeFace]) updatePageTable(eyeFace);
+	}
+}
+
+size_t VirtualCubemap::allocatedBytes() const
+{
+	if (!tiles) return 0;
+	return slots.size() * tileBytes + (size_t)12 * tilesPerFace * 4;
+}
+
+size_t VirtualCubemap::fullBytes() const
+{
+	if (!tiles) return 0;
+	size_t face = (size_t)header().faceSize * header().faceSize * 3;
+	return 12 * (face + face / 3);
+}
+
+uint32_t VirtualCubemap::tileKey(int eye, int face, int level, int x, int y)
+{
+	return (uint32_t)eye << 31 | (uint32_t)face << 28 | (uint32_t)level << 24 | (uint32_t)y << 12 | (uint32_t)x;
+}
+
+int VirtualCubemap::tileIndex(int level, int x, int y) const
+{
+	int index = 0;
+	for (int finer = 0; finer < level; finer++) index += pagesAt(finer) * pagesAt(finer);
+	return index + y * pagesAt(level) + x;
+}
+
+size_t VirtualCubemap::tileOffset(uint32_t key) const
+{
+	int eyeFace = (key >> 31) * 6 + ((key >> 28) & 7);
+	int index = tileIndex((key >> 24) & 15, key & 0xfff, (key >> 12) & 0xfff);
+	return sizeof(VirtualCubemapHeader) + ((size_t)eyeFace * tilesPerFace + index) * tileBytes;
+}
+
+void VirtualCubemap::parseFeedback(const unsigned char * texels, size_t count)
+{
+	int levels = header().levels;
+	uint32_t last = 0xffffffff;
+	for (size_t i = 0; i < count; i++, texels += 4) {
+		// Cleared texels saw no sky
+		if (texels[3] != 255) continue;
+		int x = texels[0], y = texels[1];
+		int level = texels[2] & 15, face = (texels[2] >> 4) & 7, eye = texels[2] >> 7;
+		if (level >= levels || face >= 6 || x >= pagesAt(level) || y >= pagesAt(level)) continue;
+		// Neighbouring texels mostly want the same page
+		uint32_t key = tileKey(eye, face, level, x, y);
+		if (key == last) continue;
+		last = key;
+		// The tile and the coarser ones holding it, which serve it until it arrives
+		std::vector<int> & faceSlots = tileSlots[eye * 6 + face];
+		for (; level < levels; level++, x /= 2, y /= 2) {
+			int slot = faceSlots[tileIndex(level, x, y)];
+			if (slot < 0) wanted.push_back(tileKey(eye, face, level, x, y));
+			else slots[slot].lastUsed = frame;
+		}
+	}
+}
+
+void VirtualCubemap::requestTiles()
+{
+	if (wanted.empty()) return;
+	// Coarse levels first, they cover the most and every finer one falls back to them
+	std::sort(wanted.begin(), wanted.end(), [](uint32_t a, uint32_t b) {
+		int levelA = (a >> 24) & 15, levelB = (b >> 24) & 15;
+		return levelA != levelB ? levelA > levelB : a < b;
+	});
+	wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+	int issued = 0;
+	{
+		std::lock_guard<std::mutex> guard(loadLock);
+		for (uint32_t key : wanted) {
+			if (issued == maxRequestsPerFrame) break;
+			int & tileSlot = tileSlots[(key >> 31) * 6 + ((key >> 28) & 7)][tileIndex((key >> 24) & 15, key & 0xfff, (key >> 12) & 0xfff)];
+			if (tileSlot >= 0) continue;
+			int slot = freeSlot();
+			if (slot < 0) {
+				cacheFull++;
+				break;
+			}
+			slots[slot].key = key;
+			slots[slot].state = SLOT_LOADING;
+			slots[slot].lastUsed = frame;
+			tileSlot = slot;
+			Load load = { key, slot };
+			loads.push_back(load);
+			requested++;
+			issued++;
+		}
+	}
+	wanted.clear();
+	if (issued) loadWake.notify_one();
+}
+
+int VirtualCubemap::freeSlot()
+{
+	int oldest = -1;
+	for (int slot = 0; slot < (int)slots.size(); slot++) {
+		const Slot & candidate = slots[slot];
+		if (candidate.state == SLOT_FREE) return slot;
+		if (candidate.state != SLOT_RESIDENT || candidate.pinned || candidate.lastUsed >= frame) continue;
+		if (oldest < 0 || candidate.lastUsed < slots[oldest].lastUsed) oldest = slot;
+	}
+	if (oldest < 0) return -1;
+	// The page table stops pointing at it before the new tile is uploaded over it
+	uint32_t key = slots[oldest].key;
+	int eyeFace = (key >> 31) * 6 + ((key >> 28) & 7);
+	tileSlots[eyeFace][tileIndex((key >> 24) & 15, key & 0xfff, (key >> 12) & 0xfff)] = -1;
+	dirtyFaces[eyeFace] = true;
+	slots[oldest].state = SLOT_FREE;
+	resident--;
+	evictions++;
+	return oldest;
+}
+
+void VirtualCubemap::tileArrived(int slot, uint32_t key)
+{
+	slots[slot].state = SLOT_RESIDENT;
+	resident++;
+	loaded++;
+	dirtyFaces[(key >> 31) * 6 + ((key >> 28) & 7)] = true;
+}
+
+void VirtualCubemap::tileFailed(int slot, uint32_t key)
+{
+	int eyeFace = (key >> 31) * 6 + ((key >> 28) & 7);
+	tileSlots[eyeFace][tileIndex((key >> 24) & 15, key & 0xfff, (key >> 12) & 0xfff)] = -1;
+	slots[slot].state = SLOT_FREE;
+}
+
+void VirtualCubemap::updatePageTable(int eyeFace)
+{
+	// Coarse to fine, a page without a resident tile takes the entry of the page above it
+	std::vector<int> & faceSlots = tileSlots[eyeFace];
+	std::vector<uint16_t> & entries = pageEntries[eyeFace];
+	glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int level = header().levels - 1; level >= 0; level--) {
+		int pages = pagesAt(level), first = tileIndex(level, 0, 0);
+		for (int y = 0; y < pages; y++) {
+			for (int x = 0; x < pages; x++) {
+				int index = first + y * pages + x;
+				int slot = faceSlots[index];
+				if (slot >= 0 && slots[slot].state == SLOT_RESIDENT) {
+					entries[index * 2] = (uint16_t)slot;
+					entries[index * 2 + 1] = (uint16_t)level;
+				}
+				else {
+					int parent = tileIndex(level + 1, x / 2, y / 2);
+					entries[index * 2] = entries[parent * 2];
+					entries[index * 2 + 1] = entries[parent * 2 + 1];
+				}
+			}
+		}
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, eyeFace, pages, pages, 1, GL_RG_INTEGER, GL_UNSIGNED_SHORT, &entries[first * 2]);
+		RenderStats::upload((long long)pages * pages * 4);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	dirtyFaces[eyeFace] = false;
+}
+
+void VirtualCubemap::loaderLoop()
+{
+	for (;;) {
+		Load load;
+		{
+			std::unique_lock<std::mutex> guard(loadLock);
+			loadWake.wait(guard, [this] { return stopping || !loads.empty(); });
+			if (stopping) return;
+			load = loads.front();
+			loads.pop_front();
+		}
+		// Reading the mapping pages the tile in from disk, here rather than on the GL thread
+		const unsigned char * bytes = file.data() + tileOffset(load.key);
+		std::vector<unsigned char> pixels(bytes, bytes + tileBytes);
+		UploadService::TextureRegion region = { GL_TEXTURE_2D_ARRAY, tiles, 0, load.slot,
+			tileStride, tileStride, GL_RGB, GL_UNSIGNED_BYTE, 3 };
+		std::shared_ptr<bool> open = alive;
+		bool queued = uploads.uploadTexture(region, std::move(pixels), [this, open, load] {
+			if (*open) tileArrived(load.slot, load.key);
+		});
+		if (!queued) {
+			// The slot is only touched on the GL thread, where the callbacks run
+			uploads.uploadTexture(region, std::vector<unsigned char>(), [this, open, load] {
+				if (*open) tileFailed(load.slot, load.key);
+			});
+		}
+	}
+}
@@ -0,0 +1,164 @@
+#ifndef _VIRTUAL_CUBEMAP_H_
+#define _VIRTUAL_CUBEMAP_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileIO.h"
+#include "UploadService.h"
+
+// Tiled layout of a stereo cubemap on disk, written by cookVirtualCubemap:
+//   VirtualCubemapHeader
+//   tiles of eye 0 face 0 level 0 row by row, then its coarser levels, then face 1 ...
+// Every level halves the last down to a single tile per face. A tile is tileStride
+// square RGB texels: tileSize of its own with a border of its neighbours' around it,
+// so bilinear filtering never reads outside the tile.
+struct VirtualCubemapHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t faceSize, tileSize, border;
+	// Pages along a face at level 0, levels down to one page
+	uint32_t pagesPerSide, levels;
+	uint32_t reserved;
+};
+
+// Cooks the face PPMs in leftDirectory and rightDirectory, named as for
+// Skybox::loadCubemap, into a tiled file. Faces must be square and of the same size,
+// tileSize times a power of two of at most 256. False with a message on failure.
+bool cookVirtualCubemap(const std::string & leftDirectory, const std::string & rightDirectory,
+	const std::string & outputPath, int tileSize = 128);
+
+// A stereo cubemap far larger than VRAM, sampled through a page table. Only tiles the
+// walls have asked for are resident, in a physical cache of one tile per layer of an
+// array texture; the page table of each eye and face maps a page of each level to the
+// tile holding it, or to the nearest coarser resident tile. The single tile of each
+// face's coarsest level stays resident, so every lookup finds something.
+//
+// Feedback passes render the sky at low resolution into RGBA8 targets, writing the
+// page each texel would sample (see skybox_virtual.frag), and readFeedback copies them
+// into a pixel buffer. update() reads them back a frame or two later, once the copies
+// are done, and requests what is missing, coarse levels first. A loader thread reads
+// the tiles from the mapped file and hands them to the upload service; the page table
+// points at a tile once it has arrived. When the cache is full the tile used the
+// longest ago makes room.
+class VirtualCubemap
+{
+public:
+	// uploads must outlive this and have update() called every frame
+	explicit VirtualCubemap(UploadService & uploads);
+	~VirtualCubemap();
+	VirtualCubemap(const VirtualCubemap &) = delete;
+	VirtualCubemap & operator=(const VirtualCubemap &) = delete;
+
+	// Maps a cooked file and creates a cache sized for walls of wallTexels texels per eye:
+	// about as many texels as the walls show, with room for the coarser levels, as far as
+	// GL allows array layers
+	bool open(const std::string & path, long long wallTexels);
+
+	// The page table and the tiles on units firstUnit and firstUnit + 1, and the layout
+	// uniforms of the skybox_virtual.frag program
+	void bind(GLuint program, int firstUnit = 2);
+	// Switches the program to writing pages for a target lodBias levels finer than the
+	// one the feedback pass renders
+	static void setFeedback(GLuint program, bool feedback, float lodBias);
+	// Queues a copy of a feedback target of size x size for the next update(). Skipped
+	// while the GPU is still copying an earlier frame's.
+	void readFeedback(GLuint texture, int size);
+
+	// Once per frame on the GL thread
+	void update();
+
+	const VirtualCubemapHeader & header() const { return *(const VirtualCubemapHeader *)file.data(); }
+	int capacity() const { return (int)slots.size(); }
+	int residentCount() const { return resident; }
+	// Of the tile cache and the page tables, and of the cubemap with all its mips in VRAM
+	size_t allocatedBytes() const;
+	size_t fullBytes() const;
+
+	// Tiles requested per update(), the rest wait for the next feedback
+	int maxRequestsPerFrame = 64;
+
+	long long requested = 0, loaded = 0, evictions = 0, cacheFull = 0, feedbackFrames = 0;
+
+private:
+	enum SlotState { SLOT_FREE, SLOT_LOADING, SLOT_RESIDENT };
+	struct Slot {
+		uint32_t key = 0;
+		SlotState state = SLOT_FREE;
+		bool pinned = false;
+		long long lastUsed = 0;
+	};
+	struct Load {
+		uint32_t key;
+		int slot;
+	};
+	// Copies of one frame's feedback targets into a pixel buffer
+	struct FeedbackFrame {
+		GLuint buffer = 0;
+		GLsync fence = 0;
+		size_t used = 0;
+	};
+
+	// eye 1 bit, face 3, level 4, y 12, x 12
+	static uint32_t tileKey(int eye, int face, int level, int x, int y);
+	// Index of a tile among the tiles of its eye and face, level by level, row by row
+	int tileIndex(int level, int x, int y) const;
+	size_t tileOffset(uint32_t key) const;
+	int pagesAt(int level) const { return std::max((int)header().pagesPerSide >> level, 1); }
+
+	void parseFeedback(const unsigned char * texels, size_t count);
+	void requestTiles();
+	// A free slot, or the one used the longest ago not used by the last feedback. -1 if
+	// every slot is busy.
+	int freeSlot();
+	void tileArrived(int slot, uint32_t key);
+	// Frees the slot of a tile that could not be uploaded
+	void tileFailed(int slot, uint32_t key);
+	void updatePageTable(int eyeFace);
+	void loaderLoop();
+
+	UploadService & uploads;
+	MappedFile file;
+	size_t tileBytes = 0;
+	int tileStride = 0, tilesPerFace = 0;
+	GLuint pageTable = 0, tiles = 0;
+
+	std::vector<Slot> slots;
+	int resident = 0;
+	long long frame = 0;
+	// Per eye and face, by tileIndex: the slot loading or holding the tile, -1 for none
+	std::vector<int> tileSlots[12];
+	// Per eye and face, by tileIndex: slot and level of the tile serving each page
+	std::vector<uint16_t> pageEntries[12];
+	bool dirtyFaces[12];
+	// Tiles the feedback asked for since the last requests
+	std::vector<uint32_t> wanted;
+
+	static const int feedbackFrameCount = 3;
+	static const size_t feedbackBytes = 1 << 20;
+	FeedbackFrame feedback[feedbackFrameCount];
+	int feedbackWrite = 0;
+
+	std::thread loader;
+	std::mutex loadLock;
+	std::condition_variable loadWake;
+	std::deque<Load> loads;
+	bool stopping = false;
+	// Cleared on destruction, upload callbacks still queued check it
+	std::shared_ptr<bool> alive;
+};
+
+#endif
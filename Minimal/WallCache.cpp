@@ -0,0 +1,214 @@
+#include "WallCache.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cmath>
+
+WallCache::WallCache(GLuint program, int size, size_t budgetBytes)
+	: program(program), wallSize(size)
+{
+	if (glfwExtensionSupported("GL_EXT_texture_compression_s3tc")) {
+		// 4 bits per texel, the driver compresses what is copied in
+		format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		bytesPerLayer = (size_t)size * size / 2;
+	}
+	else {
+		format = GL_RGBA8;
+		bytesPerLayer = (size_t)size * size * 4;
+	}
+	GLint maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	maxEntries = (int)std::min(budgetBytes / (bytesPerLayer * 3), (size_t)maxLayers / 3);
+	maxEntries = std::max(maxEntries, 1);
+	canGrow = glfwExtensionSupported("GL_ARB_copy_image") != 0;
+
+	// The blend draws one triangle covering the target, placed by gl_VertexID alone
+	glGenVertexArrays(1, &VAO);
+}
+
+WallCache::~WallCache()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteTextures(1, &array);
+	glDeleteBuffers(1, &pixelBuffer);
+}
+
+void WallCache::setContent(uint64_t signature)
+{
+	if (signature == content) return;
+	clear();
+	content = signature;
+}
+
+void WallCache::clear()
+{
+	index.clear();
+	entries.clear();
+}
+
+bool WallCache::lookup(int eye, const glm::vec3 & eyePos, Blend & blend)
+{
+	glm::ivec3 base;
+	glm::vec3 fraction;
+	if (!locate(eyePos, base, fraction)) {
+		misses++;
+		return false;
+	}
+	blend.corners = 0;
+	float total = 0.0f;
+	int used[8];
+	for (int corner = 0; corner < 8; corner++) {
+		glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+		glm::vec3 axis = glm::mix(glm::vec3(1.0f) - fraction, fraction, glm::vec3(offset));
+		float weight = axis.x * axis.y * axis.z;
+		// On a face or grid point the corners across it are not needed
+		if (weight < 1e-4f) continue;
+		auto found = index.find(key(eye, base + offset));
+		if (found == index.end()) {
+			misses++;
+			return false;
+		}
+		used[blend.corners] = found->second;
+		blend.layers[blend.corners] = found->second * 3;
+		blend.weights[blend.corners] = weight;
+		blend.corners++;
+		total += weight;
+	}
+	for (int i = 0; i < blend.corners; i++) {
+		blend.weights[i] /= total;
+		entries[used[i]].lastUsed = ++useClock;
+	}
+	hits++;
+	return true;
+}
+
+bool WallCache::nextFill(int eye, const glm::vec3 & eyePos, glm::vec3 & point) const
+{
+	glm::ivec3 base;
+	glm::vec3 fraction;
+	if (!locate(eyePos, base, fraction)) return false;
+	float nearest = 0.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+		glm::vec3 axis = glm::mix(glm::vec3(1.0f) - fraction, fraction, glm::vec3(offset));
+		float weight = axis.x * axis.y * axis.z;
+		if (weight < 1e-4f || weight <= nearest || index.count(key(eye, base + offset))) continue;
+		nearest = weight;
+		point = regionMin + glm::vec3(base + offset) * cellSize;
+	}
+	return nearest > 0.0f;
+}
+
+void WallCache::store(int eye, const glm::vec3 & point, const GLuint walls[3])
+{
+	uint64_t pointKey = key(eye, gridPoint(point));
+	int slot;
+	auto found = index.find(pointKey);
+	if (found != index.end()) {
+		slot = found->second;
+	}
+	else if ((int)entries.size() < maxEntries) {
+		slot = (int)entries.size();
+		entries.push_back(Entry());
+		if (slot >= allocatedEntries) grow(canGrow ? std::min(std::max(allocatedEntries * 2, 8), maxEntries) : maxEntries);
+	}
+	else {
+		slot = 0;
+		for (int i = 1; i < (int)entries.size(); i++) {
+			if (entries[i].lastUsed < entries[slot].lastUsed) slot = i;
+		}
+		index.erase(entries[slot].key);
+		evictions++;
+	}
+	entries[slot].key = pointKey;
+	entries[slot].lastUsed = ++useClock;
+	index[pointKey] = slot;
+
+	// Read back into the buffer and copy from there, compressing on the way in
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	for (int wall = 0; wall < 3; wall++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+		glBindTexture(GL_TEXTURE_2D, walls[wall]);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot * 3 + wall, wallSize, wallSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		RenderStats::upload((long long)wallSize * wallSize * 4);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	fills++;
+}
+
+void WallCache::draw(const Blend & blend, int wall)
+{
+	glUseProgram(program);
+	RenderStats::program(program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	RenderStats::texture();
+	glUniform1i(glGetUniformLocation(program, "entries"), 0);
+	glUniform1i(glGetUniformLocation(program, "wall"), wall);
+	glUniform1i(glGetUniformLocation(program, "corners"), blend.corners);
+	glUniform1iv(glGetUniformLocation(program, "layers"), blend.corners, blend.layers);
+	glUniform1fv(glGetUniformLocation(program, "weights"), blend.corners, blend.weights);
+	glBindVertexArray(VAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	RenderStats::draw();
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+size_t WallCache::allocatedBytes() const
+{
+	return (size_t)allocatedEntries * 3 * bytesPerLayer;
+}
+
+bool WallCache::locate(const glm::vec3 & eyePos, glm::ivec3 & base, glm::vec3 & fraction) const
+{
+	glm::vec3 grid = (eyePos - regionMin) / cellSize;
+	glm::ivec3 cells = glm::ivec3(glm::ceil((regionMax - regionMin) / cellSize - 1e-4f));
+	for (int axis = 0; axis < 3; axis++) {
+		if (grid[axis] < 0.0f || grid[axis] > (float)cells[axis]) return false;
+		base[axis] = std::min((int)std::floor(grid[axis]), cells[axis] - 1);
+		fraction[axis] = grid[axis] - base[axis];
+	}
+	return true;
+}
+
+uint64_t WallCache::key(int eye, const glm::ivec3 & point) const
+{
+	return (uint64_t)eye << 60 | (uint64_t)point.x << 40 | (uint64_t)point.y << 20 | (uint64_t)point.z;
+}
+
+glm::ivec3 WallCache::gridPoint(const glm::vec3 & position) const
+{
+	return glm::ivec3(glm::floor((position - regionMin) / cellSize + 0.5f));
+}
+
+void WallCache::grow(int count)
+{
+	GLuint grown;
+	glGenTextures(1, &grown);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, grown);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, wallSize, wallSize, count * 3, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	if (array) {
+		// Compressed blocks are copied as they are
+		glCopyImageSubData(array, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, grown, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+			wallSize, wallSize, allocatedEntries * 3);
+		glDeleteTextures(1, &array);
+	}
+	array = grown;
+	allocatedEntries = count;
+	if (pixelBuffer) return;
+
+	glGenBuffers(1, &pixelBuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)wallSize * wallSize * 4, NULL, GL_STREAM_COPY);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
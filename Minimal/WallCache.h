@@ -0,0 +1,103 @@
+#ifndef _WALL_CACHE_H_
+#define _WALL_CACHE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Wall images of a static scene keyed by the CAVE viewer's eye position. Eye
+// positions inside a region are quantized to a grid; the three walls of an eye seen
+// from a grid point are one entry, rendered at size x size and stored as three layers
+// of one array texture, DXT1 compressed where GL_EXT_texture_compression_s3tc is
+// available. Entries take at most budgetBytes, the least recently used one makes room.
+// The array grows with the entries where GL_ARB_copy_image can carry them over,
+// otherwise the whole budget is allocated with the first entry.
+//
+// A frame whose eye position has all eight grid points of its cell cached blends their
+// walls with trilinear weights instead of rendering them. Anywhere else the walls are
+// rendered for real, and the caller fills a missing grid point now and then.
+class WallCache
+{
+public:
+	// The entries around an eye position and their weights, corners of no weight are skipped
+	struct Blend {
+		int layers[8];
+		float weights[8];
+		int corners;
+	};
+
+	// program is the wallcache.vert/wallcache.frag program
+	WallCache(GLuint program, int size = 1024, size_t budgetBytes = 512 << 20);
+	~WallCache();
+	WallCache(const WallCache &) = delete;
+	WallCache & operator=(const WallCache &) = delete;
+
+	// The grid, read on every lookup; clear() after changing it
+	glm::vec3 regionMin = glm::vec3(-0.5f, -0.5f, -0.5f), regionMax = glm::vec3(0.5f, 0.5f, 0.5f);
+	float cellSize = 0.05f;
+
+	// Drops every entry when signature differs from the one they were made with, so
+	// anything that changes what the walls show invalidates the cache
+	void setContent(uint64_t signature);
+	void clear();
+
+	// True, counted as a hit, when eyePos is in the region and the grid points around it
+	// are cached for eye
+	bool lookup(int eye, const glm::vec3 & eyePos, Blend & blend);
+	// The grid point around eyePos nearest to it that is not cached yet, false outside the
+	// region or when all are
+	bool nextFill(int eye, const glm::vec3 & eyePos, glm::vec3 & point) const;
+	// Copies three size x size wall textures, left, right and bottom, into the entry of
+	// point. The copy stays on the GPU, through a pixel buffer.
+	void store(int eye, const glm::vec3 & point, const GLuint walls[3]);
+	// One wall of the blend into the current framebuffer, which it covers completely
+	void draw(const Blend & blend, int wall);
+
+	int size() const { return wallSize; }
+	bool compressed() const { return format != GL_RGBA8; }
+	int entryCount() const { return (int)entries.size(); }
+	int capacity() const { return maxEntries; }
+	// Of the array texture as far as it has grown, and at most
+	size_t allocatedBytes() const;
+	size_t budgetBytes() const { return (size_t)maxEntries * 3 * bytesPerLayer; }
+
+	long long hits = 0, misses = 0, fills = 0, evictions = 0;
+
+private:
+	struct Entry {
+		uint64_t key;
+		unsigned long long lastUsed;
+	};
+
+	// false outside the region; base is the cell's lowest grid point, weights along each axis
+	bool locate(const glm::vec3 & eyePos, glm::ivec3 & base, glm::vec3 & fraction) const;
+	uint64_t key(int eye, const glm::ivec3 & point) const;
+	glm::ivec3 gridPoint(const glm::vec3 & position) const;
+	// Makes room for count entries, keeping the ones stored
+	void grow(int count);
+
+	GLuint program, array = 0, pixelBuffer = 0, VAO;
+	GLenum format;
+	int wallSize, maxEntries, allocatedEntries = 0;
+	bool canGrow;
+	size_t bytesPerLayer;
+	// The grid point of an entry to its index, entries[i] is layers 3i to 3i + 2
+	std::unordered_map<uint64_t, int> index;
+	std::vector<Entry> entries;
+	unsigned long long useClock = 0;
+	uint64_t content = 0;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#version 330 core
+
+in vec2 UV;
+flat in int wall;
+
+out vec3 color;
+
+// Every wall is a layer, the walls of the current eye start at firstLayer
+uniform sampler2DArray walls;
+uniform int firstLayer;
+
+void main()
+{
+    color = texture(walls, vec3(UV, firstLayer + wall)).rgb;
+}
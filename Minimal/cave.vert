@@ -0,0 +1,23 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+// 0 left, 1 right, 2 bottom
+layout (location = 2) in int wallIndex;
+
+uniform mat4 projection;
+uniform mat4 model;
+uniform mat4 view;
+
+out vec2 UV;
+flat out int wall;
+// For sampling the walls by direction, see cave_cubemap.frag
+out vec3 worldPosition;
+
+void main()
+{
+    gl_Position = projection * model * view * vec4(position, 1.0);
+    UV = vertexUV;
+    wall = wallIndex;
+    worldPosition = (view * vec4(position, 1.0)).xyz;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 UV;
+flat in int wall;
+in vec3 worldPosition;
+
+out vec3 color;
+
+// The scene around the CAVE viewer's eye, rendered once for all walls
+uniform samplerCube viewCubemap;
+uniform vec3 cubemapCenter;
+
+void main()
+{
+    color = texture(viewCubemap, worldPosition - cubemapCenter).rgb;
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+in vec2 UV;
+flat in int wall;
+
+out vec3 color;
+
+// The walls at reduced density, one layer each
+uniform sampler2DArray walls;
+// Full density around the gaze point, covering insetRect of wall insetWall
+uniform sampler2D insetSampler;
+uniform int insetWall;
+uniform vec4 insetRect;
+// Width of the seam in wall UV units, the inset fades in over it
+uniform float insetBlend;
+
+void main()
+{
+    color = texture(walls, vec3(UV, wall)).rgb;
+    if (wall != insetWall) return;
+    vec2 edge = min(UV - insetRect.xy, insetRect.zw - UV);
+    float weight = smoothstep(0.0, insetBlend, min(edge.x, edge.y));
+    if (weight > 0.0) {
+        vec2 insetUV = (UV - insetRect.xy) / (insetRect.zw - insetRect.xy);
+        color = mix(color, texture(insetSampler, insetUV).rgb, weight);
+    }
+}
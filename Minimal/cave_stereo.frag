@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec2 UV;
+flat in int stereoEye;
+flat in int wall;
+
+out vec3 color;
+
+// Every eye sees the walls rendered for its own position, the right eye's start at
+// rightEyeLayer (0 when both eyes share one set)
+uniform sampler2DArray walls;
+uniform int rightEyeLayer;
+
+void main()
+{
+    color = texture(walls, vec3(UV, stereoEye * rightEyeLayer + wall)).rgb;
+}
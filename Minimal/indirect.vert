@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+// Per instance, the object this instance draws
+layout (location = 2) in int objectId;
+
+uniform mat4 projection;
+uniform mat4 model;
+// Five texels per object, the first four are its toWorld
+uniform samplerBuffer objects;
+
+out vec2 UV;
+
+void main()
+{
+	int base = objectId * 5;
+	mat4 view = mat4(texelFetch(objects, base), texelFetch(objects, base + 1),
+		texelFetch(objects, base + 2), texelFetch(objects, base + 3));
+	gl_Position = projection * model * view * vec4(position.x, position.y, position.z, 1.0);
+	UV = vertexUV;
+}
@@ -0,0 +1,9 @@
+#version 330 core
+
+// Only the depth of the lens mask matters, color writes are masked off
+out vec3 color;
+
+void main()
+{
+    color = vec3(0.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+// Hidden area of the lens, already in normalized device coordinates
+layout (location = 0) in vec2 position;
+
+void main()
+{
+    // On the near plane, so everything drawn later in the eye pass fails the depth test
+    gl_Position = vec4(position, -1.0, 1.0);
+}
@@ -137,17 +137,13 @@ bool checkGlError() {
 	}
 }
 
-void glDebugCallbackHandler(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *msg, GLvoid* data) {
-	OutputDebugStringA(msg);
-	std::cout << "debug call: " << msg << std::endl;
-}
-
 //////////////////////////////////////////////////////////////////////
 //
 // GLFW provides cross platform window creation
 //
 
 #include <GLFW/glfw3.h>
+#include "GlDebugLog.h"
 
 namespace glfw {
 	inline GLFWwindow * createWindow(const uvec2 & size, const ivec2 & position = ivec2(INT_MIN)) {
@@ -170,6 +166,8 @@ protected:
 	ivec2 windowPosition;
 	GLFWwindow * window{ nullptr };
 	unsigned int frame{ 0 };
+	// Driver messages on a debug context, the G key prints their counts
+	std::unique_ptr<GlDebugLog> debugLog;
 
 public:
 	GlfwApp() {
@@ -203,6 +201,8 @@ public:
 
 		while (!glfwWindowShouldClose(window)) {
 			++frame;
+			if (debugLog) debugLog->beginFrame(frame);
+			beginFrame();
 			glfwPollEvents();
 			update();
 			draw();
@@ -210,6 +210,7 @@ public:
 		}
 
 		shutdownGl();
+		if (debugLog) debugLog->printSummary(std::cout);
 
 		return 0;
 	}
@@ -244,12 +245,9 @@ protected:
 		}
 		glGetError();
 
-		if (GLEW_KHR_debug) {
-			GLint v;
-			glGetIntegerv(GL_CONTEXT_FLAGS, &v);
-			if (v & GL_CONTEXT_FLAG_DEBUG_BIT) {
-				//glDebugMessageCallback(glDebugCallbackHandler, this);
-			}
+		if (!debugLog) {
+			debugLog = std::unique_ptr<GlDebugLog>(new GlDebugLog());
+			if (!debugLog->attach()) debugLog.reset();
 		}
 	}
 
@@ -259,6 +257,10 @@ protected:
 	virtual void shutdownGl() {
 	}
 
+	// Called before the input of a frame is read
+	virtual void beginFrame() {
+	}
+
 	virtual void finishFrame() {
 		glfwSwapBuffers(window);
 	}
@@ -278,6 +280,9 @@ protected:
 		case GLFW_KEY_ESCAPE:
 			glfwSetWindowShouldClose(window, 1);
 			return;
+		case GLFW_KEY_G:
+			if (debugLog) debugLog->printSummary(std::cout);
+			return;
 		}
 	}
 
@@ -315,86 +320,19 @@ private:
 #include <OVR_CAPI.h>
 #include <OVR_CAPI_GL.h>
 
-namespace ovr {
-
-	// Convenience method for looping over each eye with a lambda
-	template <typename Function>
-	inline void for_each_eye(Function function) {
-		for (ovrEyeType eye = ovrEyeType::ovrEye_Left;
-			eye < ovrEyeType::ovrEye_Count;
-			eye = static_cast<ovrEyeType>(eye + 1)) {
-			function(eye);
-		}
-	}
-
-	inline mat4 toGlm(const ovrMatrix4f & om) {
-		return glm::transpose(glm::make_mat4(&om.M[0][0]));
-	}
-
-	inline mat4 toGlm(const ovrFovPort & fovport, float nearPlane = 0.01f, float farPlane = 10000.0f) {
-		return toGlm(ovrMatrix4f_Projection(fovport, nearPlane, farPlane, true));
-	}
-
-	inline vec3 toGlm(const ovrVector3f & ov) {
-		return glm::make_vec3(&ov.x);
-	}
-
-	inline vec2 toGlm(const ovrVector2f & ov) {
-		return glm::make_vec2(&ov.x);
-	}
-
-	inline uvec2 toGlm(const ovrSizei & ov) {
-		return uvec2(ov.w, ov.h);
-	}
-
-	inline quat toGlm(const ovrQuatf & oq) {
-		return glm::make_quat(&oq.x);
-	}
-
-	inline mat4 toGlm(const ovrPosef & op) {
-		mat4 orientation = glm::mat4_cast(toGlm(op.Orientation));
-		mat4 translation = glm::translate(mat4(), ovr::toGlm(op.Position));
-		return translation * orientation;
-	}
-
-	inline ovrMatrix4f fromGlm(const mat4 & m) {
-		ovrMatrix4f result;
-		mat4 transposed(glm::transpose(m));
-		memcpy(result.M, &(transposed[0][0]), sizeof(float) * 16);
-		return result;
-	}
-
-	inline ovrVector3f fromGlm(const vec3 & v) {
-		ovrVector3f result;
-		result.x = v.x;
-		result.y = v.y;
-		result.z = v.z;
-		return result;
-	}
-
-	inline ovrVector2f fromGlm(const vec2 & v) {
-		ovrVector2f result;
-		result.x = v.x;
-		result.y = v.y;
-		return result;
-	}
-
-	inline ovrSizei fromGlm(const uvec2 & v) {
-		ovrSizei result;
-		result.w = v.x;
-		result.h = v.y;
-		return result;
-	}
+#include "OvrGlm.h"
+#include "PoseBatch.h"
+#include "FramePacer.h"
+#include "LensMask.h"
+#include "StageTimer.h"
+#include "Hud.h"
+#include "RenderStats.h"
+#include "Shader.h"
 
-	inline ovrQuatf fromGlm(const quat & q) {
-		ovrQuatf result;
-		result.x = q.x;
-		result.y = q.y;
-		result.z = q.z;
-		result.w = q.w;
-		return result;
-	}
-}
+#define LENS_MASK_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/lensmask.vert"
+#define LENS_MASK_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/lensmask.frag"
+#define HUD_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/hud.vert"
+#define HUD_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/hud.frag"
 
 class RiftManagerApp {
 protected:
@@ -440,9 +378,33 @@ private:
 
 	float defaultHmdToEyeOffset[2]; // 0.0294861
 
+	// Sleeps until the latest safe start of every frame instead of spinning into ovr_SubmitFrame
+	FramePacer _pacer;
+	// Index 0 without pacing, 1 with, compared with the P key
+	PacingStats _pacingStats[2];
+	double _frameStart{ 0.0 }, _lastFrameStart{ 0.0 }, _sleepSeconds{ 0.0 };
+	int _droppedFrames{ 0 };
+	// Whether initGl raised the timer resolution, so only a raised one is restored
+	bool _timerPeriodSet{ false };
+
+	// Depth only mask over the parts of each eye the lens hides, toggled with the L key
+	std::unique_ptr<LensMask> _lensMask;
+	GLuint _lensMaskProgram{ 0 };
+	bool _lensMaskEnabled{ true };
+	// The M key times the eye passes with the mask on every other frame, index 1 with it
+	std::unique_ptr<StageTimer> _eyeTimer;
+	int _maskFramesLeft{ 0 };
+	int _maskFrames[2];
+	double _maskGpuMs[2];
+	// Head locked stats overlay, shown while hudVisible()
+	std::unique_ptr<Hud> _hud;
+	// Draw calls and state changes of the frame, counted while the HUD shows them or
+	// for the one frame the N key prints
+	bool _printRenderStats{ false };
+
 public:
 
-	RiftApp() {
+	RiftApp() : _pacer(_hmdDesc.DisplayRefreshRate) {
 		using namespace ovr;
 		_viewScaleDesc.HmdSpaceToWorldScaleInMeters = 1.0f;
 
@@ -472,6 +434,12 @@ public:
 		_mirrorSize /= 2;
 	}
 
+	~RiftApp() {
+		if (_timerPeriodSet) {
+			timeEndPeriod(1);
+		}
+	}
+
 protected:
 	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
 		return glfw::createWindow(_mirrorSize);
@@ -482,6 +450,8 @@ protected:
 
 		// Disable the v-sync for buffer swap
 		glfwSwapInterval(0);
+		// 1 ms sleeps for the frame pacer, the default timer resolution is 15.6 ms
+		_timerPeriodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
 
 		ovrTextureSwapChainDesc desc = {};
 		desc.Type = ovrTexture_2D;
@@ -533,6 +503,33 @@ protected:
 			FAIL("Could not create mirror texture");
 		}
 		glGenFramebuffers(1, &_mirrorFbo);
+
+		_lensMaskProgram = LoadShaders(LENS_MASK_VERTEX_SHADER_PATH, LENS_MASK_FRAGMENT_SHADER_PATH);
+		_lensMask = std::unique_ptr<LensMask>(new LensMask());
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			_lensMask->build(eye, _sceneLayer.Fov[eye]);
+		});
+		_eyeTimer = std::unique_ptr<StageTimer>(new StageTimer(2));
+		_hud = std::unique_ptr<Hud>(new Hud(_session, LoadShaders(HUD_VERTEX_SHADER_PATH, HUD_FRAGMENT_SHADER_PATH)));
+	}
+
+	void drawLensMask(ovrEyeType eye) {
+		glUseProgram(_lensMaskProgram);
+		RenderStats::program(_lensMaskProgram);
+		_lensMask->draw(eye);
+	}
+
+	void reportLensMask() {
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			const ovrSizei & size = _sceneLayer.Viewport[eye].Size;
+			float fraction = _lensMask->hiddenFraction(eye);
+			std::cout << "lens mask eye " << eye << ": " << fraction * 100.0f << "% hidden, "
+				<< (int)(fraction * size.w * size.h) << " of " << size.w * size.h << " pixels skipped" << std::endl;
+		});
+		double without = _maskGpuMs[0] / std::max(_maskFrames[0], 1);
+		double with = _maskGpuMs[1] / std::max(_maskFrames[1], 1);
+		std::cout << "eye passes: " << without << " ms GPU without the mask, " << with << " ms with it, "
+			<< without - with << " ms saved per frame" << std::endl;
 	}
 
 	void onKey(int key, int scancode, int action, int mods) override {
@@ -540,11 +537,40 @@ protected:
 		case GLFW_KEY_R:
 			ovr_RecenterTrackingOrigin(_session);
 			return;
+		case GLFW_KEY_P:
+			_pacingStats[0].print(std::cout, "unpaced");
+			_pacingStats[1].print(std::cout, "paced");
+			_pacer.enabled = !_pacer.enabled;
+			_pacingStats[_pacer.enabled] = PacingStats();
+			std::cout << "frame pacing " << (_pacer.enabled ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_L:
+			_lensMaskEnabled = !_lensMaskEnabled;
+			std::cout << "lens mask " << (_lensMaskEnabled ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_M:
+			_maskFramesLeft = 400;
+			_maskFrames[0] = _maskFrames[1] = 0;
+			_maskGpuMs[0] = _maskGpuMs[1] = 0.0;
+			return;
+		case GLFW_KEY_N:
+			_printRenderStats = true;
+			return;
 		}
 
 		GlfwApp::onKey(key, scancode, action, mods);
 	}
 
+	void beginFrame() override {
+		double sleepStart = ovr_GetTimeInSeconds();
+		if (_pacer.enabled) {
+			FramePacer::sleepUntil(_pacer.startTime(ovr_GetPredictedDisplayTime(_session, frame)), ovr_GetTimeInSeconds);
+		}
+		_lastFrameStart = _frameStart;
+		_frameStart = ovr_GetTimeInSeconds();
+		_sleepSeconds = _frameStart - sleepStart;
+	}
+
 	ovrPosef lastEye[2], renderEye[2];
 	bool initLastEye[2] = {false, false};
 	void draw() final override {
@@ -571,7 +597,12 @@ protected:
 		ovr_GetTextureSwapChainCurrentIndex(_session, _eyeTexture, &curIndex);
 		GLuint curTexId;
 		ovr_GetTextureSwapChainBufferGL(_session, _eyeTexture, curIndex, &curTexId);
+		bool hud = hudVisible() && _hud->valid();
+		RenderStats & renderStats = RenderStats::local();
+		renderStats.enabled = hud || _printRenderStats;
+		renderStats.beginFrame(frame);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+		RenderStats::framebuffer(_fbo);
 		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, curTexId, 0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		ovr::for_each_eye([&](ovrEyeType eye) {
@@ -587,15 +618,38 @@ protected:
 			}
 			lastEye[eye] = renderEye[eye];
 			// */
-			
+		});
+		// All four poses of the frame in one batch: the CAVE viewer eyes, then the HMD eyes
+		ovrPosef framePoses[4] = { renderEye[0], renderEye[1], eyePoses[0], eyePoses[1] };
+		glm::mat4 frameMatrices[4];
+		ovr::toGlm(framePoses, 4, frameMatrices);
+		// The HMD between the eyes, facing the way the head does
+		glm::mat4 head = frameMatrices[2];
+		head[3] = (frameMatrices[2][3] + frameMatrices[3][3]) * 0.5f;
+		gazePose(head);
+		bool stereo = instancedStereo();
+		if (hud) _hud->beginFrame();
+		bool timing = _maskFramesLeft > 0;
+		bool masked = timing ? (frame & 1) != 0 : _lensMaskEnabled;
+		ovr::for_each_eye([&](ovrEyeType eye) {
 			currentEye(eye);
 			const auto& vp = _sceneLayer.Viewport[eye];
 			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
 			_sceneLayer.RenderPose[eye] = eyePoses[eye];
 			glm::vec3 eyePos = glm::vec3(renderEye[eye].Position.x, renderEye[eye].Position.y, renderEye[eye].Position.z);
-			offscreenRender(_eyeProjections[eye], ovr::toGlm(renderEye[eye]), _fbo, vp, eyePos);
+			if (hud) _hud->beginStage(Hud::STAGE_WALLS);
+			offscreenRender(_eyeProjections[eye], frameMatrices[eye], _fbo, vp, eyePos);
+			if (hud) _hud->endStage(Hud::STAGE_WALLS);
+			if (stereo) return;
+			if (hud) _hud->beginStage(Hud::STAGE_EYES);
+			if (timing) _eyeTimer->begin(eye);
+			renderStats.beginPass(eye == ovrEye_Left ? "left eye" : "right eye");
+			if (masked) drawLensMask(eye);
 			glm::vec3 origEyePos = glm::vec3(eyePoses[eye].Position.x, eyePoses[eye].Position.y, eyePoses[eye].Position.z);
-			renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), origEyePos);
+			renderScene(_eyeProjections[eye], frameMatrices[2 + eye], origEyePos);
+			renderStats.endPass();
+			if (timing) _eyeTimer->end(eye);
+			if (hud) _hud->endStage(Hud::STAGE_EYES);
 			
 			//*/
 			/*
@@ -608,23 +662,93 @@ protected:
 			renderScene(_eyeProjections[eye], ovr::toGlm(renderEye[eye]));
 			*/
 		});
+		if (stereo) {
+			// The walls of both eyes are done, draw both eyes of the eye buffer at once
+			if (hud) _hud->beginStage(Hud::STAGE_EYES);
+			if (timing) _eyeTimer->begin(0);
+			renderStats.beginPass("both eyes");
+			if (masked) {
+				ovr::for_each_eye([&](ovrEyeType eye) {
+					const auto& vp = _sceneLayer.Viewport[eye];
+					glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+					drawLensMask(eye);
+				});
+			}
+			renderSceneStereo(_eyeProjections, frameMatrices + 2, _sceneLayer.Viewport, _renderTargetSize);
+			renderStats.endPass();
+			if (timing) _eyeTimer->end(0);
+			if (hud) _hud->endStage(Hud::STAGE_EYES);
+		}
 		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 		ovr_CommitTextureSwapChain(_session, _eyeTexture);
-		ovrLayerHeader* headerList = &_sceneLayer.Header;
-		ovr_SubmitFrame(_session, frame, &_viewScaleDesc, &headerList, 1);
+		double cpuSeconds = ovr_GetTimeInSeconds() - _frameStart;
+		// After the frame time is taken, so the HUD does not show its own cost
+		if (hud) {
+			renderStats.beginPass("hud");
+			_hud->render(1000.0f / _hmdDesc.DisplayRefreshRate);
+			renderStats.endPass();
+		}
+		ovrLayerHeader* headerList[2] = { &_sceneLayer.Header, hud ? _hud->layer() : nullptr };
+		ovr_SubmitFrame(_session, frame, &_viewScaleDesc, headerList, hud ? 2 : 1);
+
+		if (timing) {
+			// Waits for the GPU, only while measuring
+			_eyeTimer->collect();
+			_maskGpuMs[masked] += stereo ? _eyeTimer->gpuMs(0) : _eyeTimer->gpuMs(0) + _eyeTimer->gpuMs(1);
+			_maskFrames[masked]++;
+			if (--_maskFramesLeft == 0) {
+				reportLensMask();
+			}
+		}
+
+		int wallPasses = wallPassCount();
+		// Stats are for the previous frames, the most recent one first
+		ovrPerfStats perfStats;
+		if (OVR_SUCCESS(ovr_GetPerfStats(_session, &perfStats)) && perfStats.FrameStatsCount > 0) {
+			const ovrPerfStatsPerCompositorFrame & stats = perfStats.FrameStats[0];
+			bool dropped = stats.AppDroppedFrameCount > _droppedFrames;
+			_droppedFrames = stats.AppDroppedFrameCount;
+			double renderSeconds = std::max(cpuSeconds, (double)stats.AppGpuElapsedTime);
+			if (hud) {
+				// The counters lag a frame, like the compositor's stats
+				Hud::FrameStats hudStats = { (float)(cpuSeconds * 1000.0), stats.AppGpuElapsedTime * 1000.0f, wallPasses,
+					stats.AppDroppedFrameCount, stats.CompositorDroppedFrameCount, renderStats.lastFrame().total };
+				_hud->addFrame(hudStats);
+			}
+			_pacer.recordFrame(renderSeconds, dropped);
+			if (_lastFrameStart > 0.0) {
+				_pacingStats[_pacer.enabled].add(_frameStart - _lastFrameStart, _sleepSeconds, renderSeconds,
+					stats.AppMotionToPhotonLatency, dropped);
+			}
+		}
 
 		GLuint mirrorTextureId;
 		ovr_GetMirrorTextureBufferGL(_session, _mirrorTexture, &mirrorTextureId);
+		renderStats.beginPass("mirror");
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
+		RenderStats::framebuffer(_mirrorFbo);
 		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mirrorTextureId, 0);
 		glBlitFramebuffer(0, 0, _mirrorSize.x, _mirrorSize.y, 0, _mirrorSize.y, _mirrorSize.x, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		renderStats.endFrame();
+		if (_printRenderStats) {
+			renderStats.print(std::cout);
+			_printRenderStats = false;
+		}
 	}
 	float getDefaultIOD(int idx) { return defaultHmdToEyeOffset[idx]; }
 
 	virtual void offscreenRender(const glm::mat4 & projection, const glm::mat4 & headPose, GLuint _fbo, const ovrRecti & vp, const glm::vec3 & eyePos) = 0;
 	virtual void renderScene(const glm::mat4 & projection, const glm::mat4 & headPose, const glm::vec3 & eyePos) = 0;
+	// Where the viewer's head is this frame, before any eye is rendered
+	virtual void gazePose(const glm::mat4 & head) {}
+	// Single pass stereo: renderSceneStereo replaces the two renderScene calls of a frame
+	virtual bool instancedStereo() { return false; }
+	virtual void renderSceneStereo(const glm::mat4 projection[2], const glm::mat4 headPose[2], const ovrRecti viewport[2], const uvec2 & targetSize) {}
+	// The performance HUD and the wall passes it shows, counted since the last call
+	virtual bool hudVisible() { return false; }
+	virtual int wallPassCount() { return 0; }
 	virtual void currentEye(ovrEyeType eye) = 0;
 	virtual int getViewState() = 0;
 	virtual int getTrackingState() = 0;
@@ -641,12 +765,35 @@ protected:
 
 
 #include <time.h>
-#include "Shader.h"
+#include <cfloat>
+#include <cmath>
+#include <chrono>
+#include <vector>
 #include "Cube.h"
 #include "Skybox.h"
 #include "Cave.h"
 #include "Line.h"
-struct SimScene {
+#include "CpuRenderer.h"
+#include "FileIO.h"
+#include "Projection.h"
+#include "SimControls.h"
+#include "FixedTimestep.h"
+#include "PosePredictor.h"
+#include "IndirectScene.h"
+#include "Mesh.h"
+#include "UploadService.h"
+#include "FrameGraph.h"
+#include "WallCache.h"
+#include "ProjectorOutput.h"
+// CPU side of the std140 StereoEyes block in stereo.glsl
+struct StereoEyes {
+	mat4 projection[2];
+	mat4 view[2];
+	vec4 viewport[2];
+	vec4 bounds[2];
+};
+
+struct SimScene : public SimControls {
 	Cave * cave;
 	Cube * cube;
 	Skybox * skybox;
@@ -665,110 +812,173 @@ struct SimScene {
 	Line * liner5;
 	Line * liner6;
 	Line * liner7;
-	GLint cubeShaderProgram, skyboxShaderProgram, lineShaderProgram;
-
-	bool buttonAPressed = false, buttonBPressed = false, buttonXPressed = false, rightHandTriggerPressed = false;
-	int buttonA = 0, buttonB = 0, buttonX = 0;
-	float IOD = 0.0f, cubeSize = 0.03f, cubeX = 0.0f, cubeZ = -0.5f;
-	int random_num = rand() % 6;
-	bool randomGened = false;
+	GLint cubeShaderProgram, caveShaderProgram, skyboxShaderProgram, lineShaderProgram;
 
 #define CUBE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/shader.vert"
 #define CUBE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/shader.frag"
 
+#define CAVE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cave.vert"
+#define CAVE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cave.frag"
+
 #define SKYBOX_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/skybox.vert"
 #define SKYBOX_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/skybox.frag"
 
 #define LINE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/LineShader.vert"
 #define LINE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/LineShader.frag"
 
-public:
-	static glm::mat4 P; // P for projection
-	static glm::mat4 V; // V for view
-	int curEyeIdx;
-	GLuint lFBO, lrenderedTexture, lRBO;
-	GLuint rFBO, rrenderedTexture, rRBO;
-	GLuint bFBO, brenderedTexture, bRBO;
-
-	SimScene() {
-		srand(time(0));
-		cubeShaderProgram = LoadShaders(CUBE_VERTEX_SHADER_PATH, CUBE_FRAGMENT_SHADER_PATH);
-		skyboxShaderProgram = LoadShaders(SKYBOX_VERTEX_SHADER_PATH, SKYBOX_FRAGMENT_SHADER_PATH);
-		lineShaderProgram = LoadShaders(LINE_VERTEX_SHADER_PATH, LINE_FRAGMENT_SHADER_PATH);
-
-		// left
-		glGenFramebuffers(1, &lFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER, lFBO);
-
-		glGenTextures(1, &lrenderedTexture);
-		glBindTexture(GL_TEXTURE_2D, lrenderedTexture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2048, 2048, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lrenderedTexture, 0);
+#define INDIRECT_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/indirect.vert"
+#define CULL_COMPUTE_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cull.comp"
 
-		glGenRenderbuffers(1, &lRBO);
-		glBindRenderbuffer(GL_RENDERBUFFER, lRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 2048, 2048);
-		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+#define MESH_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/mesh.vert"
+#define MESH_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/mesh.frag"
 
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, // 1. fbo target: GL_FRAMEBUFFER
-			GL_DEPTH_ATTACHMENT, // 2. attachment point
-			GL_RENDERBUFFER, // 3. rbo target: GL_RENDERBUFFER
-			lRBO); // 4. rbo ID
+#define FOVEATED_CAVE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cave_foveated.frag"
 
-		//right
-		glGenFramebuffers(1, &rFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER, rFBO);
+#define WALL_CACHE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/wallcache.vert"
+#define WALL_CACHE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/wallcache.frag"
 
-		glGenTextures(1, &rrenderedTexture);
-		glBindTexture(GL_TEXTURE_2D, rrenderedTexture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2048, 2048, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rrenderedTexture, 0);
+#define PROJECTOR_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/projector.vert"
+#define PROJECTOR_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/projector.frag"
 
-		glGenRenderbuffers(1, &rRBO);
-		glBindRenderbuffer(GL_RENDERBUFFER, rRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 2048, 2048);
-		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+#define VIRTUAL_SKYBOX_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/skybox_virtual.frag"
 
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, // 1. fbo target: GL_FRAMEBUFFER
-			GL_DEPTH_ATTACHMENT, // 2. attachment point
-			GL_RENDERBUFFER, // 3. rbo target: GL_RENDERBUFFER
-			rRBO); // 4. rbo ID
+#define CUBEMAP_GEOMETRY_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cubemap.geom"
+#define CUBEMAP_CAVE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cave_cubemap.frag"
+// Renames the outputs of the scene's vertex shaders to the inputs of cubemap.geom
+#define CUBEMAP_VERTEX_PRELUDE "#define UV cubemapUV\n#define Normal cubemapNormal\n#define TexCoords cubemapTexCoords\n"
 
-		// bottom
-		glGenFramebuffers(1, &bFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER, bFBO);
+#define STEREO_PRELUDE_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/stereo.glsl"
+#define STEREO_CUBE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/shader_stereo.vert"
+#define STEREO_CAVE_FRAGMENT_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/cave_stereo.frag"
+#define STEREO_SKYBOX_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/skybox_stereo.vert"
+#define STEREO_LINE_VERTEX_SHADER_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/LineShader_stereo.vert"
 
-		glGenTextures(1, &brenderedTexture);
-		glBindTexture(GL_TEXTURE_2D, brenderedTexture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2048, 2048, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brenderedTexture, 0);
+#define LEFT_CUBEMAP_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/left-ppm"
+#define RIGHT_CUBEMAP_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/right-ppm"
+#define CUBE_TEXTURE_PATH "C:/Users/degu/Desktop/CSE190Project3/Minimal/vr_test_pattern.ppm"
 
-		glGenRenderbuffers(1, &bRBO);
-		glBindRenderbuffer(GL_RENDERBUFFER, bRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 2048, 2048);
-		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+public:
+	static glm::mat4 P; // P for projection
+	static glm::mat4 V; // V for view
+	int curEyeIdx;
+	// The wall textures are the layers of wallArray: left, right, bottom. The wall
+	// passes draw through wallGraph, these framebuffers are for reading the walls back.
+	GLuint wallArray;
+	GLuint lFBO, rFBO, bFBO;
+	// Walls of the right eye in layers 3 to 5, only separate from the ones above when
+	// both eyes' walls have to exist at the same time (single pass stereo)
+	bool separateEyeWalls = false;
+	GLuint rightEyeFBO[3];
+	// The wall passes of an eye, declared every preRender. Their depth buffers are
+	// transient, so the passes share one per size.
+	FrameGraph wallGraph;
+
+	// Single pass stereo: both eyes in one instanced draw per object, see stereo.glsl
+	GLint stereoCaveProgram = 0, stereoSkyboxProgram = 0, stereoLineProgram = 0;
+	GLuint stereoUBO = 0;
+	// One viewport per eye from the vertex shader, otherwise clip distances split the target
+	bool stereoViewportIndex = false;
+
+	// Foveated walls: every wall at surroundScale of the full 2048 density plus a full
+	// density inset of insetFraction of the wall's side around the gaze point, on the
+	// one wall the viewer looks at. Both are read when the targets are (re)created.
+	bool foveated = false;
+	float surroundScale = 0.5f;
+	float insetFraction = 0.25f;
+	// Width of the seam in wall UV, inside the inset
+	float insetBlend = 0.02f;
+	int surroundSize = 0, insetSize = 0;
+	GLuint surroundArray, insetTexture;
+	GLint foveatedCaveProgram = 0;
+	vec3 gazeOrigin, gazeDirection = vec3(0.0f, 0.0f, -1.0f);
+	int insetWall = -1;
+	vec4 insetRect;
+	// Wall texels cleared and shaded by the last preRender
+	long long wallTexelsShaded = 0;
+	// Wall passes since the HUD last read them
+	int wallPasses = 0;
+
+	// Copies of the cube around the cave, culled and drawn per wall pass by IndirectScene
+	IndirectScene * crowd = nullptr;
+	GLint indirectShaderProgram = 0;
+	// Culling the crowd on the CPU, every wall view of a preRender is prepared as a job
+	// up front so drawWallScene only submits it. Views are numbered as by wallView.
+	std::unique_ptr<ThreadPool> jobs;
+	static const int wallViewCount = 16;
+	IndirectScene::ViewPacket crowdViews[wallViewCount];
+	ThreadPool::Job crowdJobs[wallViewCount];
+
+	// Textures replaced mid session are streamed in by uploads, see swapStereoCubemaps
+	std::unique_ptr<UploadService> uploads;
+	bool stereoSetsSwapped = false;
+
+	// An imported model next to the cube, see loadModel
+	Mesh * model = nullptr;
+	GLint meshShaderProgram = 0;
+	// The model's LOD and triangles in the last pass of each wall view, see wallView
+	int modelLod[wallViewCount] = { 0 }, modelTriangles[wallViewCount] = { 0 };
+
+	// Wall images of a static scene keyed by the eye position, see useWallCache. A
+	// preRender that can't blend its walls from the cache fills one grid point of it.
+	WallCache * wallCache = nullptr;
+	bool wallCacheEnabled = false;
+	// Whether the last preRender blended its walls from the cache
+	bool wallsFromCache = false;
+
+	// Viewpoint cubemap walls: instead of a pass per wall, the scene is rendered once per
+	// eye into a cubemap around the CAVE viewer's eye, all six faces in one layered pass,
+	// and the cave samples it by direction. The cost does not depend on the number of
+	// walls. cubemapSize is read by initViewCubemap.
+	bool viewCubemap = false;
+	int cubemapSize = 2048;
+	int cubemapFaceSize = 0;
+	// Per eye like the wall array's layers, the second only with separate eye walls
+	GLuint viewCubemaps[2] = { 0, 0 }, cubemapDepth = 0;
+	vec3 cubemapCenter[2];
+	GLint cubemapCaveProgram = 0, cubemapSkyboxProgram = 0, cubemapCubeProgram = 0;
+	GLint cubemapIndirectProgram = 0, cubemapMeshProgram = 0;
+
+	// The stereo sets as a virtual cubemap, see loadVirtualSky. Every wall pass also draws
+	// the sky at 1 / skyFeedbackScale of its size into a feedback target, which tells
+	// virtualSky the tiles the walls sample. Declared after uploads, which it uses.
+	std::unique_ptr<VirtualCubemap> virtualSky;
+	GLint virtualSkyProgram = 0;
+	int skyFeedbackScale = 32;
+
+	// Inputs of the last wall passes, kept so the CPU renderer can reproduce them
+	glm::mat4 wallModelview;
+	glm::vec3 wallEyePos;
+	int wallEyeIdx = 0;
+	bool wallBlanked[3] = { false, false, false };
+	CpuRenderer * cpuRenderer = nullptr;
+
+	// With a shared scene, textures are taken from it instead of being loaded again. Its
+	// context must share objects with the current one. The programs are linked per scene:
+	// uniforms belong to the program object, so scenes drawing from several threads at
+	// once would overwrite each other's matrices.
+	SimScene(const SimScene * shared = nullptr) {
+		srand(time(0));
+		cubeShaderProgram = LoadShaders(CUBE_VERTEX_SHADER_PATH, CUBE_FRAGMENT_SHADER_PATH);
+		caveShaderProgram = LoadShaders(CAVE_VERTEX_SHADER_PATH, CAVE_FRAGMENT_SHADER_PATH);
+		skyboxShaderProgram = LoadShaders(SKYBOX_VERTEX_SHADER_PATH, SKYBOX_FRAGMENT_SHADER_PATH);
+		lineShaderProgram = LoadShaders(LINE_VERTEX_SHADER_PATH, LINE_FRAGMENT_SHADER_PATH);
 
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, // 1. fbo target: GL_FRAMEBUFFER
-			GL_DEPTH_ATTACHMENT, // 2. attachment point
-			GL_RENDERBUFFER, // 3. rbo target: GL_RENDERBUFFER
-			bRBO); // 4. rbo ID
+		wallArray = createWallArray(2048, 3);
+		createWallLayer(lFBO, wallArray, 0);
+		createWallLayer(rFBO, wallArray, 1);
+		createWallLayer(bFBO, wallArray, 2);
 
-		cave = new Cave();
+		cave = new Cave(shared ? shared->cave : nullptr);
 		//cave->toWorld = glm::mat4(1.0f);
 		cave->toWorld = glm::rotate(glm::mat4(1.0f), -0.785398f, glm::vec3(0.0f, 1.0f, 0.0f));
-		skybox = new Skybox();
+		skybox = new Skybox(shared ? shared->skybox : nullptr);
 		skybox->toWorld = glm::mat4(1.0f);
-		riftskybox = new Skybox();
+		// riftskybox only differs in the cubemap it uses, so it can share the textures of skybox
+		riftskybox = new Skybox(skybox);
 		riftskybox->toWorld = glm::mat4(1.0f);
 		riftskybox->useCubemap(2);
-		cube = new Cube();
-		cube->toWorld = glm::translate(glm::mat4(1.0f), glm::vec3(cubeX, 0.0f, cubeZ)) * glm::scale(glm::mat4(1.0f), glm::vec3(cubeSize, cubeSize, cubeSize));
+		cube = new Cube(shared ? shared->cube : nullptr);
+		cube->toWorld = cubeTransform();
 		linel1 = new Line();
 		linel2 = new Line();
 		linel3 = new Line();
@@ -785,19 +995,177 @@ public:
 		liner7 = new Line();
 	}
 
-	void update() {
-		cube->toWorld = glm::translate(glm::mat4(1.0f), glm::vec3(cubeX, 0.0f, cubeZ)) * glm::scale(glm::mat4(1.0f), glm::vec3(cubeSize, cubeSize, cubeSize));
+	// Needs the scene's context current. Textures shared with other scenes are left alone,
+	// the objects only free their own vertex arrays and buffers.
+	~SimScene() {
+		jobs.reset();
+		// The skyboxes' streaming threads queue uploads, the virtual sky cancels its own
+		delete skybox;
+		delete riftskybox;
+		virtualSky.reset();
+		uploads.reset();
+		delete cave;
+		delete cube;
+		Line * lines[14] = { linel1, linel2, linel3, linel4, linel5, linel6, linel7,
+			liner1, liner2, liner3, liner4, liner5, liner6, liner7 };
+		for (Line * line : lines) {
+			delete line;
+		}
+		delete crowd;
+		delete model;
+		delete wallCache;
+		delete cpuRenderer;
+
+		GLint programs[16] = { cubeShaderProgram, caveShaderProgram, skyboxShaderProgram, lineShaderProgram,
+			stereoCaveProgram, stereoSkyboxProgram, stereoLineProgram, foveatedCaveProgram, indirectShaderProgram,
+			meshShaderProgram, virtualSkyProgram, cubemapCaveProgram, cubemapSkyboxProgram, cubemapCubeProgram,
+			cubemapIndirectProgram, cubemapMeshProgram };
+		for (GLint program : programs) {
+			if (program) glDeleteProgram(program);
+		}
+
+		GLuint fbos[3] = { lFBO, rFBO, bFBO };
+		glDeleteFramebuffers(3, fbos);
+		if (separateEyeWalls) glDeleteFramebuffers(3, rightEyeFBO);
+		glDeleteTextures(1, &wallArray);
+		glDeleteBuffers(1, &stereoUBO);
+		if (surroundSize) {
+			glDeleteTextures(1, &surroundArray);
+			glDeleteTextures(1, &insetTexture);
+		}
+		glDeleteTextures(2, viewCubemaps);
+		glDeleteTextures(1, &cubemapDepth);
+	}
+	SimScene(const SimScene &) = delete;
+	SimScene & operator=(const SimScene &) = delete;
+
+	// Color texture of one size x size wall pass
+	static GLuint createWallTexture(int size = 2048) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	// size x size wall textures as the layers of one array, so the cave samples all of
+	// its walls with one bind and one draw
+	static GLuint createWallArray(int size, int layers) {
+		GLuint array;
+		glGenTextures(1, &array);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, size, size, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return array;
+	}
+
+	// Framebuffer with one layer of a wall array as its only attachment, to read it back
+	static void createWallLayer(GLuint & fbo, GLuint array, int layer) {
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, layer);
+	}
+
+	// Wall 0 left, 1 right, 2 bottom as seen by an eye
+	GLuint wallFBO(int eyeIdx, int wall) const {
+		if (eyeIdx == 1 && separateEyeWalls) return rightEyeFBO[wall];
+		const GLuint fbos[3] = { lFBO, rFBO, bFBO };
+		return fbos[wall];
+	}
+
+	// Layer of wallArray holding the left wall of an eye, the other two follow it
+	int firstWallLayer(int eyeIdx) const {
+		return eyeIdx == 1 && separateEyeWalls ? 3 : 0;
+	}
+
+	// Loads the stereo programs and gives the right eye its own walls, once
+	void initStereo() {
+		if (stereoUBO) return;
+
+		// gl_ViewportIndex can only be written from the vertex shader with one of these
+		std::string prelude;
+		if (glfwExtensionSupported("GL_ARB_shader_viewport_layer_array")) {
+			prelude = "#extension GL_ARB_shader_viewport_layer_array : require\n";
+			stereoViewportIndex = true;
+		}
+		else if (glfwExtensionSupported("GL_AMD_vertex_shader_viewport_index")) {
+			prelude = "#extension GL_AMD_vertex_shader_viewport_index : require\n";
+			stereoViewportIndex = true;
+		}
+		if (stereoViewportIndex) {
+			prelude += "#define STEREO_VIEWPORT_INDEX\n";
+		}
+		if (!readTextFile(STEREO_PRELUDE_PATH, prelude)) {
+			std::cerr << "could not read " << STEREO_PRELUDE_PATH << std::endl;
+		}
+
+		stereoCaveProgram = LoadShaders(STEREO_CUBE_VERTEX_SHADER_PATH, STEREO_CAVE_FRAGMENT_SHADER_PATH, prelude.c_str());
+		stereoSkyboxProgram = LoadShaders(STEREO_SKYBOX_VERTEX_SHADER_PATH, SKYBOX_FRAGMENT_SHADER_PATH, prelude.c_str());
+		stereoLineProgram = LoadShaders(STEREO_LINE_VERTEX_SHADER_PATH, LINE_FRAGMENT_SHADER_PATH, prelude.c_str());
+		GLint programs[3] = { stereoCaveProgram, stereoSkyboxProgram, stereoLineProgram };
+		for (GLint program : programs) {
+			GLuint block = glGetUniformBlockIndex(program, "StereoEyes");
+			if (block != GL_INVALID_INDEX) {
+				glUniformBlockBinding(program, block, 0);
+			}
+		}
+
+		glGenBuffers(1, &stereoUBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, stereoUBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(StereoEyes), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		separateWalls();
+	}
+
+	// Gives the right eye walls of its own, so both eyes' walls exist at the end of a frame
+	void separateWalls() {
+		if (separateEyeWalls) return;
+		// Grow the wall array by the right eye's walls, the left eye's layers are attached again
+		// since their storage is specified anew
+		glBindTexture(GL_TEXTURE_2D_ARRAY, wallArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, 2048, 2048, 6, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		for (int wall = 0; wall < 3; wall++) {
+			glBindFramebuffer(GL_FRAMEBUFFER, wallFBO(0, wall));
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, wallArray, 0, wall);
+			createWallLayer(rightEyeFBO[wall], wallArray, 3 + wall);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// The graph's framebuffers have the old storage attached
+		wallGraph.releaseCache();
+		separateEyeWalls = true;
+	}
+
+	// Context state the scene expects, needed once per context
+	static void initGlState() {
+		// Enable depth buffering
+		glEnable(GL_DEPTH_TEST);
+		// Related to shaders and z value comparisons for the depth buffer
+		glDepthFunc(GL_LEQUAL);
+		// Set polygon drawing mode to fill front and back of each polygon
+		// You can also use the paramter of GL_LINE instead of GL_FILL to see wireframes
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		// Disable backface culling to render both sides of polygons
+		glDisable(GL_CULL_FACE);
+		// Set clear color
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	// alpha is how far the frame lies between the last two simulation steps
+	void update(float alpha) {
+		cube->toWorld = cubeTransform(alpha);
 	}
 
 	void preRender(const glm::mat4 & projection, const glm::mat4 & modelview, GLuint _fbo, const ovrRecti & vp, const glm::vec3 & eyePos) {
 		// render scene to texture
-		//------------------------left
-		glBindFramebuffer(GL_FRAMEBUFFER, lFBO);
-		glViewport(0, 0, 2048, 2048);
 		glClearColor(0.f, 0.f, 0.f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		float nearPlane = 0.01f, farPlane = 1000.0f;
 		//if (buttonX == 1 && curEyeIdx == 0) hasLeft = true;
 		//if (buttonX == 1 && curEyeIdx == 1) hasRight = true;
 		if (buttonX == 1 && !randomGened) {
@@ -805,15 +1173,54 @@ public:
 			randomGened = true;
 		}
 
-		vec3 pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, 2.0f, 1.0f));
-		vec3 pb = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
-		vec3 pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, 2.0f, 1.0f));
-		if (buttonX == 0 || curEyeIdx * 3 != random_num) {
-			glUseProgram(skyboxShaderProgram);
-			skybox->draw(skyboxShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
-			glUseProgram(cubeShaderProgram);
-			cube->draw(cubeShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
+		wallModelview = modelview;
+		wallEyePos = eyePos;
+		wallEyeIdx = curEyeIdx;
+		for (int wall = 0; wall < 3; wall++) {
+			wallBlanked[wall] = buttonX != 0 && curEyeIdx * 3 + wall == random_num;
+		}
+		wallTexelsShaded = 0;
+		if (foveated) {
+			updateInset();
+		}
+
+		// The cache holds full density walls seen from a position alone
+		// Blended walls send no sky feedback, so a virtual sky would never sharpen in them
+		bool cacheable = wallCacheEnabled && !foveated && !viewCubemap && !virtualSky && translationOnly(modelview)
+			&& !wallBlanked[0] && !wallBlanked[1] && !wallBlanked[2];
+		WallCache::Blend blend;
+		wallsFromCache = false;
+		if (cacheable) {
+			wallCache->setContent(wallContent());
+			wallsFromCache = wallCache->lookup(curEyeIdx, eyePos, blend);
+		}
+
+		wallGraph.reset();
+		if (viewCubemap) {
+			declareViewCubemap(modelview, eyePos);
 		}
+		else if (wallsFromCache) {
+			for (int wall = 0; wall < 3; wall++) {
+				declareCachedWall(wall, blend);
+			}
+		}
+		else {
+			prepareCrowd(modelview, eyePos);
+			vec3 point;
+			if (cacheable && wallCache->nextFill(curEyeIdx, eyePos, point)) {
+				declareCacheFill(modelview, eyePos, point);
+			}
+			for (int wall = 0; wall < 3; wall++) {
+				declareWall(wall, modelview, eyePos);
+			}
+		}
+		if (wallGraph.compile()) {
+			wallGraph.execute();
+		}
+
+		//------------------------left
+		vec3 pa, pb, pc;
+		wallCorners(0, pa, pb, pc);
 		// line update
 		if (curEyeIdx == 0) {
 			linel1->update(pc, eyePos, false);
@@ -825,19 +1232,7 @@ public:
 		}
 
 		//----------------------right
-		glBindFramebuffer(GL_FRAMEBUFFER, rFBO);
-		glViewport(0, 0, 2048, 2048);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
-		pb = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, -2.0f, 1.0f));
-		pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, -2.0f, 1.0f));
-		if (buttonX == 0 || curEyeIdx * 3 + 1 != random_num) {
-			glUseProgram(skyboxShaderProgram);
-			skybox->draw(skyboxShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
-			glUseProgram(cubeShaderProgram);
-			cube->draw(cubeShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
-		}
+		wallCorners(1, pa, pb, pc);
 		// line update
 		if (curEyeIdx == 0) {
 			// linel3->update(pc, eyePos, false);
@@ -854,19 +1249,7 @@ public:
 		}
 
 		//-------------------------bottom
-		glBindFramebuffer(GL_FRAMEBUFFER, bFBO);
-		glViewport(0, 0, 2048, 2048);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, 2.0f, 1.0f));
-		pb = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, 2.0f, 1.0f));
-		pc = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
-		if (buttonX == 0 || curEyeIdx * 3 + 2 != random_num) {
-			glUseProgram(skyboxShaderProgram);
-			skybox->draw(skyboxShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
-			glUseProgram(cubeShaderProgram);
-			cube->draw(cubeShaderProgram, getProjection(eyePos, pa, pb, pc, nearPlane, farPlane), modelview);
-		}
+		wallCorners(2, pa, pb, pc);
 		// line update
 		if (curEyeIdx == 0) {
 			linel7->update(pb, eyePos, false);
@@ -877,159 +1260,974 @@ public:
 
 		// restore fbo
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		RenderStats::framebuffer(0);
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+		RenderStats::framebuffer(_fbo);
 		glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+		if (jobs) {
+			jobs->finishFrame();
+		}
+		for (ThreadPool::Job & job : crowdJobs) {
+			job = nullptr;
+		}
 	}
 
-	glm::mat4 getProjection(glm::vec3 eyePos, glm::vec3 pa, glm::vec3 pb, glm::vec3 pc, float n, float f) {
-		vec3 vr = glm::normalize(pb - pa);
-		vec3 vu = glm::normalize(pc - pa);
-		vec3 vn = glm::normalize(glm::cross(vr, vu));
-		vec3 va = pa - eyePos;
-		vec3 vb = pb - eyePos;
-		vec3 vc = pc - eyePos;
-		float d = -glm::dot(vn, va);
-		float l = glm::dot(vr, va) * n / d;
-		float r = glm::dot(vr, vb) * n / d;
-		float b = glm::dot(vu, va) * n / d;
-		float t = glm::dot(vu, vc) * n / d;
-
-		glm::mat4 P = glm::mat4(2 * n / (r - l), 0.0f, 0.0f, 0.0f,
-								0.0f, 2 * n / (t - b), 0.0f, 0.0f,
-								(r + l) / (r - l), (t + b) / (t - b), -(f + n) / (f - n), -1.0f,
-								0.0f, 0.0f, -2 * f*n / (f - n), 0.0f);
-		P = glm::frustum(l, r, b, t, n, f);
-		glm::mat4 M = glm::mat4(vr.x, vr.y, vr.z, 0.0f,
-								vu.x, vu.y, vu.z, 0.0f, 
-								vn.x, vn.y, vn.z, 0.0f, 
-								0.0f, 0.0f, 0.0f, 1.0f);
-		glm::mat4 T = glm::translate(glm::vec3(-eyePos.x, -eyePos.y, -eyePos.z));
-		return P*glm::transpose(M)*T;
+	// Starts culling the crowd for this eye's wall views, see crowdJobs
+	void prepareCrowd(const mat4 & modelview, const vec3 & eyePos) {
+		if (!crowd || !crowd->objectCount() || crowd->gpuCulling) return;
+		if (!jobs) {
+			jobs = std::unique_ptr<ThreadPool>(new ThreadPool());
+		}
+		for (int wall = 0; wall < 3; wall++) {
+			vec3 pa, pb, pc;
+			wallCorners(wall, pa, pb, pc);
+			mat4 projection = getProjection(eyePos, pa, pb, pc, 0.01f, 1000.0f);
+			int views[2] = { wallView(curEyeIdx, wall), foveated && wall == insetWall ? 6 + curEyeIdx : -1 };
+			for (int view : views) {
+				if (view < 0) continue;
+				crowdViews[view].projection = view < 6 ? projection : insetProjection(projection);
+				crowdViews[view].modelview = modelview;
+				crowdJobs[view] = crowd->prepareView(*jobs, crowdViews[view]);
+			}
+		}
 	}
 
-	void render(const mat4 & projection, const mat4 & modelview, const glm::vec3 & eyePos) {
-		// render texture to cave
-		glUseProgram(skyboxShaderProgram);
-		riftskybox->draw(skyboxShaderProgram, projection, modelview);
+	// The skybox, the cube, its crowd and the model as seen through a wall. view and
+	// resolution pick the model's LOD.
+	void drawWallScene(const mat4 & projection, const mat4 & modelview, int view, int resolution) {
+		GLint skyProgram = virtualSky ? virtualSkyProgram : skyboxShaderProgram;
+		glUseProgram(skyProgram);
+		RenderStats::program(skyProgram);
+		if (virtualSky) VirtualCubemap::setFeedback(skyProgram, false, 0.0f);
+		skybox->draw(skyProgram, projection, modelview);
 		glUseProgram(cubeShaderProgram);
-		cave->draw(cubeShaderProgram, projection, modelview, lrenderedTexture, rrenderedTexture, brenderedTexture);
-		/*
-		vec3 pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, 2.0f, 1.0f));
-		if (curEyeIdx == 0) {
-			//linel1->update(pc, eyePos, false);
+		RenderStats::program(cubeShaderProgram);
+		cube->draw(cubeShaderProgram, projection, modelview);
+		if (crowd && crowd->objectCount()) {
+			glUseProgram(indirectShaderProgram);
+			RenderStats::program(indirectShaderProgram);
+			if (crowdJobs[view]) {
+				jobs->wait(crowdJobs[view]);
+				crowdJobs[view] = nullptr;
+				crowd->submitView(indirectShaderProgram, crowdViews[view], cube->texture_ID);
+			}
+			else {
+				crowd->draw(indirectShaderProgram, projection, modelview, cube->texture_ID);
+			}
 		}
-		*/
-		if (buttonAPressed == true) {
-			glUseProgram(lineShaderProgram);
-			linel1->draw(lineShaderProgram, projection, modelview);
-			linel2->draw(lineShaderProgram, projection, modelview);
-			linel3->draw(lineShaderProgram, projection, modelview);
-			linel4->draw(lineShaderProgram, projection, modelview);
-			linel5->draw(lineShaderProgram, projection, modelview);
-			linel6->draw(lineShaderProgram, projection, modelview);
-			linel7->draw(lineShaderProgram, projection, modelview);
-			liner1->draw(lineShaderProgram, projection, modelview);
-			liner2->draw(lineShaderProgram, projection, modelview);
-			liner3->draw(lineShaderProgram, projection, modelview);
-			liner4->draw(lineShaderProgram, projection, modelview);
-			liner5->draw(lineShaderProgram, projection, modelview);
-			liner6->draw(lineShaderProgram, projection, modelview);
-			liner7->draw(lineShaderProgram, projection, modelview);
+		if (model) {
+			int lod = model->selectLod(view, projection * modelview, resolution);
+			modelLod[view] = lod;
+			modelTriangles[view] = model->triangles(lod);
+			glUseProgram(meshShaderProgram);
+			RenderStats::program(meshShaderProgram);
+			model->draw(meshShaderProgram, projection, modelview, lod);
 		}
 	}
 
-	void currentEye(int eyeIdx) {
-		curEyeIdx = eyeIdx;
-		//cave->useCubemap(curEyeIdx);
-		skybox->useCubemap(curEyeIdx);
+	// Wall views are eye * 3 + wall, the foveated insets 6 + eye, the walls of a wall
+	// cache fill 8 + wall, the viewpoint cubemaps 11 + eye and the walls past the
+	// bottom one, only rendered by the cubemap benchmark, 10 + wall
+	static int wallView(int eyeIdx, int wall) {
+		return wall < 3 ? eyeIdx * 3 + wall : 10 + wall;
 	}
 
-private:
-
-};
+	static const char * wallViewName(int view) {
+		const char * names[wallViewCount] = { "left eye, left wall", "left eye, right wall", "left eye, bottom wall",
+			"right eye, left wall", "right eye, right wall", "right eye, bottom wall", "left eye, inset", "right eye, inset",
+			"cache fill, left wall", "cache fill, right wall", "cache fill, bottom wall", "left eye, cubemap", "right eye, cubemap",
+			"wall across from the left", "wall across from the right", "ceiling" };
+		return names[view];
+	}
 
-class SimApp : public RiftApp {
-	std::shared_ptr<SimScene> simScene;
+	// Triangles of the model per wall view in the last frame, against its full detail
+	void reportLods() {
+		if (!model) {
+			std::cout << "no model loaded" << std::endl;
+			return;
+		}
+		const char * walls[3] = { "left", "right", "bottom" };
+		const char * eyes[2] = { "left", "right" };
+		for (int view = 0; view < 8; view++) {
+			if (view >= 6 && !foveated) break;
+			if (view < 6) std::cout << eyes[view / 3] << " eye, " << walls[view % 3] << " wall: ";
+			else std::cout << eyes[view - 6] << " eye, inset: ";
+			std::cout << model->triangles(0) << " triangles at full detail, " << modelTriangles[view]
+				<< " drawn at LOD " << modelLod[view] << std::endl;
+		}
+	}
 
-public:
-	SimApp() {}
-	glm::mat4 lastHeadPose;
-	glm::mat4 rightHandPose;
-	glm::vec3 triggerPose;
-	glm::mat4 lastRightHand;
-protected:
+	// An OBJ, through its cooked cache, or a cooked mesh. It is scaled to modelSize and
+	// placed beside the cube.
+	bool loadModel(const std::string & path, float modelSize = 0.2f) {
+		CookedMesh cooked;
+		if (!loadCachedMesh(path, cooked)) {
+			std::cerr << "could not load model " << path << std::endl;
+			return false;
+		}
+		if (!meshShaderProgram) {
+			meshShaderProgram = LoadShaders(MESH_VERTEX_SHADER_PATH, MESH_FRAGMENT_SHADER_PATH);
+		}
+		delete model;
+		model = new Mesh(cooked);
+		vec3 extent = model->boundsMax - model->boundsMin;
+		float largest = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+		model->toWorld = glm::translate(glm::mat4(1.0f), vec3(0.25f, 0.0f, -0.5f))
+			* glm::scale(glm::mat4(1.0f), vec3(modelSize / largest))
+			* glm::translate(glm::mat4(1.0f), -(model->boundsMin + model->boundsMax) * 0.5f);
+		return true;
+	}
 
-	void initGl() override {
-		RiftApp::initGl();
-		// Enable depth buffering
-		glEnable(GL_DEPTH_TEST);
-		// Related to shaders and z value comparisons for the depth buffer
-		glDepthFunc(GL_LEQUAL);
-		// Set polygon drawing mode to fill front and back of each polygon
-		// You can also use the paramter of GL_LINE instead of GL_FILL to see wireframes
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		// Disable backface culling to render both sides of polygons
-		glDisable(GL_CULL_FACE);
-		// Set clear color
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		ovr_RecenterTrackingOrigin(_session);
-		simScene = std::shared_ptr<SimScene>(new SimScene());
+	// Streams the stereo cubemap sets back in with the eyes exchanged, the walls keep the
+	// old ones until the new array is complete
+	void swapStereoCubemaps() {
+		if (!uploads) {
+			uploads = std::unique_ptr<UploadService>(new UploadService());
+		}
+		bool swapped = !stereoSetsSwapped;
+		std::string left = std::string(LEFT_CUBEMAP_PATH) + "/", right = std::string(RIGHT_CUBEMAP_PATH) + "/";
+		bool started = skybox->streamStereoCubemap(*uploads, swapped ? right : left, swapped ? left : right, [this, swapped] {
+			riftskybox->texture_ID_stereo = skybox->texture_ID_stereo;
+			stereoSetsSwapped = swapped;
+			std::cout << "stereo cubemaps " << (swapped ? "swapped" : "restored") << std::endl;
+		});
+		if (!started) {
+			std::cout << "stereo cubemaps are still streaming" << std::endl;
+		}
 	}
 
-	void shutdownGl() override {
+	// Spends this frame's upload budget, on the GL thread
+	void updateUploads() {
+		if (uploads) {
+			uploads->update();
+		}
+		if (virtualSky) {
+			virtualSky->update();
+		}
 	}
 
-	void update() override {
-		ovrInputState inputState;
-		double displayMidpointSeconds = ovr_GetPredictedDisplayTime(_session, frame);
-		ovrTrackingState trackState = ovr_GetTrackingState(_session, displayMidpointSeconds, ovrTrue);
-		if (OVR_SUCCESS(ovr_GetInputState(_session, ovrControllerType_Touch, &inputState))) {
-			if (inputState.Buttons & ovrButton_A) simScene->buttonAPressed = true;
-			else if (simScene->buttonAPressed) {
-				simScene->buttonA = (simScene->buttonA + 1) % 4; simScene->buttonAPressed = false;
+	// Draws the stereo sets in the walls from a file cooked by cookVirtualCubemap instead
+	// of the cube map array, with a tile cache sized for the three full density walls
+	bool loadVirtualSky(const std::string & path) {
+		if (!uploads) {
+			uploads = std::unique_ptr<UploadService>(new UploadService());
+		}
+		std::unique_ptr<VirtualCubemap> sky(new VirtualCubemap(*uploads));
+		if (!sky->open(path, 3LL * 2048 * 2048)) {
+			std::cerr << "could not load virtual sky " << path << std::endl;
+			return false;
+		}
+		if (!virtualSkyProgram) {
+			virtualSkyProgram = LoadShaders(SKYBOX_VERTEX_SHADER_PATH, VIRTUAL_SKYBOX_FRAGMENT_SHADER_PATH);
+		}
+		virtualSky = std::move(sky);
+		skybox->virtualCubemap = virtualSky.get();
+		return true;
+	}
+
+	void reportVirtualSky() {
+		if (!virtualSky) {
+			std::cout << "no virtual sky loaded" << std::endl;
+			return;
+		}
+		VirtualCubemap & sky = *virtualSky;
+		std::cout << "virtual sky: " << sky.residentCount() << " of " << sky.capacity() << " tiles resident, "
+			<< sky.requested << " requested, " << sky.loaded << " loaded, " << sky.evictions << " evicted, cache full "
+			<< sky.cacheFull << " times, " << sky.feedbackFrames << " feedback readbacks; "
+			<< sky.allocatedBytes() / (1024 * 1024) << " MB in VRAM against " << sky.fullBytes() / (1024 * 1024)
+			<< " MB for the whole cubemap" << std::endl;
+	}
+
+	// count copies of the cube scattered around the cave, 0 for none. Culls on the GPU
+	// where the context has the extensions for it.
+	void setCrowd(int count) {
+		if (!crowd) {
+			indirectShaderProgram = LoadShaders(INDIRECT_VERTEX_SHADER_PATH, CUBE_FRAGMENT_SHADER_PATH);
+			GLuint cullProgram = 0;
+			if (IndirectScene::gpuCullingSupported()) {
+				cullProgram = LoadComputeShader(CULL_COMPUTE_SHADER_PATH);
+			}
+			crowd = new IndirectScene(cullProgram);
+			GLuint indices[36];
+			for (GLuint i = 0; i < 36; i++) indices[i] = i;
+			crowd->setMesh(cube->vertices, cube->uvs, 36, indices, 36);
+		}
+		crowd->setObjects(crowd->scatter(count, 4.0f, 40.0f, 0.02f, 0.1f, 190));
+	}
+
+	// One wall into its full density layer, or into its surround and, for the wall the
+	// viewer looks at, the inset when foveated. The cave pass reads them after the graph.
+	void declareWall(int wall, const mat4 & modelview, const vec3 & eyePos) {
+		float nearPlane = 0.01f, farPlane = 1000.0f;
+		vec3 pa, pb, pc;
+		wallCorners(wall, pa, pb, pc);
+		mat4 projection = getProjection(eyePos, pa, pb, pc, nearPlane, farPlane);
+		int view = wallView(curEyeIdx, wall);
+		if (!foveated) {
+			FrameGraph::Resource layer = wallGraph.importTexture(wallViewName(view), wallArray, firstWallLayer(curEyeIdx) + wall, 2048, 2048);
+			wallPass(layer, 2048, projection, modelview, wall, view);
+			return;
+		}
+		wallPass(wallGraph.importTexture(wallViewName(view), surroundArray, wall, surroundSize, surroundSize),
+			surroundSize, projection, modelview, wall, view);
+		if (wall == insetWall) {
+			wallPass(wallGraph.importTexture(wallViewName(6 + curEyeIdx), insetTexture, -1, insetSize, insetSize),
+				insetSize, insetProjection(projection), modelview, wall, 6 + curEyeIdx);
+		}
+	}
+
+	void wallPass(FrameGraph::Resource color, int size, const mat4 & projection, const mat4 & modelview, int wall, int view) {
+		FrameGraph::TargetDesc depthDesc = { size, size, GL_DEPTH_COMPONENT };
+		FrameGraph::Resource depth = wallGraph.createTarget("wall depth", depthDesc);
+		wallGraph.addPass(wallViewName(view), {}, { color, depth }, [=]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			if (!wallBlanked[wall]) {
+				drawWallScene(projection, modelview, view, size);
+			}
+			wallTexelsShaded += (long long)size * size;
+			wallPasses++;
+		});
+		wallGraph.markOutput(color);
+		if (virtualSky && !wallBlanked[wall]) {
+			declareSkyFeedback(projection, modelview, size);
+		}
+	}
+
+	// The sky of a wall pass at 1 / skyFeedbackScale of its size, writing the tiles its
+	// texels need instead of colors, for virtualSky to read back
+	void declareSkyFeedback(const mat4 & projection, const mat4 & modelview, int size) {
+		int feedbackSize = std::max(size / skyFeedbackScale, 1);
+		FrameGraph::TargetDesc desc = { feedbackSize, feedbackSize, GL_RGBA8 };
+		FrameGraph::Resource target = wallGraph.createTarget("sky feedback", desc);
+		// Asks for the levels the wall pass's own texels sample
+		float lodBias = -std::log2((float)size / feedbackSize);
+		wallGraph.addPass("sky feedback", {}, { target }, [=]() {
+			// An alpha of 0 marks texels the sky left alone
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glUseProgram(virtualSkyProgram);
+			RenderStats::program(virtualSkyProgram);
+			VirtualCubemap::setFeedback(virtualSkyProgram, true, lodBias);
+			skybox->draw(virtualSkyProgram, projection, modelview);
+		});
+		wallGraph.addPass("sky feedback readback", { target }, {}, [=]() {
+			virtualSky->readFeedback(wallGraph.texture(target), feedbackSize);
+		});
+	}
+
+	// Renders the walls as seen from a grid point of the wall cache into transients of
+	// its size and stores them. The frame's own walls are declared after these.
+	void declareCacheFill(const mat4 & modelview, const vec3 & eyePos, const vec3 & point) {
+		// The same view, moved from the eye to the grid point
+		mat4 pointModelview = modelview * glm::translate(glm::mat4(1.0f), eyePos - point);
+		int size = wallCache->size();
+		FrameGraph::TargetDesc colorDesc = { size, size, GL_RGBA8 };
+		std::vector<FrameGraph::Resource> colors;
+		for (int wall = 0; wall < 3; wall++) {
+			vec3 pa, pb, pc;
+			wallCorners(wall, pa, pb, pc);
+			mat4 projection = getProjection(point, pa, pb, pc, 0.01f, 1000.0f);
+			colors.push_back(wallGraph.createTarget("wall cache fill", colorDesc));
+			wallPass(colors[wall], size, projection, pointModelview, wall, 8 + wall);
+		}
+		int eyeIdx = curEyeIdx;
+		wallGraph.addPass("wall cache store", colors, {}, [=]() {
+			GLuint walls[3] = { wallGraph.texture(colors[0]), wallGraph.texture(colors[1]), wallGraph.texture(colors[2]) };
+			wallCache->store(eyeIdx, point, walls);
+		});
+	}
+
+	// One wall blended from the cached walls around the eye, no depth needed
+	void declareCachedWall(int wall, const WallCache::Blend & blend) {
+		int view = wallView(curEyeIdx, wall);
+		FrameGraph::Resource layer = wallGraph.importTexture(wallViewName(view), wallArray, firstWallLayer(curEyeIdx) + wall, 2048, 2048);
+		wallGraph.addPass(wallViewName(view), {}, { layer }, [=]() {
+			wallCache->draw(blend, wall);
+		});
+		wallGraph.markOutput(layer);
+	}
+
+	// The scene around the eye into the eye's cubemap, one layered pass for every wall
+	void declareViewCubemap(const mat4 & modelview, const vec3 & eyePos) {
+		int slot = cubemapSlot(curEyeIdx);
+		if (!viewCubemaps[slot]) {
+			viewCubemaps[slot] = createCubemap(cubemapFaceSize, GL_RGB8);
+		}
+		cubemapCenter[slot] = eyePos;
+		int view = 11 + curEyeIdx, size = cubemapFaceSize;
+		FrameGraph::Resource color = wallGraph.importTexture(wallViewName(view), viewCubemaps[slot], FrameGraph::allLayers, size, size);
+		FrameGraph::Resource depth = wallGraph.importTexture("cubemap depth", cubemapDepth, FrameGraph::allLayers, size, size, GL_DEPTH_COMPONENT24);
+		wallGraph.addPass(wallViewName(view), {}, { color, depth }, [=]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawCubemapScene(modelview, eyePos, view, size);
+			wallTexelsShaded += 6LL * size * size;
+			wallPasses++;
+		});
+		wallGraph.markOutput(color);
+	}
+
+	// drawWallScene into all faces of a cubemap around eyePos at once. The vertex shaders
+	// see one projection taking in everything up to the far plane, cubemap.geom turns it
+	// into each face's.
+	void drawCubemapScene(const mat4 & modelview, const vec3 & eyePos, int view, int resolution) {
+		float nearPlane = 0.01f, farPlane = 1000.0f;
+		mat4 faces[6];
+		cubemapFaces(eyePos, nearPlane, farPlane, faces);
+		mat4 proxy = glm::ortho(-farPlane, farPlane, -farPlane, farPlane, -farPlane, farPlane)
+			* glm::translate(glm::mat4(1.0f), -eyePos);
+		int modelFace = 0;
+		if (model) {
+			// The model's detail as seen on the face its center falls on
+			vec3 toModel = vec3(modelview * model->toWorld[3]) - eyePos;
+			vec3 extent = glm::abs(toModel);
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+			modelFace = axis * 2 + (toModel[axis] < 0.0f ? 1 : 0);
+			modelLod[view] = model->selectLod(view, faces[modelFace] * modelview, resolution);
+			modelTriangles[view] = model->triangles(modelLod[view]);
+		}
+		mat4 fromProxy = glm::inverse(proxy);
+		for (mat4 & face : faces) {
+			face = face * fromProxy;
+		}
+		auto useProgram = [&faces](GLint program) {
+			glUseProgram(program);
+			RenderStats::program(program);
+			glUniformMatrix4fv(glGetUniformLocation(program, "cubeFaces"), 6, GL_FALSE, &faces[0][0][0]);
+		};
+
+		useProgram(cubemapSkyboxProgram);
+		skybox->draw(cubemapSkyboxProgram, proxy, modelview);
+		useProgram(cubemapCubeProgram);
+		cube->draw(cubemapCubeProgram, proxy, modelview);
+		if (crowd && crowd->objectCount()) {
+			// Culled against the proxy, which only drops what lies past the far plane
+			useProgram(cubemapIndirectProgram);
+			crowd->draw(cubemapIndirectProgram, proxy, modelview, cube->texture_ID);
+		}
+		if (model) {
+			useProgram(cubemapMeshProgram);
+			model->draw(cubemapMeshProgram, proxy, modelview, modelLod[view]);
+		}
+	}
+
+	// View and projection of each face of a cubemap around center, in the order of
+	// GL_TEXTURE_CUBE_MAP_POSITIVE_X and on, oriented the way cubemaps are sampled
+	static void cubemapFaces(const vec3 & center, float nearPlane, float farPlane, mat4 faces[6]) {
+		const vec3 forward[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+		const vec3 up[6] = { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+		mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+		for (int face = 0; face < 6; face++) {
+			faces[face] = projection * glm::lookAt(center, center + forward[face], up[face]);
+		}
+	}
+
+	// Cubemap of an eye, see viewCubemaps
+	int cubemapSlot(int eyeIdx) const {
+		return eyeIdx == 1 && separateEyeWalls ? 1 : 0;
+	}
+
+	static GLuint createCubemap(int size, GLenum format) {
+		bool depth = FrameGraph::isDepthFormat(format);
+		GLuint cubemap;
+		glGenTextures(1, &cubemap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		for (int face = 0; face < 6; face++) {
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, format, size, size, 0,
+				depth ? GL_DEPTH_COMPONENT : GL_RGB, depth ? GL_FLOAT : GL_UNSIGNED_BYTE, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return cubemap;
+	}
+
+	// Loads the cubemap programs once and creates the depth cubemap, again whenever
+	// cubemapSize changed. The eyes' cubemaps follow on their first pass. False if a
+	// program fails to build, e.g. without geometry shader invocations.
+	bool initViewCubemap() {
+		if (cubemapFaceSize == cubemapSize) return true;
+		if (cubemapFaceSize) {
+			for (GLuint & cubemap : viewCubemaps) {
+				glDeleteTextures(1, &cubemap);
+				cubemap = 0;
+			}
+			glDeleteTextures(1, &cubemapDepth);
+			wallGraph.releaseCache();
+		}
+		else {
+			cubemapCaveProgram = LoadShaders(CAVE_VERTEX_SHADER_PATH, CUBEMAP_CAVE_FRAGMENT_SHADER_PATH);
+			cubemapSkyboxProgram = LoadShaders(SKYBOX_VERTEX_SHADER_PATH, CUBEMAP_GEOMETRY_SHADER_PATH, SKYBOX_FRAGMENT_SHADER_PATH,
+				CUBEMAP_VERTEX_PRELUDE, "#define CUBEMAP_TEXCOORDS\n#define CUBEMAP_NORMAL\n");
+			cubemapCubeProgram = LoadShaders(CUBE_VERTEX_SHADER_PATH, CUBEMAP_GEOMETRY_SHADER_PATH, CUBE_FRAGMENT_SHADER_PATH,
+				CUBEMAP_VERTEX_PRELUDE, "#define CUBEMAP_UV\n");
+			cubemapIndirectProgram = LoadShaders(INDIRECT_VERTEX_SHADER_PATH, CUBEMAP_GEOMETRY_SHADER_PATH, CUBE_FRAGMENT_SHADER_PATH,
+				CUBEMAP_VERTEX_PRELUDE, "#define CUBEMAP_UV\n");
+			cubemapMeshProgram = LoadShaders(MESH_VERTEX_SHADER_PATH, CUBEMAP_GEOMETRY_SHADER_PATH, MESH_FRAGMENT_SHADER_PATH,
+				CUBEMAP_VERTEX_PRELUDE, "#define CUBEMAP_UV\n#define CUBEMAP_NORMAL\n");
+			if (!cubemapCaveProgram || !cubemapSkyboxProgram || !cubemapCubeProgram || !cubemapIndirectProgram || !cubemapMeshProgram) {
+				std::cerr << "the viewpoint cubemap programs did not build" << std::endl;
+				GLint programs[5] = { cubemapCaveProgram, cubemapSkyboxProgram, cubemapCubeProgram, cubemapIndirectProgram, cubemapMeshProgram };
+				for (GLint program : programs) {
+					if (program) glDeleteProgram(program);
+				}
+				cubemapCaveProgram = cubemapSkyboxProgram = cubemapCubeProgram = cubemapIndirectProgram = cubemapMeshProgram = 0;
+				return false;
+			}
+			// No seams where a wall's directions cross from one face to the next
+			glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+		}
+		cubemapFaceSize = cubemapSize;
+		cubemapDepth = createCubemap(cubemapFaceSize, GL_DEPTH_COMPONENT24);
+		return true;
+	}
+
+	// Turns the wall cache on with an empty grid of cellSize over a cube of side extent
+	// around center, or off. The cache only serves wall views without rotation, as
+	// with the hand held viewer, since the walls of a rotating view differ per rotation.
+	void useWallCache(bool enable, const vec3 & center = vec3(0.0f), float extent = 1.0f, float cellSize = 0.05f) {
+		wallCacheEnabled = enable;
+		if (!enable) return;
+		if (!wallCache) {
+			GLuint program = LoadShaders(WALL_CACHE_VERTEX_SHADER_PATH, WALL_CACHE_FRAGMENT_SHADER_PATH);
+			wallCache = new WallCache(program);
+			std::cout << "wall cache takes up to " << wallCache->budgetBytes() / (1024 * 1024) << " MB of VRAM as it fills" << std::endl;
+		}
+		wallCache->regionMin = center - vec3(extent * 0.5f);
+		wallCache->regionMax = center + vec3(extent * 0.5f);
+		wallCache->cellSize = cellSize;
+		wallCache->clear();
+		wallCache->hits = wallCache->misses = wallCache->fills = wallCache->evictions = 0;
+	}
+
+	void reportWallCache() {
+		if (!wallCache) return;
+		WallCache & cache = *wallCache;
+		long long lookups = cache.hits + cache.misses;
+		std::cout << "wall cache: " << cache.hits << " of " << lookups << " lookups hit ("
+			<< (lookups ? 100.0 * cache.hits / lookups : 0.0) << "%), " << cache.fills << " grid points filled, "
+			<< cache.evictions << " evicted, " << cache.entryCount() << " of " << cache.capacity() << " entries in "
+			<< cache.allocatedBytes() / (1024 * 1024) << " of " << cache.budgetBytes() / (1024 * 1024) << " MB "
+			<< (cache.compressed() ? "DXT1" : "RGBA8") << std::endl;
+	}
+
+	// Changes whenever anything the walls show does, see WallCache::setContent
+	uint64_t wallContent() const {
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void * data, size_t bytes) {
+			for (size_t i = 0; i < bytes; i++) {
+				hash = (hash ^ ((const unsigned char *)data)[i]) * 1099511628211ull;
+			}
+		};
+		int crowdSize = crowd ? crowd->objectCount() : 0;
+		add(&cube->toWorld, sizeof(mat4));
+		add(&IOD, sizeof(IOD));
+		add(&crowdSize, sizeof(crowdSize));
+		add(&model, sizeof(model));
+		add(&stereoSetsSwapped, sizeof(stereoSetsSwapped));
+		return hash;
+	}
+
+	static bool translationOnly(const mat4 & m) {
+		for (int column = 0; column < 3; column++) {
+			for (int row = 0; row < 3; row++) {
+				if (std::abs(m[column][row] - (column == row ? 1.0f : 0.0f)) > 1e-5f) return false;
+			}
+		}
+		return true;
+	}
+
+	// Creates the foveation targets, again whenever surroundScale or insetFraction changed
+	void initFoveation() {
+		int surround = (int)(2048 * surroundScale + 0.5f);
+		int inset = (int)(2048 * insetFraction + 0.5f);
+		if (surround == surroundSize && inset == insetSize) return;
+		if (surroundSize) {
+			glDeleteTextures(1, &surroundArray);
+			glDeleteTextures(1, &insetTexture);
+			wallGraph.releaseCache();
+		}
+		else {
+			foveatedCaveProgram = LoadShaders(CAVE_VERTEX_SHADER_PATH, FOVEATED_CAVE_FRAGMENT_SHADER_PATH);
+		}
+		surroundSize = surround;
+		insetSize = inset;
+		surroundArray = createWallArray(surroundSize, 3);
+		insetTexture = createWallTexture(insetSize);
+	}
+
+	// The viewer's head, the inset goes where its forward ray hits a wall
+	void setGaze(const mat4 & headPose) {
+		gazeOrigin = vec3(headPose[3]);
+		gazeDirection = -vec3(headPose[2]);
+	}
+
+	void updateInset() {
+		insetWall = -1;
+		float nearest = FLT_MAX;
+		vec2 hit;
+		for (int wall = 0; wall < 3; wall++) {
+			vec3 pa, pb, pc;
+			wallCorners(wall, pa, pb, pc);
+			vec3 right = pb - pa, up = pc - pa;
+			vec3 normal = glm::cross(right, up);
+			float facing = glm::dot(gazeDirection, normal);
+			if (std::abs(facing) < 1e-6f) continue;
+			float t = glm::dot(pa - gazeOrigin, normal) / facing;
+			if (t <= 0.0f || t >= nearest) continue;
+			vec3 p = gazeOrigin + gazeDirection * t - pa;
+			// Wall UVs run from pa towards pb and pc, the same as the wall textures
+			vec2 uv(glm::dot(p, right) / glm::dot(right, right), glm::dot(p, up) / glm::dot(up, up));
+			if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) continue;
+			nearest = t;
+			insetWall = wall;
+			hit = uv;
+		}
+		if (insetWall < 0) return;
+		// Keep the whole inset on the wall
+		float half = insetFraction * 0.5f;
+		hit.x = std::min(std::max(hit.x, half), 1.0f - half);
+		hit.y = std::min(std::max(hit.y, half), 1.0f - half);
+		insetRect = vec4(hit.x - half, hit.y - half, hit.x + half, hit.y + half);
+	}
+
+	// Narrows a wall projection down to the part of the wall covered by insetRect
+	mat4 insetProjection(const mat4 & wallProjection) const {
+		vec2 low = vec2(insetRect.x, insetRect.y) * 2.0f - 1.0f;
+		vec2 high = vec2(insetRect.z, insetRect.w) * 2.0f - 1.0f;
+		mat4 crop(1.0f);
+		crop[0][0] = 2.0f / (high.x - low.x);
+		crop[1][1] = 2.0f / (high.y - low.y);
+		crop[3][0] = -(high.x + low.x) / (high.x - low.x);
+		crop[3][1] = -(high.y + low.y) / (high.y - low.y);
+		return crop * wallProjection;
+	}
+
+	// Lower left, lower right and upper left corner of a wall: 0 left, 1 right, 2 bottom.
+	// 3 and 4, across from the left and right wall, and 5, the ceiling, close the cube of
+	// a six wall CAVE; the cave has no quads for them.
+	void wallCorners(int wall, vec3 & pa, vec3 & pb, vec3 & pc) {
+		switch (wall) {
+		case 0:
+			pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, 2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, 2.0f, 1.0f));
+			break;
+		case 1:
+			pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, -2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, -2.0f, 1.0f));
+			break;
+		case 3:
+			pa = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, -2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, 2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(2.0f, 2.0f, -2.0f, 1.0f));
+			break;
+		case 4:
+			pa = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, 2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, 2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(2.0f, 2.0f, 2.0f, 1.0f));
+			break;
+		case 5:
+			pa = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, -2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(2.0f, 2.0f, -2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, 2.0f, 1.0f));
+			break;
+		default:
+			pa = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, 2.0f, 1.0f));
+			pb = glm::vec3(cave->toWorld * vec4(2.0f, -2.0f, 2.0f, 1.0f));
+			pc = glm::vec3(cave->toWorld * vec4(-2.0f, -2.0f, -2.0f, 1.0f));
+			break;
+		}
+	}
+
+	glm::mat4 getProjection(glm::vec3 eyePos, glm::vec3 pa, glm::vec3 pb, glm::vec3 pc, float n, float f) {
+		return offAxisProjection(eyePos, pa, pb, pc, n, f);
+	}
+
+	void render(const mat4 & projection, const mat4 & modelview, const glm::vec3 & eyePos) {
+		// render texture to cave
+		glUseProgram(skyboxShaderProgram);
+		RenderStats::program(skyboxShaderProgram);
+		riftskybox->draw(skyboxShaderProgram, projection, modelview);
+		if (viewCubemap) {
+			int slot = cubemapSlot(curEyeIdx);
+			glUseProgram(cubemapCaveProgram);
+			RenderStats::program(cubemapCaveProgram);
+			cave->drawCubemap(cubemapCaveProgram, projection, modelview, viewCubemaps[slot], cubemapCenter[slot]);
+		}
+		else if (foveated) {
+			glUseProgram(foveatedCaveProgram);
+			RenderStats::program(foveatedCaveProgram);
+			cave->drawFoveated(foveatedCaveProgram, projection, modelview, surroundArray, insetTexture, insetWall, insetRect, insetBlend);
+		}
+		else {
+			glUseProgram(caveShaderProgram);
+			RenderStats::program(caveShaderProgram);
+			cave->draw(caveShaderProgram, projection, modelview, wallArray, firstWallLayer(curEyeIdx));
+		}
+		/*
+		vec3 pc = glm::vec3(cave->toWorld * vec4(-2.0f, 2.0f, 2.0f, 1.0f));
+		if (curEyeIdx == 0) {
+			//linel1->update(pc, eyePos, false);
+		}
+		*/
+		if (buttonAPressed == true) {
+			glUseProgram(lineShaderProgram);
+			RenderStats::program(lineShaderProgram);
+			linel1->draw(lineShaderProgram, projection, modelview);
+			linel2->draw(lineShaderProgram, projection, modelview);
+			linel3->draw(lineShaderProgram, projection, modelview);
+			linel4->draw(lineShaderProgram, projection, modelview);
+			linel5->draw(lineShaderProgram, projection, modelview);
+			linel6->draw(lineShaderProgram, projection, modelview);
+			linel7->draw(lineShaderProgram, projection, modelview);
+			liner1->draw(lineShaderProgram, projection, modelview);
+			liner2->draw(lineShaderProgram, projection, modelview);
+			liner3->draw(lineShaderProgram, projection, modelview);
+			liner4->draw(lineShaderProgram, projection, modelview);
+			liner5->draw(lineShaderProgram, projection, modelview);
+			liner6->draw(lineShaderProgram, projection, modelview);
+			liner7->draw(lineShaderProgram, projection, modelview);
+		}
+	}
+
+	// Both eyes of the eye buffer in one pass. The walls of both eyes must have been
+	// rendered already, viewports are the eyes' rectangles in a target of targetSize.
+	void renderStereo(const mat4 projection[2], const mat4 modelview[2], const ovrRecti viewport[2], const uvec2 & targetSize) {
+		initStereo();
+
+		StereoEyes eyes;
+		vec2 size((float)targetSize.x, (float)targetSize.y);
+		for (int eye = 0; eye < 2; eye++) {
+			eyes.projection[eye] = projection[eye];
+			eyes.view[eye] = modelview[eye];
+			// Map the eye's clip space onto its rectangle of the full target viewport
+			vec2 scale = vec2(viewport[eye].Size.w, viewport[eye].Size.h) / size;
+			vec2 low = vec2(viewport[eye].Pos.x, viewport[eye].Pos.y) * 2.0f / size - 1.0f;
+			vec2 high = low + scale * 2.0f;
+			eyes.viewport[eye] = vec4(scale, (low + high) * 0.5f);
+			eyes.bounds[eye] = vec4(low.x, high.x, low.y, high.y);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, stereoUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(StereoEyes), &eyes);
+		RenderStats::upload(sizeof(StereoEyes));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, 0, stereoUBO);
+
+		if (stereoViewportIndex) {
+			for (int eye = 0; eye < 2; eye++) {
+				glViewportIndexedf(eye, (float)viewport[eye].Pos.x, (float)viewport[eye].Pos.y,
+					(float)viewport[eye].Size.w, (float)viewport[eye].Size.h);
+			}
+		}
+		else {
+			glViewport(0, 0, targetSize.x, targetSize.y);
+			for (int plane = 0; plane < 4; plane++) {
+				glEnable(GL_CLIP_DISTANCE0 + plane);
+			}
+		}
+
+		glUseProgram(stereoSkyboxProgram);
+		RenderStats::program(stereoSkyboxProgram);
+		riftskybox->drawStereo(stereoSkyboxProgram);
+		glUseProgram(stereoCaveProgram);
+		RenderStats::program(stereoCaveProgram);
+		cave->drawStereo(stereoCaveProgram, wallArray, firstWallLayer(1));
+		if (buttonAPressed == true) {
+			glUseProgram(stereoLineProgram);
+			RenderStats::program(stereoLineProgram);
+			Line * lines[14] = { linel1, linel2, linel3, linel4, linel5, linel6, linel7,
+				liner1, liner2, liner3, liner4, liner5, liner6, liner7 };
+			for (Line * line : lines) {
+				line->drawStereo(stereoLineProgram);
+			}
+		}
+
+		if (!stereoViewportIndex) {
+			for (int plane = 0; plane < 4; plane++) {
+				glDisable(GL_CLIP_DISTANCE0 + plane);
+			}
+		}
+	}
+
+	void loadCpuRenderer() {
+		if (cpuRenderer) return;
+		cpuRenderer = new CpuRenderer();
+		cpuRenderer->loadCubemap(0, LEFT_CUBEMAP_PATH);
+		cpuRenderer->loadCubemap(1, RIGHT_CUBEMAP_PATH);
+		cpuRenderer->loadCubeTexture(CUBE_TEXTURE_PATH);
+	}
+
+	void renderCpuWall(ThreadPool & pool, int wall, unsigned char * out) {
+		vec3 pa, pb, pc;
+		wallCorners(wall, pa, pb, pc);
+		glm::mat4 projection = getProjection(wallEyePos, pa, pb, pc, 0.01f, 1000.0f);
+		cpuRenderer->renderWall(pool, wallEyeIdx, projection, wallModelview, wallEyePos, pa, pb, pc,
+			skybox->toWorld, cube->toWorld, cube->vertices, cube->uvs, 36, 2048, out);
+	}
+
+	// Render the last frame's walls on the CPU and compare them with the wall textures
+	void validateCpuWalls() {
+		if (foveated) {
+			std::cout << "the CPU renderer only reproduces full density walls" << std::endl;
+			return;
+		}
+		if (viewCubemap) {
+			std::cout << "the CPU renderer reproduces wall passes, not the viewpoint cubemap" << std::endl;
+			return;
+		}
+		if (virtualSky) {
+			std::cout << "the CPU renderer samples the stereo sets whole, not the virtual sky's resident tiles" << std::endl;
+			return;
+		}
+		if ((crowd && crowd->objectCount()) || model) {
+			std::cout << "the CPU renderer does not draw the crowd or models" << std::endl;
+			return;
+		}
+		loadCpuRenderer();
+		ThreadPool pool;
+		std::vector<unsigned char> gpu(2048 * 2048 * 3), cpu(2048 * 2048 * 3);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		for (int wall = 0; wall < 3; wall++) {
+			if (wallBlanked[wall]) continue;
+			// Wall textures are array layers, read them through their framebuffers
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, wallFBO(wallEyeIdx, wall));
+			glReadPixels(0, 0, 2048, 2048, GL_RGB, GL_UNSIGNED_BYTE, gpu.data());
+			renderCpuWall(pool, wall, cpu.data());
+			ImageDiff diff = CpuRenderer::compare(gpu.data(), cpu.data(), 2048 * 2048, 8);
+			std::cout << "wall " << wall << ": max diff " << diff.maxDiff << ", mean diff " << diff.meanDiff
+				<< ", " << diff.overTolerance * 100.0 << "% texels over tolerance" << std::endl;
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+
+	// Throughput of the CPU wall renderer against the number of cores
+	void benchmarkCpuWalls() {
+		loadCpuRenderer();
+		std::vector<unsigned char> cpu(2048 * 2048 * 3);
+		unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+			ThreadPool pool(threads);
+			const int repeats = 3;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < repeats; i++) {
+				for (int wall = 0; wall < 3; wall++) {
+					renderCpuWall(pool, wall, cpu.data());
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			double walls = repeats * 3;
+			std::cout << threads << " threads: " << seconds * 1000.0 / walls << " ms per 2048x2048 wall, "
+				<< walls * 2048.0 * 2048.0 / seconds / 1e6 << " Mtexels/s" << std::endl;
+			if (threads == maxThreads) break;
+		}
+	}
+
+	void currentEye(int eyeIdx) {
+		curEyeIdx = eyeIdx;
+		//cave->useCubemap(curEyeIdx);
+		skybox->useCubemap(curEyeIdx);
+	}
+
+private:
+
+};
+
+class SimApp : public RiftApp {
+	std::shared_ptr<SimScene> simScene;
+	// The simulation runs at its own fixed rate, independent of the frame rate
+	FixedTimestep simClock;
+
+public:
+	// modelPath is an OBJ or cooked mesh to show in the walls, projectorSetup the
+	// projectors to show them on, see loadProjectorSetup, virtualSkyPath a cooked virtual
+	// cubemap of the stereo sets, see cookVirtualCubemap; empty for none
+	SimApp(double simulationRate = 90.0, const std::string & modelPath = "", const std::string & projectorSetup = "",
+		const std::string & virtualSkyPath = "")
+		: simClock(simulationRate), modelPath(modelPath), projectorSetup(projectorSetup), virtualSkyPath(virtualSkyPath) {}
+	glm::mat4 lastHeadPose;
+	glm::mat4 rightHandPose;
+	glm::vec3 triggerPose;
+	glm::mat4 lastRightHand;
+	// Extrapolates the hand to the display time when it is used as the CAVE viewer
+	PosePredictor handPredictor;
+	// Raw right hand samples recorded with the T key, for tuning handPredictor offline
+	std::vector<ovrPoseStatef> handTrace;
+	bool recordingHandTrace = false;
+	// Both eyes in one instanced pass, toggled with the I key
+	bool stereoPass = false;
+	// Cubes around the cave with the O key
+	int crowdSize = 10000;
+	std::string modelPath;
+	// The walls on real projectors, handed over after every frame
+	std::string projectorSetup;
+	std::unique_ptr<ProjectorOutput> projectors;
+	std::string virtualSkyPath;
+protected:
+
+	void initGl() override {
+		RiftApp::initGl();
+		SimScene::initGlState();
+		ovr_RecenterTrackingOrigin(_session);
+		simScene = std::shared_ptr<SimScene>(new SimScene());
+		if (!modelPath.empty()) {
+			simScene->loadModel(modelPath);
+		}
+		if (!virtualSkyPath.empty()) {
+			simScene->loadVirtualSky(virtualSkyPath);
+		}
+		std::vector<ProjectorCalibration> calibrations;
+		if (!projectorSetup.empty() && loadProjectorSetup(projectorSetup, calibrations)) {
+			// Projectors may show either eye, so both eyes' walls have to last the frame
+			simScene->separateWalls();
+			projectors = std::unique_ptr<ProjectorOutput>(new ProjectorOutput(
+				LoadShaders(PROJECTOR_VERTEX_SHADER_PATH, PROJECTOR_FRAGMENT_SHADER_PATH)));
+			if (!projectors->open(calibrations, window)) {
+				projectors.reset();
+			}
+		}
+	}
+
+	void shutdownGl() override {
+		projectors.reset();
+	}
+
+	void finishFrame() override {
+		RiftApp::finishFrame();
+		if (projectors) {
+			int firstLayer[2] = { simScene->firstWallLayer(0), simScene->firstWallLayer(1) };
+			projectors->present(simScene->wallArray, firstLayer);
+		}
+	}
+
+	void onKey(int key, int scancode, int action, int mods) override {
+		if (GLFW_PRESS == action) switch (key) {
+		case GLFW_KEY_C:
+			simScene->validateCpuWalls();
+			return;
+		case GLFW_KEY_V:
+			simScene->benchmarkCpuWalls();
+			return;
+		case GLFW_KEY_T:
+			recordingHandTrace = !recordingHandTrace;
+			if (recordingHandTrace) {
+				handTrace.clear();
+			}
+			else if (savePoseTrace("hand-trace.txt", handTrace)) {
+				std::cout << "saved " << handTrace.size() << " hand samples to hand-trace.txt" << std::endl;
+			}
+			return;
+		case GLFW_KEY_F:
+			if (projectors && !simScene->foveated) {
+				std::cout << "the projectors show the full density walls, foveated walls stay off" << std::endl;
+				return;
+			}
+			simScene->foveated = !simScene->foveated;
+			if (simScene->foveated) {
+				simScene->initFoveation();
+				stereoPass = false;
+				simScene->viewCubemap = false;
+			}
+			std::cout << "foveated walls " << (simScene->foveated ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_I:
+			stereoPass = !stereoPass;
+			// The stereo pass samples full density walls only
+			if (stereoPass) {
+				simScene->foveated = false;
+				simScene->viewCubemap = false;
 			}
-			if (inputState.Buttons & ovrButton_B) simScene->buttonBPressed = true;
-			else if (simScene->buttonBPressed) {
-				simScene->buttonB = (simScene->buttonB + 1) % 2; simScene->buttonBPressed = false;
+			std::cout << "single pass stereo " << (stereoPass ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_D:
+			simScene->reportLods();
+			return;
+		case GLFW_KEY_O:
+			simScene->setCrowd(simScene->crowd && simScene->crowd->objectCount() ? 0 : crowdSize);
+			std::cout << "crowd of " << simScene->crowd->objectCount() << " cubes, "
+				<< (simScene->crowd->gpuCulling ? "GPU" : "CPU") << " culling" << std::endl;
+			return;
+		case GLFW_KEY_K:
+			simScene->swapStereoCubemaps();
+			return;
+		case GLFW_KEY_J:
+			// The last eye's wall passes and what sharing their depth buffers saves
+			simScene->wallGraph.print(std::cout);
+			return;
+		case GLFW_KEY_H:
+			// Around where the hand is, the cache serves the hand held viewer only
+			if (simScene->wallCacheEnabled) simScene->reportWallCache();
+			simScene->useWallCache(!simScene->wallCacheEnabled, triggerPose);
+			std::cout << "wall cache " << (simScene->wallCacheEnabled ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_U:
+			if (projectors) {
+				std::cout << "the projectors show the wall textures, viewpoint cubemap walls stay off" << std::endl;
+				return;
 			}
-			if (inputState.Buttons & ovrButton_X) simScene->buttonXPressed = true;
-			else if (simScene->buttonXPressed) {
-				simScene->buttonX = (simScene->buttonX + 1) % 2; simScene->buttonXPressed = false, simScene->randomGened = false;
+			simScene->viewCubemap = !simScene->viewCubemap && simScene->initViewCubemap();
+			if (simScene->viewCubemap) {
+				// Both sample the wall textures
+				stereoPass = false;
+				simScene->foveated = false;
 			}
+			std::cout << "viewpoint cubemap walls " << (simScene->viewCubemap ? "on" : "off") << std::endl;
+			return;
+		case GLFW_KEY_B:
+			simScene->reportVirtualSky();
+			return;
+		case GLFW_KEY_Y:
+			handPredictor.enabled = !handPredictor.enabled;
+			std::cout << "hand prediction " << (handPredictor.enabled ? "on" : "off") << std::endl;
+			return;
+		}
+
+		RiftApp::onKey(key, scancode, action, mods);
+	}
 
-			if (inputState.HandTrigger[ovrHand_Right] > 0.5f) simScene->rightHandTriggerPressed = true;
-			else simScene->rightHandTriggerPressed = false;
+	void update() override {
+		ovrInputState inputState;
+		// Simulate up to the time the frame will be seen, not the time it is rendered
+		double displayMidpointSeconds = ovr_GetPredictedDisplayTime(_session, frame);
+		ovrTrackingState trackState = ovr_GetTrackingState(_session, displayMidpointSeconds, ovrTrue);
+		if (OVR_SUCCESS(ovr_GetInputState(_session, ovrControllerType_Touch, &inputState))) {
+			simScene->handleInput(inputState);
 
 			ovrPosef rightPose = trackState.HandPoses[ovrHand_Right].ThePose;
 			rightHandPose = ovr::toGlm(rightPose);
 			triggerPose = glm::vec3(rightPose.Position.x, rightPose.Position.y, rightPose.Position.z);
 
-			if (inputState.Buttons & ovrButton_RThumb) {
-				simScene->cubeX = 0.0f;
-				simScene->cubeZ = -0.5f;
-			}
-			else {
-				if (inputState.Thumbstick[ovrHand_Right].x > 0.5f) simScene->cubeX += 0.001f;
-				else if (inputState.Thumbstick[ovrHand_Right].x < -0.5f) simScene->cubeX -= 0.001f;
-				if (inputState.Thumbstick[ovrHand_Right].y > 0.5f) simScene->cubeZ -= 0.001f;
-				else if (inputState.Thumbstick[ovrHand_Right].y < -0.5f) simScene->cubeZ += 0.001f;
-			}
-			if (inputState.Buttons & ovrButton_LThumb) simScene->cubeSize = 0.03f;
-			else {
-				if (inputState.Thumbstick[ovrHand_Left].x > 0.5f) simScene->cubeSize = std::min(simScene->cubeSize + 0.001f, 0.1f);
-				else if (inputState.Thumbstick[ovrHand_Left].x < -0.5f) simScene->cubeSize = std::max(simScene->cubeSize - 0.001f, 0.001f);
+			// The latest measured hand state, predicted forward per wall pass in offscreenRender
+			ovrPoseStatef rightState = ovr_GetTrackingState(_session, 0.0, ovrFalse).HandPoses[ovrHand_Right];
+			handPredictor.update(rightState);
+			if (recordingHandTrace) {
+				handTrace.push_back(rightState);
 			}
 		}
-		simScene->update();
+		else {
+			// Without focus or controllers the last sticks would keep moving the cube
+			simScene->releaseSticks();
+		}
+		int steps = simClock.advance(displayMidpointSeconds);
+		for (int i = 0; i < steps; i++) {
+			simScene->step((float)simClock.stepSeconds());
+		}
+		simScene->update(simClock.alpha());
+		simScene->updateUploads();
 	}
 
 	void offscreenRender(const glm::mat4 & projection, const glm::mat4 & headPose, GLuint _fbo, const ovrRecti & vp, const glm::vec3 & eyePos) {
 		if (simScene->rightHandTriggerPressed) {
 			glm::mat4 no_rot = glm::mat4(1.0f);
 			if (getTrackingState() == 0) {
-				no_rot[3] = rightHandPose[3];
+				ovrPosef predicted = handPredictor.predict(ovr_GetPredictedDisplayTime(_session, frame));
+				no_rot[3] = glm::vec4(ovr::toGlm(predicted.Position), 1.0f);
 				//no_rot = rightHandPose;
 				lastRightHand = rightHandPose;
 			}
@@ -1049,6 +2247,33 @@ protected:
 		simScene->render(projection, glm::inverse(headPose), eyePos);
 	}
 
+	void gazePose(const glm::mat4 & head) override {
+		simScene->setGaze(head);
+	}
+
+	bool instancedStereo() override {
+		if (stereoPass) {
+			// Before the wall passes, so the right eye already renders into its own walls
+			simScene->initStereo();
+		}
+		return stereoPass;
+	}
+
+	void renderSceneStereo(const glm::mat4 projection[2], const glm::mat4 headPose[2], const ovrRecti viewport[2], const uvec2 & targetSize) override {
+		mat4 modelview[2] = { glm::inverse(headPose[0]), glm::inverse(headPose[1]) };
+		simScene->renderStereo(projection, modelview, viewport, targetSize);
+	}
+
+	bool hudVisible() override {
+		return simScene->hudVisible;
+	}
+
+	int wallPassCount() override {
+		int passes = simScene->wallPasses;
+		simScene->wallPasses = 0;
+		return passes;
+	}
+
 	void currentEye(ovrEyeType eye) {
 		if (eye == ovrEye_Left) {
 			simScene->currentEye(0);
@@ -1063,18 +2288,1447 @@ protected:
 	float getCubeSize() { return simScene->cubeSize; }
 };
 
-// Execute our example class
-int __stdcall WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-	int result = -1;
-	try {
+//////////////////////////////////////////////////////////////////////
+//
+// Offline rendering of recorded viewer poses, no HMD required
+//
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// One line of a pose list: "eye px py pz qx qy qz qw", eye is 0 for left and 1 for right.
+// Empty lines and lines starting with # are skipped.
+struct BatchPose {
+	int eyeIdx;
+	ovrPosef pose;
+};
+
+bool loadPoseList(const std::string & path, std::vector<BatchPose> & poses) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "could not open pose list " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		BatchPose bp;
+		ovrVector3f & p = bp.pose.Position;
+		ovrQuatf & q = bp.pose.Orientation;
+		if (fields >> bp.eyeIdx >> p.x >> p.y >> p.z >> q.x >> q.y >> q.z >> q.w) {
+			poses.push_back(bp);
+		}
+		else {
+			std::cerr << "skipping malformed pose: " << line << std::endl;
+		}
+	}
+	return !poses.empty();
+}
+
+// Color texture plus depth buffer standing in for an eye of the HMD swap chain
+struct EyeTarget {
+	GLuint fbo = 0, colorTexture = 0, depthBuffer = 0;
+	uvec2 size;
+
+	void create(const uvec2 & targetSize) {
+		size = targetSize;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glGenTextures(1, &colorTexture);
+		glBindTexture(GL_TEXTURE_2D, colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, size.x, size.y);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		checkFramebufferStatus();
+	}
+
+	void destroy() {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &colorTexture);
+		glDeleteRenderbuffers(1, &depthBuffer);
+	}
+
+	ovrRecti viewport() const {
+		ovrRecti vp;
+		vp.Pos.x = vp.Pos.y = 0;
+		vp.Size.w = size.x;
+		vp.Size.h = size.y;
+		return vp;
+	}
+};
+
+// Renders the wall textures and an eye view for every pose of a pose list into PPM
+// files. Every worker thread renders into its own hidden GLFW context; all of them
+// share objects with the main context, which loads the textures once. Each links its own
+// programs, since uniforms set by one context would show in the draws of the others.
+class BatchApp : public GlfwApp {
+	std::string posePath, outputDir;
+	unsigned int threadCount;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> sharedScene;
+
+public:
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+
+	BatchApp(const std::string & posePath, const std::string & outputDir, unsigned int threadCount)
+		: posePath(posePath), outputDir(outputDir), threadCount(std::max(1u, threadCount)) {}
+
+	int run() override {
+		if (!loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		// Contexts have to be created on the main thread, the workers only make them current
+		std::vector<GLFWwindow *> contexts;
+		for (unsigned int i = 0; i < threadCount; i++) {
+			GLFWwindow * context = glfwCreateWindow(64, 64, "batch", nullptr, window);
+			if (!context) {
+				FAIL("Unable to create a shared rendering context");
+			}
+			contexts.push_back(context);
+		}
+
+		std::atomic<int> next(0);
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> workers;
+		for (GLFWwindow * context : contexts) {
+			workers.push_back(std::thread(&BatchApp::renderPoses, this, context, std::ref(next)));
+		}
+		for (auto & worker : workers) {
+			worker.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// Three walls and one eye view per pose
+		double images = poses.size() * 4.0;
+		std::cout << poses.size() << " poses, " << images << " images in " << seconds << " s on "
+			<< threadCount << " contexts: " << images / seconds << " images/s" << std::endl;
+
+		for (GLFWwindow * context : contexts) {
+			glfwDestroyWindow(context);
+		}
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		sharedScene = std::shared_ptr<SimScene>(new SimScene());
+		// Uploads must be complete before other contexts sample the textures
+		glFinish();
+	}
+
+	void draw() override {}
+
+private:
+	void renderPoses(GLFWwindow * context, std::atomic<int> & next) {
+		glfwMakeContextCurrent(context);
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+		// VAOs, framebuffers and uniforms are not shared between contexts, so every worker
+		// has its own scene, freed before its context is released
+		{
+			SimScene scene(sharedScene.get());
+
+			EyeTarget target;
+			target.create(eyeSize);
+			GLuint fbo = target.fbo;
+			ovrRecti vp = target.viewport();
+			mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+
+			GLuint wallFBOs[3] = { scene.lFBO, scene.rFBO, scene.bFBO };
+			const char * wallNames[3] = { "left", "right", "bottom" };
+			std::vector<unsigned char> pixels(std::max(2048u * 2048u, eyeSize.x * eyeSize.y) * 3);
+			for (int i = next++; i < (int)poses.size(); i = next++) {
+				const BatchPose & bp = poses[i];
+				mat4 modelview = glm::inverse(ovr::toGlm(bp.pose));
+				vec3 eyePos = ovr::toGlm(bp.pose.Position);
+
+				scene.currentEye(bp.eyeIdx);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+				glViewport(0, 0, eyeSize.x, eyeSize.y);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				scene.preRender(projection, modelview, fbo, vp, eyePos);
+				scene.render(projection, modelview, eyePos);
+
+				char prefix[32];
+				sprintf(prefix, "/pose%05d_", i);
+				for (int wall = 0; wall < 3; wall++) {
+					glBindFramebuffer(GL_READ_FRAMEBUFFER, wallFBOs[wall]);
+					glReadPixels(0, 0, 2048, 2048, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+					writePPM(outputDir + prefix + wallNames[wall] + ".ppm", pixels.data(), 2048, 2048);
+				}
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+				glReadPixels(0, 0, eyeSize.x, eyeSize.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+				writePPM(outputDir + prefix + "eye.ppm", pixels.data(), eyeSize.x, eyeSize.y);
+			}
+
+			target.destroy();
+		}
+		glfwMakeContextCurrent(nullptr);
+	}
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Image and frame time regression test, runs on any GL 4.1 driver. To run it
+// without a GPU put Mesa's llvmpipe opengl32.dll next to the executable.
+//
+
+#include "ImageCompare.h"
+
+// pixels come straight from glReadPixels, bottom row first. Passes when at most
+// maxBadFraction of the texels are above tolerance, see comparePerceptual.
+bool checkGolden(const std::string & path, const unsigned char * pixels, int width, int height, float tolerance, double maxBadFraction) {
+	int goldenWidth, goldenHeight;
+	unsigned char * golden = loadPPM(path.c_str(), goldenWidth, goldenHeight);
+	if (!golden) {
+		return false;
+	}
+	if (goldenWidth != width || goldenHeight != height) {
+		std::cerr << path << ": golden is " << goldenWidth << "x" << goldenHeight
+			<< ", rendered " << width << "x" << height << std::endl;
+		delete[] golden;
+		return false;
+	}
+	// PPM rows go top to bottom
+	std::vector<unsigned char> flipped(width * height * 3);
+	for (int y = 0; y < height; y++) {
+		memcpy(&flipped[y * width * 3], pixels + (height - 1 - y) * width * 3, width * 3);
+	}
+	PerceptualDiff diff = comparePerceptual(golden, flipped.data(), width, height, tolerance);
+	delete[] golden;
+
+	bool passed = diff.badFraction <= maxBadFraction;
+	if (!passed) {
+		std::cout << path << ": " << diff.badFraction * 100.0 << "% texels differ, max delta "
+			<< diff.maxDelta << ", mean delta " << diff.meanDelta << std::endl;
+	}
+	return passed;
+}
+
+// A cube pushed by both thumbsticks has to stand still once the input is gone, as when
+// the app loses focus or the controllers drop out
+bool checkControlsWithoutInput() {
+	SimControls controls;
+	ovrInputState input = {};
+	input.Thumbstick[ovrHand_Right].x = 1.0f;
+	input.Thumbstick[ovrHand_Right].y = 1.0f;
+	input.Thumbstick[ovrHand_Left].x = 1.0f;
+	controls.handleInput(input);
+	controls.step(1.0f / 90.0f);
+	if (controls.cubeX == controls.prevCubeX || controls.cubeSize == controls.prevCubeSize) {
+		std::cout << "controls: the thumbsticks did not move the cube" << std::endl;
+		return false;
+	}
+	controls.releaseSticks();
+	float x = controls.cubeX, z = controls.cubeZ, size = controls.cubeSize;
+	for (int i = 0; i < 90; i++) {
+		controls.step(1.0f / 90.0f);
+	}
+	if (controls.cubeX != x || controls.cubeZ != z || controls.cubeSize != size) {
+		std::cout << "controls: the cube moved without input" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Renders the poses of a pose list through SimScene::preRender and render, the
+// same path the HMD frames take, and checks the three wall textures and the eye
+// image of every pose against the goldens in a directory, named like the output
+// of BatchApp (pose00000_left.ppm, ...). The median CPU and GPU time of both
+// stages is checked against timings.txt in the same directory, a stage missing
+// from it fails, and the controls against checkControlsWithoutInput. With update
+// set the goldens and timings are written instead. run() returns 1 on a regression.
+class RegressionApp : public GlfwApp {
+	std::string posePath, goldenDir;
+	bool updateGoldens;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> scene;
+
+	enum Stage { STAGE_PRERENDER, STAGE_RENDER, STAGE_COUNT };
+
+public:
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+	// Perceptual units, see comparePerceptual
+	float imageTolerance = 6.0f;
+	// Fraction of texels allowed above imageTolerance
+	double maxBadFraction = 0.001;
+	// A stage regresses when its median grows by more than this fraction and
+	// by more than minTimingRegressionMs, the latter keeps noise on tiny stages out
+	double timingTolerance = 0.15;
+	double minTimingRegressionMs = 0.05;
+	// Times every pose is rendered, the timings are the median over all of them
+	int repeats = 5;
+
+	RegressionApp(const std::string & posePath, const std::string & goldenDir, bool updateGoldens)
+		: posePath(posePath), goldenDir(goldenDir), updateGoldens(updateGoldens) {}
+
+	int run() override {
+		if (!loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+		std::cout << "GL renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+		EyeTarget target;
+		target.create(eyeSize);
+		ovrRecti vp = target.viewport();
+		mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+		StageTimer timer(STAGE_COUNT);
+		std::vector<double> cpuSamples[STAGE_COUNT], gpuSamples[STAGE_COUNT];
+
+		GLuint wallFBOs[3] = { scene->lFBO, scene->rFBO, scene->bFBO };
+		const char * wallNames[3] = { "left", "right", "bottom" };
+		std::vector<unsigned char> pixels(std::max(2048u * 2048u, eyeSize.x * eyeSize.y) * 3);
+		bool passed = checkControlsWithoutInput();
+		for (size_t i = 0; i < poses.size(); i++) {
+			const BatchPose & bp = poses[i];
+			mat4 modelview = glm::inverse(ovr::toGlm(bp.pose));
+			vec3 eyePos = ovr::toGlm(bp.pose.Position);
+
+			scene->currentEye(bp.eyeIdx);
+			for (int r = 0; r < repeats; r++) {
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, eyeSize.x, eyeSize.y);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				timer.begin(STAGE_PRERENDER);
+				scene->preRender(projection, modelview, target.fbo, vp, eyePos);
+				timer.end(STAGE_PRERENDER);
+				timer.begin(STAGE_RENDER);
+				scene->render(projection, modelview, eyePos);
+				timer.end(STAGE_RENDER);
+				timer.collect();
+				for (int stage = 0; stage < STAGE_COUNT; stage++) {
+					cpuSamples[stage].push_back(timer.cpuMs(stage));
+					gpuSamples[stage].push_back(timer.gpuMs(stage));
+				}
+			}
+
+			char prefix[32];
+			sprintf(prefix, "/pose%05d_", (int)i);
+			for (int wall = 0; wall < 3; wall++) {
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, wallFBOs[wall]);
+				glReadPixels(0, 0, 2048, 2048, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+				passed &= checkImage(goldenDir + prefix + wallNames[wall] + ".ppm", pixels.data(), 2048, 2048);
+			}
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+			glReadPixels(0, 0, eyeSize.x, eyeSize.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			passed &= checkImage(goldenDir + prefix + "eye.ppm", pixels.data(), eyeSize.x, eyeSize.y);
+		}
+		target.destroy();
+
+		const char * stageNames[STAGE_COUNT] = { "preRender", "render" };
+		double cpuMs[STAGE_COUNT], gpuMs[STAGE_COUNT];
+		for (int stage = 0; stage < STAGE_COUNT; stage++) {
+			cpuMs[stage] = median(cpuSamples[stage]);
+			gpuMs[stage] = median(gpuSamples[stage]);
+		}
+		std::string timingPath = goldenDir + "/timings.txt";
+		if (updateGoldens) {
+			std::ofstream file(timingPath);
+			file << "# stage cpu_ms gpu_ms, medians over " << poses.size() << " poses x " << repeats << " repeats" << std::endl;
+			for (int stage = 0; stage < STAGE_COUNT; stage++) {
+				file << stageNames[stage] << " " << cpuMs[stage] << " " << gpuMs[stage] << std::endl;
+				std::cout << stageNames[stage] << ": cpu " << cpuMs[stage] << " ms, gpu " << gpuMs[stage] << " ms" << std::endl;
+			}
+			std::cout << "wrote goldens for " << poses.size() << " poses to " << goldenDir << std::endl;
+			return 0;
+		}
+
+		// Without a baseline the timings can't be checked, which fails the run
+		std::map<std::string, std::pair<double, double>> baseline;
+		std::ifstream file(timingPath);
+		if (!file.is_open()) {
+			std::cout << "could not open " << timingPath << ", run with --update to write a baseline" << std::endl;
+			passed = false;
+		}
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty() || line[0] == '#') continue;
+			std::istringstream fields(line);
+			std::string name;
+			double cpu, gpu;
+			if (fields >> name >> cpu >> gpu) {
+				baseline[name] = std::make_pair(cpu, gpu);
+			}
+		}
+		for (int stage = 0; stage < STAGE_COUNT; stage++) {
+			std::cout << stageNames[stage] << ": cpu " << cpuMs[stage] << " ms, gpu " << gpuMs[stage] << " ms";
+			auto found = baseline.find(stageNames[stage]);
+			if (found == baseline.end()) {
+				std::cout << " NO BASELINE" << std::endl;
+				passed = false;
+				continue;
+			}
+			bool cpuSlower = isSlower(cpuMs[stage], found->second.first);
+			bool gpuSlower = isSlower(gpuMs[stage], found->second.second);
+			std::cout << ", baseline cpu " << found->second.first << " ms, gpu " << found->second.second << " ms"
+				<< (cpuSlower ? " CPU REGRESSION" : "") << (gpuSlower ? " GPU REGRESSION" : "") << std::endl;
+			passed &= !cpuSlower && !gpuSlower;
+		}
+
+		std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+		return passed ? 0 : 1;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		scene = std::shared_ptr<SimScene>(new SimScene());
+	}
+
+	void draw() override {}
+
+private:
+	bool checkImage(const std::string & path, const unsigned char * pixels, int width, int height) {
+		if (updateGoldens) {
+			return writePPM(path, pixels, width, height);
+		}
+		return checkGolden(path, pixels, width, height, imageTolerance, maxBadFraction);
+	}
+
+	bool isSlower(double current, double baseline) {
+		return current > baseline * (1.0 + timingTolerance) && current - baseline > minTimingRegressionMs;
+	}
+
+	static double median(std::vector<double> samples) {
+		if (samples.empty()) return 0.0;
+		std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+		return samples[samples.size() / 2];
+	}
+};
+
+// Headless check of the projector output. The projectors of a setup get hidden windows
+// sharing the scene's context and render offscreen. First each wall of the first pose
+// goes through an identity warp at the wall's own size, which has to reproduce the
+// wall. Then for every pose the walls of both eyes are rendered from it and the image
+// of every projector is checked against the golden of the same name in a directory
+// (pose00000_projector0.ppm, ...), or written there with update set. run() returns 1
+// on a failure.
+class ProjectorTestApp : public GlfwApp {
+	std::string setupPath, posePath, goldenDir;
+	bool updateGoldens;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> scene;
+	GLuint projectorProgram = 0;
+
+public:
+	// Only preRender draws into it
+	uvec2 eyeSize{ 256, 256 };
+	float eyeFov = 90.0f;
+	// Perceptual units, see comparePerceptual
+	float imageTolerance = 6.0f;
+	double maxBadFraction = 0.001;
+
+	ProjectorTestApp(const std::string & setupPath, const std::string & posePath, const std::string & goldenDir, bool updateGoldens)
+		: setupPath(setupPath), posePath(posePath), goldenDir(goldenDir), updateGoldens(updateGoldens) {}
+
+	int run() override {
+		std::vector<ProjectorCalibration> calibrations;
+		if (!loadProjectorSetup(setupPath, calibrations) || !loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		EyeTarget target;
+		target.create(eyeSize);
+		int firstLayer[2] = { scene->firstWallLayer(0), scene->firstWallLayer(1) };
+		bool passed = true;
+
+		renderWalls(poses[0], target);
+		{
+			std::vector<ProjectorCalibration> identities;
+			for (int wall = 0; wall < 3; wall++) {
+				identities.push_back(ProjectorCalibration::identity(wall, 0, 2048, 2048));
+			}
+			ProjectorOutput identity(projectorProgram);
+			if (!identity.open(identities, window, false)) {
+				return -1;
+			}
+			std::vector<unsigned char> wallPixels(2048 * 2048 * 3), projected;
+			for (int wall = 0; wall < 3; wall++) {
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, scene->wallFBO(0, wall));
+				glReadPixels(0, 0, 2048, 2048, GL_RGB, GL_UNSIGNED_BYTE, wallPixels.data());
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+				identity.renderOffscreen(wall, scene->wallArray, firstLayer, projected);
+				PerceptualDiff diff = comparePerceptual(wallPixels.data(), projected.data(), 2048, 2048, imageTolerance);
+				bool reproduced = diff.badFraction <= maxBadFraction;
+				std::cout << "identity warp of wall " << wall << ": " << (reproduced ? "reproduces it" : "DIFFERS") << ", "
+					<< diff.badFraction * 100.0 << "% texels over tolerance, max delta " << diff.maxDelta << std::endl;
+				passed &= reproduced;
+			}
+		}
+
+		ProjectorOutput projectors(projectorProgram);
+		if (!projectors.open(calibrations, window, false)) {
+			return -1;
+		}
+		std::vector<unsigned char> pixels;
+		for (size_t i = 0; i < poses.size(); i++) {
+			renderWalls(poses[i], target);
+			for (int projector = 0; projector < projectors.count(); projector++) {
+				projectors.renderOffscreen(projector, scene->wallArray, firstLayer, pixels);
+				char name[48];
+				sprintf(name, "/pose%05d_projector%d.ppm", (int)i, projector);
+				glm::ivec2 size = projectors.size(projector);
+				if (updateGoldens) {
+					passed &= writePPM(goldenDir + name, pixels.data(), size.x, size.y);
+				}
+				else {
+					passed &= checkGolden(goldenDir + name, pixels.data(), size.x, size.y, imageTolerance, maxBadFraction);
+				}
+			}
+		}
+		target.destroy();
+
+		if (updateGoldens) {
+			std::cout << "wrote goldens of " << projectors.count() << " projectors for " << poses.size() << " poses to " << goldenDir << std::endl;
+		}
+		std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+		return passed ? 0 : 1;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		scene = std::shared_ptr<SimScene>(new SimScene());
+		scene->separateWalls();
+		projectorProgram = LoadShaders(PROJECTOR_VERTEX_SHADER_PATH, PROJECTOR_FRAGMENT_SHADER_PATH);
+	}
+
+	void draw() override {}
+
+private:
+	// The walls of both eyes as seen from the pose
+	void renderWalls(const BatchPose & bp, EyeTarget & target) {
+		mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+		mat4 modelview = glm::inverse(ovr::toGlm(bp.pose));
+		vec3 eyePos = ovr::toGlm(bp.pose.Position);
+		for (int eye = 0; eye < 2; eye++) {
+			scene->currentEye(eye);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, eyeSize.x, eyeSize.y);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			scene->preRender(projection, modelview, target.fbo, target.viewport(), eyePos);
+		}
+	}
+};
+
+// Fill savings of the foveated walls against the error they cause, on a pose list.
+// Every pose is rendered with full density walls and then foveated at each surround
+// density. The gaze is the pose itself, so the inset lands in the middle of the eye
+// image; the error is reported for the whole image and for its middle quarter.
+class FoveationApp : public GlfwApp {
+	std::string posePath;
+	float insetFraction;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> scene;
+
+public:
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+	// Perceptual units, see comparePerceptual
+	float imageTolerance = 6.0f;
+	std::vector<float> surroundScales{ 0.25f, 0.5f, 0.75f };
+
+	FoveationApp(const std::string & posePath, float insetFraction)
+		: posePath(posePath), insetFraction(insetFraction) {}
+
+	int run() override {
+		if (!loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		EyeTarget target;
+		target.create(eyeSize);
+		mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+		size_t imageBytes = eyeSize.x * eyeSize.y * 3;
+
+		std::vector<unsigned char> references(poses.size() * imageBytes), pixels(imageBytes);
+		long long fullFill = 0;
+		scene->foveated = false;
+		for (size_t i = 0; i < poses.size(); i++) {
+			renderPose(poses[i], target, projection, &references[i * imageBytes]);
+			fullFill += scene->wallTexelsShaded;
+		}
+		std::cout << poses.size() << " poses, full density walls shade " << fullFill / poses.size()
+			<< " texels per pose" << std::endl;
+
+		scene->insetFraction = insetFraction;
+		for (float surroundScale : surroundScales) {
+			scene->surroundScale = surroundScale;
+			scene->initFoveation();
+			scene->foveated = true;
+			long long fill = 0;
+			PerceptualDiff whole, middle;
+			for (size_t i = 0; i < poses.size(); i++) {
+				scene->setGaze(ovr::toGlm(poses[i].pose));
+				renderPose(poses[i], target, projection, pixels.data());
+				fill += scene->wallTexelsShaded;
+				accumulate(whole, compare(&references[i * imageBytes], pixels.data(), 0));
+				accumulate(middle, compare(&references[i * imageBytes], pixels.data(), eyeSize.x / 4));
+			}
+			std::cout << "surround " << surroundScale << ", inset " << insetFraction << ": "
+				<< 100.0 * (1.0 - (double)fill / fullFill) << "% less fill; whole image mean delta "
+				<< whole.meanDelta / poses.size() << ", max " << whole.maxDelta << ", "
+				<< 100.0 * whole.badFraction / poses.size() << "% over tolerance; middle mean delta "
+				<< middle.meanDelta / poses.size() << ", max " << middle.maxDelta << ", "
+				<< 100.0 * middle.badFraction / poses.size() << "% over tolerance" << std::endl;
+		}
+		target.destroy();
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		scene = std::shared_ptr<SimScene>(new SimScene());
+	}
+
+	void draw() override {}
+
+private:
+	void renderPose(const BatchPose & bp, EyeTarget & target, const mat4 & projection, unsigned char * out) {
+		mat4 modelview = glm::inverse(ovr::toGlm(bp.pose));
+		vec3 eyePos = ovr::toGlm(bp.pose.Position);
+		scene->currentEye(bp.eyeIdx);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+		glViewport(0, 0, eyeSize.x, eyeSize.y);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene->preRender(projection, modelview, target.fbo, target.viewport(), eyePos);
+		scene->render(projection, modelview, eyePos);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+		glReadPixels(0, 0, eyeSize.x, eyeSize.y, GL_RGB, GL_UNSIGNED_BYTE, out);
+	}
+
+	// Compares the images without a border of margin texels on every side
+	PerceptualDiff compare(const unsigned char * reference, const unsigned char * image, int margin) {
+		int width = eyeSize.x - 2 * margin, height = eyeSize.y - 2 * margin;
+		std::vector<unsigned char> a(width * height * 3), b(width * height * 3);
+		for (int y = 0; y < height; y++) {
+			size_t offset = ((y + margin) * eyeSize.x + margin) * 3;
+			memcpy(&a[y * width * 3], reference + offset, width * 3);
+			memcpy(&b[y * width * 3], image + offset, width * 3);
+		}
+		return comparePerceptual(a.data(), b.data(), width, height, imageTolerance);
+	}
+
+	static void accumulate(PerceptualDiff & total, const PerceptualDiff & diff) {
+		total.maxDelta = std::max(total.maxDelta, diff.maxDelta);
+		total.meanDelta += diff.meanDelta;
+		total.badFraction += diff.badFraction;
+	}
+};
+
+// Hit rate and error of the wall cache on a pose list. The poses are replayed as the
+// hand held viewer, whose wall view only moves, over a cache whose region is the
+// bounding box of the poses. The first replay starts with an empty cache, the second
+// with what the first left in it. Every pose is also rendered without the cache and
+// the walls blended on a hit are compared with those.
+class WallCacheApp : public GlfwApp {
+	std::string posePath;
+	float cellSize;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> scene;
+
+public:
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+	// Perceptual units, see comparePerceptual
+	float imageTolerance = 6.0f;
+	int replays = 2;
+
+	WallCacheApp(const std::string & posePath, float cellSize)
+		: posePath(posePath), cellSize(cellSize) {}
+
+	int run() override {
+		if (!loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		vec3 low(FLT_MAX), high(-FLT_MAX);
+		for (const BatchPose & bp : poses) {
+			low = glm::min(low, ovr::toGlm(bp.pose.Position));
+			high = glm::max(high, ovr::toGlm(bp.pose.Position));
+		}
+		vec3 extent = high - low + vec3(cellSize);
+		scene->useWallCache(true, (low + high) * 0.5f, std::max(std::max(extent.x, extent.y), extent.z), cellSize);
+		WallCache & cache = *scene->wallCache;
+
+		EyeTarget target;
+		target.create(eyeSize);
+		mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+		StageTimer timer(1);
+		size_t wallBytes = 2048 * 2048 * 3;
+		std::vector<unsigned char> cached(3 * wallBytes), reference(wallBytes);
+
+		for (int replay = 0; replay < replays; replay++) {
+			long long hits = cache.hits, fills = cache.fills, evictions = cache.evictions;
+			double hitMs = 0.0, missMs = 0.0;
+			PerceptualDiff error;
+			for (const BatchPose & bp : poses) {
+				scene->wallCacheEnabled = true;
+				timer.begin(0);
+				renderPose(bp, target, projection);
+				timer.end(0);
+				timer.collect();
+				bool hit = scene->wallsFromCache;
+				(hit ? hitMs : missMs) += timer.gpuMs(0);
+				if (!hit) continue;
+				for (int wall = 0; wall < 3; wall++) {
+					readWall(bp.eyeIdx, wall, &cached[wall * wallBytes]);
+				}
+				scene->wallCacheEnabled = false;
+				renderPose(bp, target, projection);
+				for (int wall = 0; wall < 3; wall++) {
+					readWall(bp.eyeIdx, wall, reference.data());
+					PerceptualDiff diff = comparePerceptual(reference.data(), &cached[wall * wallBytes], 2048, 2048, imageTolerance);
+					error.maxDelta = std::max(error.maxDelta, diff.maxDelta);
+					error.meanDelta += diff.meanDelta / 3.0;
+					error.badFraction += diff.badFraction / 3.0;
+				}
+			}
+			hits = cache.hits - hits;
+			long long misses = (long long)poses.size() - hits;
+			std::cout << "replay " << replay + 1 << ": " << hits << " of " << poses.size() << " poses from the cache ("
+				<< 100.0 * hits / poses.size() << "%), " << cache.fills - fills << " grid points filled, "
+				<< cache.evictions - evictions << " evicted; walls GPU " << (hits ? hitMs / hits : 0.0) << " ms on a hit, "
+				<< (misses ? missMs / misses : 0.0) << " ms otherwise";
+			if (hits) {
+				std::cout << "; error on hits mean delta " << error.meanDelta / hits << ", max " << error.maxDelta
+					<< ", " << 100.0 * error.badFraction / hits << "% over tolerance";
+			}
+			std::cout << std::endl;
+		}
+		scene->reportWallCache();
+		target.destroy();
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		scene = std::shared_ptr<SimScene>(new SimScene());
+	}
+
+	void draw() override {}
+
+private:
+	// Only the walls are compared, so this stops after preRender
+	void renderPose(const BatchPose & bp, EyeTarget & target, const mat4 & projection) {
+		vec3 eyePos = ovr::toGlm(bp.pose.Position);
+		mat4 modelview = glm::inverse(glm::translate(glm::mat4(1.0f), eyePos));
+		scene->currentEye(bp.eyeIdx);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+		glViewport(0, 0, eyeSize.x, eyeSize.y);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene->preRender(projection, modelview, target.fbo, target.viewport(), eyePos);
+	}
+
+	void readWall(int eyeIdx, int wall, unsigned char * out) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, scene->wallFBO(eyeIdx, wall));
+		glReadPixels(0, 0, 2048, 2048, GL_RGB, GL_UNSIGNED_BYTE, out);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+};
+
+// Wall passes against the viewpoint cubemap on a pose list, for CAVEs of 3, 5 and 6
+// walls. Walls past the cave's three are the other faces of its cube, rendered into
+// targets of the benchmark's own; the one cubemap pass stands for any number of walls.
+// Also reports how far the cave drawn from the cubemap is from the one drawn from the
+// walls, in the eye buffer.
+class CubemapBenchApp : public GlfwApp {
+	std::string posePath;
+	int cubemapSize;
+	std::vector<BatchPose> poses;
+	std::shared_ptr<SimScene> scene;
+	GLuint wallArray = 0, wallDepth = 0;
+	GLuint wallFBOs[6];
+
+public:
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+	// Perceptual units, see comparePerceptual
+	float imageTolerance = 6.0f;
+	int repeats = 5;
+
+	CubemapBenchApp(const std::string & posePath, int cubemapSize)
+		: posePath(posePath), cubemapSize(cubemapSize) {}
+
+	int run() override {
+		if (!loadPoseList(posePath, poses)) {
+			return -1;
+		}
+
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+		std::cout << "GL renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+		EyeTarget target;
+		target.create(eyeSize);
+		mat4 projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+		enum { STAGE_WALLS, STAGE_CUBEMAP, STAGE_COUNT };
+		StageTimer timer(STAGE_COUNT);
+		const int wallCounts[3] = { 3, 5, 6 };
+		double wallCpu[3] = { 0.0 }, wallGpu[3] = { 0.0 }, cubemapCpu = 0.0, cubemapGpu = 0.0;
+		std::vector<unsigned char> fromWalls(eyeSize.x * eyeSize.y * 3), fromCubemap(eyeSize.x * eyeSize.y * 3);
+		PerceptualDiff error;
+
+		for (const BatchPose & bp : poses) {
+			mat4 modelview = glm::inverse(ovr::toGlm(bp.pose));
+			vec3 eyePos = ovr::toGlm(bp.pose.Position);
+			scene->currentEye(bp.eyeIdx);
+			for (int r = 0; r < repeats; r++) {
+				for (int i = 0; i < 3; i++) {
+					timer.begin(STAGE_WALLS);
+					renderWalls(wallCounts[i], bp.eyeIdx, modelview, eyePos);
+					timer.end(STAGE_WALLS);
+					timer.collect();
+					wallCpu[i] += timer.cpuMs(STAGE_WALLS);
+					wallGpu[i] += timer.gpuMs(STAGE_WALLS);
+				}
+				timer.begin(STAGE_CUBEMAP);
+				scene->wallGraph.reset();
+				scene->declareViewCubemap(modelview, eyePos);
+				if (scene->wallGraph.compile()) {
+					scene->wallGraph.execute();
+				}
+				timer.end(STAGE_CUBEMAP);
+				timer.collect();
+				cubemapCpu += timer.cpuMs(STAGE_CUBEMAP);
+				cubemapGpu += timer.gpuMs(STAGE_CUBEMAP);
+			}
+
+			renderEye(false, target, projection, modelview, eyePos, fromWalls.data());
+			renderEye(true, target, projection, modelview, eyePos, fromCubemap.data());
+			PerceptualDiff diff = comparePerceptual(fromWalls.data(), fromCubemap.data(), eyeSize.x, eyeSize.y, imageTolerance);
+			error.maxDelta = std::max(error.maxDelta, diff.maxDelta);
+			error.meanDelta += diff.meanDelta / poses.size();
+			error.badFraction += diff.badFraction / poses.size();
+		}
+		target.destroy();
+		glDeleteFramebuffers(6, wallFBOs);
+		glDeleteRenderbuffers(1, &wallDepth);
+		glDeleteTextures(1, &wallArray);
+
+		double runs = (double)poses.size() * repeats;
+		double cubemapTexels = 6.0 * cubemapSize * cubemapSize / 1e6;
+		std::cout << "cubemap of " << cubemapSize << " per face: cpu " << cubemapCpu / runs << " ms, gpu "
+			<< cubemapGpu / runs << " ms, " << cubemapTexels << " M texels per eye" << std::endl;
+		for (int i = 0; i < 3; i++) {
+			std::cout << wallCounts[i] << " walls: cpu " << wallCpu[i] / runs << " ms, gpu " << wallGpu[i] / runs << " ms, "
+				<< wallCounts[i] * 2048.0 * 2048.0 / 1e6 << " M texels per eye; the cubemap takes "
+				<< (wallGpu[i] > 0.0 ? 100.0 * cubemapGpu / wallGpu[i] : 0.0) << "% of the GPU time" << std::endl;
+		}
+		std::cout << "cave from the cubemap against the walls: mean delta " << error.meanDelta << ", max " << error.maxDelta
+			<< ", " << 100.0 * error.badFraction << "% over tolerance" << std::endl;
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		scene = std::shared_ptr<SimScene>(new SimScene());
+		scene->cubemapSize = cubemapSize;
+		if (!scene->initViewCubemap()) {
+			FAIL("The viewpoint cubemap programs did not build");
+		}
+
+		// All six faces of the cave's cube at the walls' density, one depth buffer for all
+		wallArray = SimScene::createWallArray(2048, 6);
+		glGenRenderbuffers(1, &wallDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, wallDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 2048, 2048);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		for (int wall = 0; wall < 6; wall++) {
+			SimScene::createWallLayer(wallFBOs[wall], wallArray, wall);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, wallDepth);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void draw() override {}
+
+private:
+	// The first count faces of the cave's cube the way preRender renders a wall
+	void renderWalls(int count, int eyeIdx, const mat4 & modelview, const vec3 & eyePos) {
+		for (int wall = 0; wall < count; wall++) {
+			vec3 pa, pb, pc;
+			scene->wallCorners(wall, pa, pb, pc);
+			mat4 projection = scene->getProjection(eyePos, pa, pb, pc, 0.01f, 1000.0f);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, wallFBOs[wall]);
+			glViewport(0, 0, 2048, 2048);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			scene->drawWallScene(projection, modelview, SimScene::wallView(eyeIdx, wall), 2048);
+		}
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	}
+
+	// The pose as both the CAVE viewer and the HMD
+	void renderEye(bool cubemap, EyeTarget & target, const mat4 & projection, const mat4 & modelview, const vec3 & eyePos, unsigned char * out) {
+		scene->viewCubemap = cubemap;
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+		glViewport(0, 0, eyeSize.x, eyeSize.y);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene->preRender(projection, modelview, target.fbo, target.viewport(), eyePos);
+		scene->render(projection, modelview, eyePos);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+		glReadPixels(0, 0, eyeSize.x, eyeSize.y, GL_RGB, GL_UNSIGNED_BYTE, out);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+};
+
+// Submission cost of the crowd as it grows. A frame is what the CAVE needs per
+// viewer: every wall through its off-axis projection and the eye view, for both
+// eyes. It is submitted per object, CPU culled into one instanced draw per view, and
+// GPU culled into one multi draw indirect per view where the context supports it.
+//
+// Then the CPU culling of the largest crowd is spread over job pools of 1 up to the
+// hardware's threads: every view is prepared as jobs and only the GL submission runs
+// in order on this thread.
+class IndirectApp : public GlfwApp {
+	std::shared_ptr<SimScene> scene;
+	// The wall views draw here, the scene's walls have no depth buffer outside its frame graph
+	EyeTarget wallTarget;
+
+public:
+	std::vector<int> counts{ 1000, 3000, 10000, 30000, 100000 };
+	int frames = 60, warmupFrames = 5;
+	uvec2 eyeSize{ 1024, 1024 };
+	float eyeFov = 90.0f;
+	float ipd = 0.064f;
+
+	int run() override {
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		EyeTarget target;
+		target.create(eyeSize);
+		wallTarget.create(uvec2(2048, 2048));
+		scene->setCrowd(0);
+		IndirectScene & crowd = *scene->crowd;
+		bool gpuAvailable = crowd.gpuCulling;
+		if (!gpuAvailable) {
+			std::cout << "no compute shaders or multi draw indirect, skipping GPU culling" << std::endl;
+		}
+		const char * modes[3] = { "per object", "CPU culled, instanced", "GPU culled, multi draw indirect" };
+		StageTimer timer(1);
+
+		for (int count : counts) {
+			scene->setCrowd(count);
+			for (int mode = 0; mode < 3; mode++) {
+				if (mode == 2 && !gpuAvailable) continue;
+				crowd.gpuCulling = mode == 2;
+				double cpuMs = 0.0, gpuMs = 0.0;
+				for (int frame = 0; frame < warmupFrames + frames; frame++) {
+					timer.begin(0);
+					renderFrame(mode, target, false);
+					timer.end(0);
+					timer.collect();
+					if (frame < warmupFrames) continue;
+					cpuMs += timer.cpuMs(0);
+					gpuMs += timer.gpuMs(0);
+				}
+				// Counting waits for the GPU after every view, so it gets a frame of its own
+				RenderStats & renderStats = RenderStats::local();
+				renderStats.enabled = true;
+				renderStats.beginFrame(0);
+				int visible = renderFrame(mode, target, true);
+				renderStats.endFrame();
+				renderStats.enabled = false;
+				const RenderCounters & calls = renderStats.lastFrame().total;
+				std::cout << count << " objects, " << modes[mode] << ": " << cpuMs / frames << " ms CPU, "
+					<< gpuMs / frames << " ms GPU per frame, " << visible / 8 << " visible per view, "
+					<< calls.draws << " draws and " << calls.uploadBytes / 1024 << " KB uploaded per frame" << std::endl;
+			}
+		}
+		crowd.gpuCulling = false;
+		double baseMs = 0.0;
+		unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+			ThreadPool pool(threads);
+			double cpuMs = 0.0;
+			for (int frame = 0; frame < warmupFrames + frames; frame++) {
+				timer.begin(0);
+				renderFrame(1, target, false, &pool);
+				timer.end(0);
+				timer.collect();
+				if (frame >= warmupFrames) cpuMs += timer.cpuMs(0);
+			}
+			cpuMs /= frames;
+			if (threads == 1) baseMs = cpuMs;
+			std::cout << crowd.objectCount() << " objects, CPU culled as jobs on " << threads << " threads: "
+				<< cpuMs << " ms CPU per frame, " << baseMs / cpuMs << "x" << std::endl;
+			if (threads == maxThreads) break;
+		}
+		crowd.gpuCulling = gpuAvailable;
+		target.destroy();
+		wallTarget.destroy();
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void initGl() override {
+		SimScene::initGlState();
+		scene = std::shared_ptr<SimScene>(new SimScene());
+	}
+
+	void draw() override {}
+
+private:
+	// Views are eye * 4 + the wall, or 3 for the eye view
+	void viewMatrices(int view, mat4 & projection, mat4 & modelview) const {
+		vec3 eyePos((view / 4 ? 0.5f : -0.5f) * ipd, 0.0f, 0.0f);
+		modelview = glm::inverse(glm::translate(glm::mat4(1.0f), eyePos));
+		int wall = view % 4;
+		if (wall == 3) {
+			projection = glm::perspective(glm::radians(eyeFov), (float)eyeSize.x / eyeSize.y, 0.01f, 1000.0f);
+			return;
+		}
+		vec3 pa, pb, pc;
+		scene->wallCorners(wall, pa, pb, pc);
+		projection = offAxisProjection(eyePos, pa, pb, pc, 0.01f, 1000.0f);
+	}
+
+	// Three walls and the eye view for both eyes, returns the visible objects summed over
+	// the views when countVisible. With a pool the CPU culling of all views is started
+	// as jobs before the first is submitted.
+	int renderFrame(int mode, EyeTarget & target, bool countVisible, ThreadPool * pool = nullptr) {
+		IndirectScene::ViewPacket packets[8];
+		ThreadPool::Job prepared[8];
+		for (int view = 0; view < 8 && pool; view++) {
+			viewMatrices(view, packets[view].projection, packets[view].modelview);
+			prepared[view] = scene->crowd->prepareView(*pool, packets[view]);
+		}
+		int visible = 0;
+		for (int view = 0; view < 8; view++) {
+			if (view % 4 == 3) {
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, eyeSize.x, eyeSize.y);
+			}
+			else {
+				glBindFramebuffer(GL_FRAMEBUFFER, wallTarget.fbo);
+				glViewport(0, 0, 2048, 2048);
+			}
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			if (pool) {
+				pool->wait(prepared[view]);
+				scene->crowd->submitView(scene->indirectShaderProgram, packets[view], scene->cube->texture_ID);
+				visible += countVisible ? scene->crowd->lastVisibleCount() : 0;
+				continue;
+			}
+			mat4 projection, modelview;
+			viewMatrices(view, projection, modelview);
+			visible += renderView(mode, projection, modelview, countVisible);
+		}
+		if (pool) {
+			pool->finishFrame();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return visible;
+	}
+
+	int renderView(int mode, const mat4 & projection, const mat4 & modelview, bool countVisible) {
+		IndirectScene & crowd = *scene->crowd;
+		if (mode == 0) {
+			glUseProgram(scene->cubeShaderProgram);
+			crowd.drawPerObject(scene->cubeShaderProgram, projection, modelview, scene->cube->texture_ID);
+		}
+		else {
+			glUseProgram(scene->indirectShaderProgram);
+			crowd.draw(scene->indirectShaderProgram, projection, modelview, scene->cube->texture_ID);
+		}
+		return countVisible ? crowd.lastVisibleCount() : 0;
+	}
+};
+
+// Load time and memory of a model, parsed from its OBJ and uploaded as floats against
+// mapped from its cooked cache and uploaded as is. Every load ends with a glFinish so
+// the upload is included. The first load of each is the cold one as far as this
+// process goes; the OS file cache is warm for the repeats.
+class MeshLoadApp : public GlfwApp {
+	std::string objPath;
+
+public:
+	int repeats = 10;
+
+	MeshLoadApp(const std::string & objPath) : objPath(objPath) {}
+
+	int run() override {
+		preCreate();
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		window = createRenderingTarget(windowSize, windowPosition);
+		postCreate();
+		initGl();
+
+		// Cooking is a one time cost, keep it out of the measurement
+		{
+			CookedMesh cooked;
+			if (!loadCachedMesh(objPath, cooked)) {
+				return -1;
+			}
+		}
+		std::string cookedPath = cookedMeshPath(objPath);
+
+		double textFirst = 0.0, textTotal = 0.0, cookedFirst = 0.0, cookedTotal = 0.0;
+		size_t textCpuBytes = 0, textGpuBytes = 0, cookedCpuBytes = 0, cookedGpuBytes = 0;
+		for (int i = 0; i < repeats; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!loadText(textCpuBytes, textGpuBytes)) {
+				return -1;
+			}
+			double textMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			start = std::chrono::high_resolution_clock::now();
+			{
+				CookedMesh cooked;
+				if (!cooked.open(cookedPath.c_str())) {
+					std::cerr << "could not map " << cookedPath << std::endl;
+					return -1;
+				}
+				Mesh mesh(cooked);
+				glFinish();
+				cookedCpuBytes = cooked.size();
+				cookedGpuBytes = mesh.gpuBytes;
+			}
+			double cookedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if (i == 0) {
+				textFirst = textMs;
+				cookedFirst = cookedMs;
+			}
+			textTotal += textMs;
+			cookedTotal += cookedMs;
+		}
+		std::cout << "OBJ parse: first load " << textFirst << " ms, mean " << textTotal / repeats << " ms, "
+			<< textCpuBytes / 1024 << " KiB parsed in memory, " << textGpuBytes / 1024 << " KiB on the GPU" << std::endl;
+		std::cout << "cooked mesh: first load " << cookedFirst << " ms, mean " << cookedTotal / repeats << " ms, "
+			<< cookedCpuBytes / 1024 << " KiB mapped, " << cookedGpuBytes / 1024 << " KiB on the GPU" << std::endl;
+
+		// What the meshlet order does for the post-transform cache
+		ImportedMesh imported;
+		if (importObj(objPath.c_str(), imported)) {
+			float importedAcmr = averageCacheMissRatio(imported.indices);
+			std::vector<MeshletRange> meshlets;
+			buildMeshlets(imported, meshlets);
+			std::cout << "ACMR, 32 entry FIFO: " << importedAcmr << " in OBJ order, "
+				<< averageCacheMissRatio(imported.indices) << " in meshlet order" << std::endl;
+		}
+		return 0;
+	}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		return glfw::createWindow(uvec2(64, 64));
+	}
+
+	void draw() override {}
+
+private:
+	// What a loader without the cache does: parse, interleave floats and upload
+	bool loadText(size_t & cpuBytes, size_t & gpuBytes) {
+		ImportedMesh mesh;
+		if (!importObj(objPath.c_str(), mesh)) {
+			return false;
+		}
+		std::vector<GLfloat> vertices(mesh.positions.size() * 8);
+		for (size_t v = 0; v < mesh.positions.size(); v++) {
+			GLfloat * out = &vertices[v * 8];
+			out[0] = mesh.positions[v].x; out[1] = mesh.positions[v].y; out[2] = mesh.positions[v].z;
+			out[3] = mesh.uvs[v].x; out[4] = mesh.uvs[v].y;
+			out[5] = mesh.normals[v].x; out[6] = mesh.normals[v].y; out[7] = mesh.normals[v].z;
+		}
+		GLuint buffers[2];
+		glGenBuffers(2, buffers);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+		glBufferData(GL_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), mesh.indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glFinish();
+		glDeleteBuffers(2, buffers);
+
+		// The file text is held while parsing, then the mesh and its interleaved copy
+		cpuBytes = (size_t)fileSize(objPath) + mesh.positions.size() * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2))
+			+ mesh.indices.size() * sizeof(uint32_t) + vertices.size() * sizeof(GLfloat);
+		gpuBytes = vertices.size() * sizeof(GLfloat) + mesh.indices.size() * sizeof(GLuint);
+		return true;
+	}
+
+	static long long fileSize(const std::string & path) {
+		std::ifstream stream(path, std::ios::in | std::ios::binary | std::ios::ate);
+		return stream.is_open() ? (long long)stream.tellg() : 0;
+	}
+};
+
+// Residual error of the hand prediction on a trace recorded with the T key, no HMD needed
+int evaluatePrediction(const std::string & tracePath, double latency) {
+	std::vector<ovrPoseStatef> trace;
+	if (!loadPoseTrace(tracePath, trace)) {
+		return -1;
+	}
+	PosePredictor configured, constantVelocity, raw;
+	constantVelocity.accelerationWeight = 0.0f;
+	raw.enabled = false;
+	std::pair<const char *, PosePredictor *> variants[] = {
+		{ "no prediction", &raw }, { "constant velocity", &constantVelocity }, { "configured", &configured } };
+	std::cout << trace.size() << " samples, predicting " << latency * 1000.0 << " ms ahead" << std::endl;
+	for (auto & variant : variants) {
+		PredictionError error = variant.second->evaluate(trace, latency);
+		std::cout << variant.first << ": position mean " << error.meanPosition * 1000.0 << " mm, p95 "
+			<< error.p95Position * 1000.0 << " mm, max " << error.maxPosition * 1000.0 << " mm; angle mean "
+			<< glm::degrees(error.meanAngle) << " deg, p95 " << glm::degrees(error.p95Angle) << " deg, max "
+			<< glm::degrees(error.maxAngle) << " deg" << std::endl;
+	}
+	return 0;
+}
+
+// Execute our example class
+// Usage: Minimal.exe [--batch <pose list> <output directory> [contexts]]
+//                    [--regress <pose list> <golden directory> [--update]]
+//                    [--sim-rate <steps per second>] [--model <obj or cooked mesh>]
+//                    [--projectors <projector setup>]
+//                      The projectors swap on a thread of their own and never hold up the HMD's
+//                      frames; they show the latest frame at their own refresh rate. Only with
+//                      WGL_NV_swap_group do they flip together on a vertical blank, otherwise
+//                      they swap without vertical sync and out of step with each other.
+//                    [--projector-test <projector setup> <pose list> <golden directory> [--update]]
+//                    [--evaluate-prediction <hand trace> [latency ms]]
+//                    [--foveation <pose list> [inset fraction]]
+//                    [--wall-cache <pose list> [cell size m]]
+//                    [--cubemap-bench <pose list> [cubemap size]]
+//                    [--indirect [frames per measurement]]
+//                    [--mesh-load <obj> [repeats]]
+int __stdcall WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+	int result = -1;
+	AllocConsole();
+	freopen("conin$", "r", stdin);
+	freopen("conout$", "w", stdout);
+	freopen("conout$", "w", stderr);
+	std::istringstream args(lpCmdLine ? lpCmdLine : "");
+	std::string mode;
+	if (args >> mode && mode == "--batch") {
+		std::string posePath, outputDir;
+		unsigned int contexts = 4;
+		args >> posePath >> outputDir >> contexts;
+		try {
+			result = BatchApp(posePath, outputDir, contexts).run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--cook-virtual-cubemap") {
+		std::string leftDirectory, rightDirectory, outputPath;
+		int tileSize = 128;
+		args >> leftDirectory >> rightDirectory >> outputPath >> tileSize;
+		return cookVirtualCubemap(leftDirectory, rightDirectory, outputPath, tileSize) ? 0 : -1;
+	}
+	if (mode == "--evaluate-prediction") {
+		std::string tracePath;
+		double latencyMs = 30.0;
+		args >> tracePath >> latencyMs;
+		return evaluatePrediction(tracePath, latencyMs / 1000.0);
+	}
+	if (mode == "--foveation") {
+		std::string posePath;
+		float insetFraction = 0.25f;
+		args >> posePath >> insetFraction;
+		try {
+			result = FoveationApp(posePath, insetFraction).run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--wall-cache") {
+		std::string posePath;
+		float cellSize = 0.05f;
+		args >> posePath >> cellSize;
+		try {
+			result = WallCacheApp(posePath, cellSize).run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--cubemap-bench") {
+		std::string posePath;
+		int cubemapSize = 2048;
+		args >> posePath >> cubemapSize;
+		try {
+			result = CubemapBenchApp(posePath, cubemapSize).run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--indirect") {
+		try {
+			IndirectApp app;
+			int frames;
+			if (args >> frames) app.frames = frames;
+			result = app.run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--mesh-load") {
+		std::string objPath;
+		args >> objPath;
+		try {
+			MeshLoadApp app(objPath);
+			int repeats;
+			if (args >> repeats) app.repeats = std::max(repeats, 1);
+			result = app.run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--projector-test") {
+		std::string setupPath, posePath, goldenDir, update;
+		args >> setupPath >> posePath >> goldenDir >> update;
+		try {
+			result = ProjectorTestApp(setupPath, posePath, goldenDir, update == "--update").run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	if (mode == "--regress") {
+		std::string posePath, goldenDir, update;
+		args >> posePath >> goldenDir >> update;
+		try {
+			result = RegressionApp(posePath, goldenDir, update == "--update").run();
+		}
+		catch (std::exception & error) {
+			OutputDebugStringA(error.what());
+			std::cerr << error.what() << std::endl;
+		}
+		return result;
+	}
+	try {
 		if (!OVR_SUCCESS(ovr_Initialize(nullptr))) {
 			FAIL("Failed to initialize the Oculus SDK");
 		}
-		AllocConsole();
-		freopen("conin$", "r", stdin);
-		freopen("conout$", "w", stdout);
-		freopen("conout$", "w", stderr);
-		result = SimApp().run();
+		double simulationRate = 90.0;
+		std::string modelPath, projectorSetup, virtualSkyPath;
+		// The simulator's options, in any order
+		std::string option = mode;
+		do {
+			if (option == "--sim-rate") {
+				args >> simulationRate;
+			}
+			else if (option == "--model") {
+				args >> modelPath;
+			}
+			else if (option == "--projectors") {
+				args >> projectorSetup;
+			}
+			else if (option == "--virtual-sky") {
+				args >> virtualSkyPath;
+			}
+		} while (args >> option);
+		result = SimApp(simulationRate, modelPath, projectorSetup, virtualSkyPath).run();
 	}
 	catch (std::exception & error) {
 		OutputDebugStringA(error.what());
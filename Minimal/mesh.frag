@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec3 Normal;
+in vec2 UV;
+
+out vec3 color;
+
+uniform vec3 lightDirection;
+uniform vec3 baseColor;
+
+void main()
+{
+	// Half lambert, so the side facing away from the light keeps its shape
+	float diffuse = dot(normalize(Normal), normalize(lightDirection)) * 0.5 + 0.5;
+	color = baseColor * diffuse;
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+// Packed vertices of a cooked mesh, see Mesh.h
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+layout (location = 2) in vec2 octNormal;
+
+uniform mat4 projection;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat3 normalMatrix;
+
+out vec3 Normal;
+out vec2 UV;
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+void main()
+{
+	gl_Position = projection * model * view * vec4(position, 1.0);
+	Normal = normalMatrix * octDecode(octNormal);
+	UV = vertexUV;
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 UV;
+in vec2 imageUV;
+
+out vec3 color;
+
+uniform sampler2DArray walls;
+uniform int layer;
+// Linear light attenuation over the projector's image, stored top row first
+uniform sampler2D blend;
+uniform float gamma;
+
+void main()
+{
+    vec3 attenuation = texture(blend, vec2(imageUV.x, 1.0 - imageUV.y)).rgb;
+    // The walls are gamma encoded, so is what the projector is sent
+    color = texture(walls, vec3(UV, layer)).rgb * pow(attenuation, vec3(1.0 / gamma));
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+// A vertex of the warp mesh: where it is in the projector's image, from 0 to 1, and
+// the wall texture coordinates it shows
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 wallUV;
+
+out vec2 UV;
+out vec2 imageUV;
+
+void main()
+{
+    UV = wallUV;
+    imageUV = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -15,8 +15,13 @@ using namespace std;
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "FileIO.h"
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+	return LoadShaders(vertex_file_path, fragment_file_path, nullptr);
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path,const char * vertex_prelude){
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -24,13 +29,7 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
+	if(!readTextFile(vertex_file_path, VertexShaderCode)){
 		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", vertex_file_path);
 		printf("The current working directory is:");
 		// Please for the love of whatever deity/ies you believe in never do something like the next line of code,
@@ -44,15 +43,19 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		return 0;
 	}
 
+	// The prelude goes right after the #version line, which has to stay first
+	if (vertex_prelude) {
+		size_t version = VertexShaderCode.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : VertexShaderCode.find('\n', version);
+		if (lineEnd == std::string::npos) {
+			lineEnd = VertexShaderCode.size();
+		}
+		VertexShaderCode.insert(lineEnd, std::string("\n") + vertex_prelude);
+	}
+
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
+	readTextFile(fragment_file_path, FragmentShaderCode);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
@@ -119,5 +122,137 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	return ProgramID;
+}
+
+// Compiles one stage, prelude inserted after the #version line. 0 if the file is missing.
+static GLuint CompileShaderFile(GLenum type, const char * file_path, const char * prelude){
+	std::string ShaderCode;
+	if(!readTextFile(file_path, ShaderCode)){
+		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", file_path);
+		return 0;
+	}
+	if (prelude) {
+		size_t version = ShaderCode.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : ShaderCode.find('\n', version);
+		if (lineEnd == std::string::npos) {
+			lineEnd = ShaderCode.size();
+		}
+		ShaderCode.insert(lineEnd, std::string("\n") + prelude);
+	}
+
+	GLuint ShaderID = glCreateShader(type);
+	printf("Compiling shader : %s\n", file_path);
+	char const * SourcePointer = ShaderCode.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer , NULL);
+	glCompileShader(ShaderID);
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
+	}
+	return ShaderID;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * geometry_file_path,const char * fragment_file_path,const char * vertex_prelude,const char * geometry_prelude){
+	GLuint ShaderIDs[3] = {
+		CompileShaderFile(GL_VERTEX_SHADER, vertex_file_path, vertex_prelude),
+		CompileShaderFile(GL_GEOMETRY_SHADER, geometry_file_path, geometry_prelude),
+		CompileShaderFile(GL_FRAGMENT_SHADER, fragment_file_path, nullptr)
+	};
+
+	// Link the program
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	for (GLuint ShaderID : ShaderIDs) {
+		if (ShaderID) glAttachShader(ProgramID, ShaderID);
+	}
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+
+	for (GLuint ShaderID : ShaderIDs) {
+		if (!ShaderID) continue;
+		glDetachShader(ProgramID, ShaderID);
+		glDeleteShader(ShaderID);
+	}
+
+	// Callers fall back to another path on 0
+	if (Result != GL_TRUE) {
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+GLuint LoadComputeShader(const char * compute_file_path){
+
+	GLuint ComputeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+
+	std::string ComputeShaderCode;
+	if(!readTextFile(compute_file_path, ComputeShaderCode)){
+		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", compute_file_path);
+		glDeleteShader(ComputeShaderID);
+		return 0;
+	}
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+
+	// Compile Compute Shader
+	printf("Compiling shader : %s\n", compute_file_path);
+	char const * ComputeSourcePointer = ComputeShaderCode.c_str();
+	glShaderSource(ComputeShaderID, 1, &ComputeSourcePointer , NULL);
+	glCompileShader(ComputeShaderID);
+
+	// Check Compute Shader
+	glGetShaderiv(ComputeShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ComputeShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ComputeShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ComputeShaderID, InfoLogLength, NULL, &ComputeShaderErrorMessage[0]);
+		printf("%s\n", &ComputeShaderErrorMessage[0]);
+	}
+	else {
+		printf("Successfully compiled compute shader!\n");
+	}
+
+	// Link the program
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, ComputeShaderID);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+
+	glDetachShader(ProgramID, ComputeShaderID);
+	glDeleteShader(ComputeShaderID);
+
+	// Callers fall back to another path on 0
+	if (Result != GL_TRUE) {
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
 	return ProgramID;
 }
\ No newline at end of file
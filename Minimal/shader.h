@@ -2,5 +2,12 @@
 #define SHADER_HPP
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+// vertex_prelude is inserted after the #version line of the vertex shader, e.g. shared
+// declarations, #extension directives or #defines selecting a variant
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path,const char * vertex_prelude);
+// With a geometry shader between the two, each stage with its own prelude (or nullptr)
+GLuint LoadShaders(const char * vertex_file_path,const char * geometry_file_path,const char * fragment_file_path,const char * vertex_prelude,const char * geometry_prelude);
+// A program of a single compute shader
+GLuint LoadComputeShader(const char * compute_file_path);
 
 #endif
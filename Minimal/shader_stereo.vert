@@ -0,0 +1,17 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+layout (location = 2) in int wallIndex;
+
+uniform mat4 toWorld;
+
+out vec2 UV;
+flat out int wall;
+
+void main()
+{
+    stereoOutput(eyeProjection[gl_InstanceID] * eyeView[gl_InstanceID] * toWorld * vec4(position, 1.0));
+    UV = vertexUV;
+    wall = wallIndex;
+}
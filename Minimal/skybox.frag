@@ -1,4 +1,4 @@
-#version 330 core
+#version 400 core
 // Andy Thai
 
 struct DirLight {
@@ -19,6 +19,9 @@ out vec4 color;
 
 // Uniform
 uniform samplerCube skybox;
+// The stereo sets, one layer per eye. A layer of -1 samples skybox instead.
+uniform samplerCubeArray stereoSkybox;
+uniform int layer;
 uniform DirLight dirLight;
 
 
@@ -26,5 +29,6 @@ void main()
 {
     vec3 norm = normalize(Normal);
 	vec3 l = normalize(dirLight.direction);
-    color = texture(skybox, TexCoords);
+    if (layer < 0) color = texture(skybox, TexCoords);
+    else color = texture(stereoSkybox, vec4(TexCoords, layer));
 }
\ No newline at end of file
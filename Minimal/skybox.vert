@@ -1,4 +1,4 @@
-#version 330 core
+#version 400 core
 // Andy Thai
 // NOTE: Do NOT use any version older than 330! Bad things will happen!
 
@@ -0,0 +1,20 @@
+#version 400 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+
+uniform mat4 model;
+
+out vec3 TexCoords;
+out vec3 Normal;
+
+void main()
+{
+    // Make skybox seem infinitely far away
+    mat4 view = eyeView[gl_InstanceID];
+    view[3].xyz = vec3(0.0);
+    stereoOutput(eyeProjection[gl_InstanceID] * model * view * vec4(position, 1.0));
+    TexCoords = position;
+    TexCoords.x *= -1;
+    Normal = mat3(transpose(inverse(model))) * normal;
+}
@@ -0,0 +1,91 @@
+#version 400 core
+// The stereo sets as a virtual cubemap, see VirtualCubemap.h. Used with skybox.vert.
+
+in vec3 TexCoords;
+in vec3 Normal;
+
+out vec4 color;
+
+uniform samplerCube skybox;
+// The eye, -1 samples skybox instead
+uniform int layer;
+// Per eye and face a layer, per tile level a mip level: the slot and level of the tile
+// serving each page
+uniform usampler2DArray pageTable;
+// The resident tiles, one per layer, each with a border around it
+uniform sampler2DArray tiles;
+uniform int pagesPerSide;
+uniform int levels;
+uniform int tileSize;
+uniform int tileStride;
+// Instead of the color, write the page this texel wants, for VirtualCubemap::readFeedback
+uniform bool feedback;
+uniform float lodBias;
+
+// The face r selects and the directions of its s, t and major axes, as in the GL
+// spec's cube map face selection table
+int cubeFace(vec3 r, out vec3 sAxis, out vec3 tAxis, out vec3 major)
+{
+	vec3 a = abs(r);
+	if (a.x >= a.y && a.x >= a.z) {
+		tAxis = vec3(0.0, -1.0, 0.0);
+		if (r.x > 0.0) { sAxis = vec3(0.0, 0.0, -1.0); major = vec3(1.0, 0.0, 0.0); return 0; }
+		sAxis = vec3(0.0, 0.0, 1.0); major = vec3(-1.0, 0.0, 0.0); return 1;
+	}
+	if (a.y >= a.z) {
+		sAxis = vec3(1.0, 0.0, 0.0);
+		if (r.y > 0.0) { tAxis = vec3(0.0, 0.0, 1.0); major = vec3(0.0, 1.0, 0.0); return 2; }
+		tAxis = vec3(0.0, 0.0, -1.0); major = vec3(0.0, -1.0, 0.0); return 3;
+	}
+	tAxis = vec3(0.0, -1.0, 0.0);
+	if (r.z > 0.0) { sAxis = vec3(1.0, 0.0, 0.0); major = vec3(0.0, 0.0, 1.0); return 4; }
+	sAxis = vec3(-1.0, 0.0, 0.0); major = vec3(0.0, 0.0, -1.0); return 5;
+}
+
+ivec2 pageAt(vec2 uv, int level)
+{
+	int pages = max(pagesPerSide >> level, 1);
+	return min(ivec2(uv * float(pages)), ivec2(pages - 1));
+}
+
+// One level, from its own tile or the coarser one standing in for it
+vec3 sampleLevel(int eyeFace, vec2 uv, int level)
+{
+	uvec2 entry = texelFetch(pageTable, ivec3(pageAt(uv, level), eyeFace), level).rg;
+	int tileLevel = int(entry.g);
+	vec2 local = uv * float(max(pagesPerSide >> tileLevel, 1)) - vec2(pageAt(uv, tileLevel));
+	vec2 st = (float(tileStride - tileSize) * 0.5 + local * float(tileSize)) / float(tileStride);
+	return textureLod(tiles, vec3(st, float(entry.r)), 0.0).rgb;
+}
+
+void main()
+{
+	if (layer < 0) {
+		color = feedback ? vec4(0.0) : texture(skybox, TexCoords);
+		return;
+	}
+	vec3 sAxis, tAxis, major;
+	int face = cubeFace(TexCoords, sAxis, tAxis, major);
+	float m = dot(major, TexCoords);
+	vec2 projected = vec2(dot(sAxis, TexCoords), dot(tAxis, TexCoords)) / m;
+	vec2 uv = clamp(projected * 0.5 + 0.5, 0.0, 1.0);
+
+	// The footprint through this face's projection, which unlike uv itself stays smooth
+	// where neighbouring texels fall on another face
+	vec3 dx = dFdx(TexCoords), dy = dFdy(TexCoords);
+	vec2 uvdx = 0.5 * (vec2(dot(sAxis, dx), dot(tAxis, dx)) - projected * dot(major, dx)) / m;
+	vec2 uvdy = 0.5 * (vec2(dot(sAxis, dy), dot(tAxis, dy)) - projected * dot(major, dy)) / m;
+	float texels = float(pagesPerSide * tileSize);
+	float lod = log2(max(length(uvdx), length(uvdy)) * texels) + lodBias;
+	lod = clamp(lod, 0.0, float(levels - 1));
+	int fine = int(lod);
+
+	if (feedback) {
+		ivec2 page = pageAt(uv, fine);
+		color = vec4(float(page.x), float(page.y), float(fine | face << 4 | layer << 7), 255.0) / 255.0;
+		return;
+	}
+	int eyeFace = layer * 6 + face;
+	int coarse = min(fine + 1, levels - 1);
+	color = vec4(mix(sampleLevel(eyeFace, uv, fine), sampleLevel(eyeFace, uv, coarse), lod - float(fine)), 1.0);
+}
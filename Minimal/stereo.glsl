@@ -0,0 +1,34 @@
+// Instanced stereo: inserted after #version into the *_stereo.vert shaders by LoadShaders.
+// Every draw is issued with two instances and gl_InstanceID picks the eye.
+
+layout (std140) uniform StereoEyes
+{
+    mat4 eyeProjection[2];
+    mat4 eyeView[2];
+    // xy scale and zw offset that move an eye's clip space into its half of the target
+    vec4 eyeViewport[2];
+    // left, right, bottom and top of the eye's half in normalized device coordinates
+    vec4 eyeBounds[2];
+};
+
+flat out int stereoEye;
+
+void stereoOutput(vec4 clipPosition)
+{
+    stereoEye = gl_InstanceID;
+#ifdef STEREO_VIEWPORT_INDEX
+    // One viewport per eye, the rasterizer does the rest
+    gl_ViewportIndex = gl_InstanceID;
+    gl_Position = clipPosition;
+#else
+    // One viewport over both eyes, squeeze into this eye's half and clip at its edges
+    vec4 p = clipPosition;
+    p.xy = p.xy * eyeViewport[gl_InstanceID].xy + eyeViewport[gl_InstanceID].zw * p.w;
+    vec4 bounds = eyeBounds[gl_InstanceID];
+    gl_ClipDistance[0] = p.x - bounds.x * p.w;
+    gl_ClipDistance[1] = bounds.y * p.w - p.x;
+    gl_ClipDistance[2] = p.y - bounds.z * p.w;
+    gl_ClipDistance[3] = bounds.w * p.w - p.y;
+    gl_Position = p;
+#endif
+}
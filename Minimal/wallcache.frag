@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+// Every entry is three layers, left, right and bottom wall
+uniform sampler2DArray entries;
+uniform int wall;
+// The cached grid points around the eye, their first layers and trilinear weights
+uniform int corners;
+uniform int layers[8];
+uniform float weights[8];
+
+void main()
+{
+    color = vec3(0.0);
+    for (int i = 0; i < corners; i++) {
+        color += texture(entries, vec3(UV, layers[i] + wall)).rgb * weights[i];
+    }
+}
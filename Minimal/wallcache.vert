@@ -0,0 +1,11 @@
+#version 330 core
+
+// One triangle covering the whole target, from the vertex index alone
+out vec2 UV;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    UV = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}